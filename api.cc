@@ -1,5 +1,13 @@
+#include <sstream>
 #include "api.h"
 #include "http_session.h"
+#include "frame_pool.h"
+#include "tcp_connection.h"
+#include "io_uring_loop.h"
+#include "udp_transport.h"
+#include "rtsp_multicast.h"
+#include "rtcp_scheduler.h"
+#include "rtcp_feedback.h"
 
 using simple_rtmp::http_session_ptr;
 using simple_rtmp::http_request_ptr;
@@ -10,7 +18,224 @@ void hello_world(http_session_ptr& session, http_request_ptr& request)
     session->write(request, response);
 }
 
+void frame_pool_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::frame_pool::stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"pools\":" << stats.pools << ",";
+    ss << "\"hits\":" << stats.hits << ",";
+    ss << "\"misses\":" << stats.misses << ",";
+    ss << "\"hit_rate\":" << stats.hit_rate() << ",";
+    ss << "\"remote_frees\":" << stats.remote_frees << ",";
+    ss << "\"oversize\":" << stats.oversize << ",";
+    ss << "\"slab_bytes\":" << stats.slab_bytes << ",";
+    ss << "\"released_slabs\":" << stats.released_slabs;
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+void write_queue_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::tcp_connection::stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"dropped_frames\":" << stats.dropped_frames << ",";
+    ss << "\"dropped_bytes\":" << stats.dropped_bytes << ",";
+    ss << "\"queue_delay_ms\":" << stats.queue_delay_ms << ",";
+    ss << "\"avg_queue_delay_ms\":" << stats.avg_queue_delay_ms() << ",";
+    ss << "\"max_queue_delay_ms\":" << stats.max_queue_delay_ms << ",";
+    ss << "\"disconnects\":" << stats.disconnects << ",";
+    ss << "\"write_batches\":" << stats.write_batches << ",";
+    ss << "\"zerocopy_sends\":" << stats.zerocopy_sends << ",";
+    ss << "\"zerocopy_copied\":" << stats.zerocopy_copied << ",";
+    ss << "\"zerocopy_fallbacks\":" << stats.zerocopy_fallbacks;
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+static void write_json_string(std::stringstream& ss, const std::string& str)
+{
+    ss << "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            ss << '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20)
+        {
+            ss << c;
+        }
+    }
+    ss << "\"";
+}
+
+void connection_memory_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::tcp_connection::memory_stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"connections\":" << stats.connections << ",";
+    ss << "\"object_bytes\":" << stats.object_bytes << ",";
+    ss << "\"read_size_bytes\":" << stats.read_size_bytes << ",";
+    ss << "\"read_grows\":" << stats.read_grows << ",";
+    ss << "\"read_shrinks\":" << stats.read_shrinks << ",";
+    ss << "\"vectored_reads\":" << stats.vectored_reads << ",";
+    ss << "\"compacted_reads\":" << stats.compacted_reads << ",";
+    ss << "\"list\":[";
+    auto conns = simple_rtmp::tcp_connection::connections();
+    for (std::size_t i = 0; i < conns.size(); i++)
+    {
+        const auto& c = conns[i];
+        ss << (i == 0 ? "{" : ",{");
+        ss << "\"local\":";
+        write_json_string(ss, c.local);
+        ss << ",\"remote\":";
+        write_json_string(ss, c.remote);
+        ss << ",\"memory_bytes\":" << c.memory_bytes;
+        ss << ",\"queued_bytes\":" << c.queued_bytes;
+        ss << ",\"queue_delay_ms\":" << c.queue_delay_ms;
+        ss << "}";
+    }
+    ss << "]";
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+void timeout_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::tcp_connection::timeout_stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"handshake\":" << stats.handshake << ",";
+    ss << "\"idle\":" << stats.idle << ",";
+    ss << "\"keepalive\":" << stats.keepalive << ",";
+    ss << "\"write_stall\":" << stats.write_stall << ",";
+    ss << "\"reaped_bytes\":" << stats.reaped_bytes;
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+void udp_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::udp_transport::stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"transports\":" << stats.transports << ",";
+    ss << "\"packets\":" << stats.packets << ",";
+    ss << "\"bytes\":" << stats.bytes << ",";
+    ss << "\"syscalls\":" << stats.syscalls << ",";
+    ss << "\"gso_messages\":" << stats.gso_messages << ",";
+    ss << "\"dropped\":" << stats.dropped << ",";
+    ss << "\"rtcp_received\":" << stats.rtcp_received;
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+void multicast_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::rtsp_multicast::stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"groups\":" << stats.groups << ",";
+    ss << "\"viewers\":" << stats.viewers << ",";
+    ss << "\"packets\":" << stats.packets << ",";
+    ss << "\"bytes\":" << stats.bytes << ",";
+    ss << "\"dropped\":" << stats.dropped;
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+void rtcp_info(http_session_ptr& session, http_request_ptr& request)
+{
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"sender_reports\":" << simple_rtmp::rtcp_scheduler::reports();
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+static void write_track_quality(std::stringstream& ss, const simple_rtmp::track_quality& q)
+{
+    ss << "{";
+    ss << "\"reports\":" << q.reports << ",";
+    ss << "\"fraction_lost\":" << q.fraction_lost << ",";
+    ss << "\"network_loss\":" << q.network_loss << ",";
+    ss << "\"cumulative_lost\":" << q.cumulative_lost << ",";
+    ss << "\"jitter_ms\":" << q.jitter_ms << ",";
+    ss << "\"rtt_ms\":" << q.rtt_ms << ",";
+    ss << "\"dropped\":" << q.dropped;
+    ss << "}";
+}
+
+void rtsp_viewers_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto viewers = simple_rtmp::rtcp_feedback::viewers();
+    std::stringstream ss;
+    ss << "[";
+    for (std::size_t i = 0; i < viewers.size(); i++)
+    {
+        const auto& v = viewers[i];
+        ss << (i == 0 ? "{" : ",{");
+        ss << "\"session\":";
+        write_json_string(ss, v.session);
+        ss << ",\"stream\":";
+        write_json_string(ss, v.stream);
+        ss << ",\"remote\":";
+        write_json_string(ss, v.remote);
+        ss << ",\"transport\":";
+        write_json_string(ss, v.transport);
+        ss << ",\"keyframe_only\":" << (v.keyframe_only ? "true" : "false");
+        ss << ",\"video\":";
+        write_track_quality(ss, v.video);
+        ss << ",\"audio\":";
+        write_track_quality(ss, v.audio);
+        ss << "}";
+    }
+    ss << "]";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
+void io_uring_info(http_session_ptr& session, http_request_ptr& request)
+{
+    auto stats = simple_rtmp::io_uring_loop::stats();
+    std::stringstream ss;
+    ss << "{";
+    ss << "\"loops\":" << stats.loops << ",";
+    ss << "\"enters\":" << stats.enters << ",";
+    ss << "\"sqes\":" << stats.sqes << ",";
+    ss << "\"cqes\":" << stats.cqes << ",";
+    ss << "\"recv_bytes\":" << stats.recv_bytes << ",";
+    ss << "\"send_bytes\":" << stats.send_bytes << ",";
+    ss << "\"zerocopy_sends\":" << stats.zerocopy_sends << ",";
+    ss << "\"zerocopy_copied\":" << stats.zerocopy_copied << ",";
+    ss << "\"recv_no_buffers\":" << stats.recv_no_buffers << ",";
+    ss << "\"recv_copied\":" << stats.recv_copied << ",";
+    ss << "\"sqe_full\":" << stats.sqe_full;
+    ss << "}";
+    auto response = session->create_response(request, 200, ss.str());
+    session->write(request, response);
+}
+
 void simple_rtmp::register_api()
 {
     simple_rtmp::http_session::register_request_cb("/api/v1/hello", std::bind(hello_world, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/frame_pool", std::bind(frame_pool_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/write_queue", std::bind(write_queue_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/connections", std::bind(connection_memory_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/timeouts", std::bind(timeout_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/io_uring", std::bind(io_uring_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/udp", std::bind(udp_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/multicast", std::bind(multicast_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/rtcp", std::bind(rtcp_info, std::placeholders::_1, std::placeholders::_2));
+    simple_rtmp::http_session::register_request_cb("/api/v1/rtsp_viewers", std::bind(rtsp_viewers_info, std::placeholders::_1, std::placeholders::_2));
 }
@@ -0,0 +1,861 @@
+// 端到端分发性能测试
+// 一个推流端把 flv 文件按时间戳实时推到 1935，同时在进程内起 N 个 rtmp(1936)、rtsp(8554 tcp 交织)、http-flv(8081) 播放端
+// 推流时间戳就是发送时刻(相对测试开始的毫秒数)，播放端收到视频帧时用当前时间减去时间戳得到端到端延迟
+// 服务端的 cpu 和内存从 /proc 读取，和只有推流时的基线比较得到每个播放者的开销
+// 系统调用数用 perf stat 统计 raw_syscalls:sys_enter，包括 sendmsg/recvmsg/epoll_wait/io_uring_enter，需要 perf 和相应权限，没有时不输出
+// 服务端由这里启动时继承环境变量，SIMPLE_RTMP_IO_BACKEND=io_uring 可以对比两种读写实现，见 io_backend_compare.sh
+//
+// fanout_bench <simple_rtmp 路径|已运行的服务端 pid> <h264/aac flv 文件> [每种协议的播放者个数] [测试秒数]
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <boost/asio.hpp>
+#include "execution.h"
+
+extern "C"
+{
+#include "rtmp-client.h"
+#include "flv-reader.h"
+#include "flv-proto.h"
+}
+
+namespace
+{
+const char* kApp = "live";
+const char* kStream = "bench";
+const uint16_t kPublishPort = 1935;
+const uint16_t kRtmpPort = 1936;
+const uint16_t kRtspPort = 8554;
+const uint16_t kHttpPort = 8081;
+const int kWarmupSeconds = 3;
+const int kBaselineSeconds = 3;
+
+const auto kStart = std::chrono::steady_clock::now();
+
+uint32_t now_ms()
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - kStart).count());
+}
+
+uint32_t read_be16(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 8) | p[1];
+}
+uint32_t read_be24(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+}
+uint32_t read_be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+// 热身结束后才开始统计，避免 gop 缓存里的旧帧把延迟拉高
+std::atomic<bool> recording{false};
+
+// 每个播放端只在自己的线程上修改，测试结束停掉线程后再汇总
+struct player_stats
+{
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> bytes{0};
+    std::vector<uint32_t> latency;
+    bool playing = false;
+
+    void on_bytes(std::size_t n)
+    {
+        if (recording.load(std::memory_order_relaxed))
+        {
+            bytes.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+    void on_frame(bool video, uint32_t timestamp)
+    {
+        playing = true;
+        if (!recording.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        frames.fetch_add(1, std::memory_order_relaxed);
+        uint32_t const now = now_ms();
+        if (video && now >= timestamp)
+        {
+            latency.push_back(now - timestamp);
+        }
+    }
+};
+
+class client : public std::enable_shared_from_this<client>
+{
+   public:
+    explicit client(boost::asio::io_context& io) : socket_(io)
+    {
+    }
+    virtual ~client() = default;
+
+   public:
+    void start(uint16_t port)
+    {
+        auto self = shared_from_this();
+        boost::asio::ip::tcp::endpoint ed(boost::asio::ip::make_address("127.0.0.1"), port);
+        socket_.async_connect(ed,
+                              [this, self](boost::system::error_code ec)
+                              {
+                                  if (ec)
+                                  {
+                                      fprintf(stderr, "connect failed %s\n", ec.message().c_str());
+                                      return;
+                                  }
+                                  socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+                                  on_connect();
+                                  do_read();
+                              });
+    }
+    void close()
+    {
+        boost::system::error_code ec;
+        socket_.close(ec);
+    }
+    player_stats& stats()
+    {
+        return stats_;
+    }
+    boost::asio::any_io_executor socket_executor()
+    {
+        return socket_.get_executor();
+    }
+
+   protected:
+    virtual void on_connect() = 0;
+    virtual void on_data(const uint8_t* data, std::size_t bytes) = 0;
+
+    void send(const void* data, std::size_t bytes)
+    {
+        const auto* p = static_cast<const uint8_t*>(data);
+        pending_.insert(pending_.end(), p, p + bytes);
+        do_write();
+    }
+
+   private:
+    void do_read()
+    {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(buf_),
+                                [this, self](boost::system::error_code ec, std::size_t bytes)
+                                {
+                                    if (ec)
+                                    {
+                                        return;
+                                    }
+                                    stats_.on_bytes(bytes);
+                                    on_data(buf_.data(), bytes);
+                                    do_read();
+                                });
+    }
+    void do_write()
+    {
+        if (!writing_.empty() || pending_.empty())
+        {
+            return;
+        }
+        writing_.swap(pending_);
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_,
+                                 boost::asio::buffer(writing_),
+                                 [this, self](boost::system::error_code ec, std::size_t /*bytes*/)
+                                 {
+                                     writing_.clear();
+                                     if (!ec)
+                                     {
+                                         do_write();
+                                     }
+                                 });
+    }
+
+   protected:
+    player_stats stats_;
+    boost::asio::ip::tcp::socket socket_;
+
+   private:
+    std::array<uint8_t, 64 * 1024> buf_;
+    std::vector<uint8_t> pending_;
+    std::vector<uint8_t> writing_;
+};
+
+// librtmp 的客户端，推流和 rtmp 播放共用
+class rtmp_client : public client
+{
+   public:
+    rtmp_client(boost::asio::io_context& io, uint16_t port, bool publish) : client(io), publish_(publish)
+    {
+        struct rtmp_client_handler_t handler;
+        memset(&handler, 0, sizeof(handler));
+        handler.send = rtmp_send;
+        handler.onaudio = rtmp_onaudio;
+        handler.onvideo = rtmp_onvideo;
+        handler.onscript = rtmp_onscript;
+        std::string const tcurl = "rtmp://127.0.0.1:" + std::to_string(port) + "/" + kApp;
+        rtmp_ = rtmp_client_create(kApp, kStream, tcurl.c_str(), this, &handler);
+    }
+    ~rtmp_client() override
+    {
+        rtmp_client_destroy(rtmp_);
+    }
+
+   public:
+    bool ready()
+    {
+        return rtmp_client_getstate(rtmp_) == RTMP_STATE_START;
+    }
+    void push(int type, const std::vector<uint8_t>& data, uint32_t timestamp)
+    {
+        if (type == FLV_TYPE_VIDEO)
+        {
+            rtmp_client_push_video(rtmp_, data.data(), data.size(), timestamp);
+        }
+        else if (type == FLV_TYPE_AUDIO)
+        {
+            rtmp_client_push_audio(rtmp_, data.data(), data.size(), timestamp);
+        }
+        else if (type == FLV_TYPE_SCRIPT)
+        {
+            rtmp_client_push_script(rtmp_, data.data(), data.size(), timestamp);
+        }
+    }
+
+   private:
+    void on_connect() override
+    {
+        rtmp_client_start(rtmp_, publish_ ? 1 : 0);
+    }
+    void on_data(const uint8_t* data, std::size_t bytes) override
+    {
+        rtmp_client_input(rtmp_, data, bytes);
+    }
+
+    static int rtmp_send(void* param, const void* header, size_t len, const void* data, size_t bytes)
+    {
+        auto* self = static_cast<rtmp_client*>(param);
+        self->send(header, len);
+        if (bytes > 0)
+        {
+            self->send(data, bytes);
+        }
+        return static_cast<int>(len + bytes);
+    }
+    static int rtmp_onvideo(void* param, const void* data, size_t bytes, uint32_t timestamp)
+    {
+        const auto* p = static_cast<const uint8_t*>(data);
+        // 只统计 avc nalu，跳过 sequence header
+        if (bytes > 1 && p[1] == 1)
+        {
+            static_cast<rtmp_client*>(param)->stats_.on_frame(true, timestamp);
+        }
+        return 0;
+    }
+    static int rtmp_onaudio(void* param, const void* /*data*/, size_t /*bytes*/, uint32_t timestamp)
+    {
+        static_cast<rtmp_client*>(param)->stats_.on_frame(false, timestamp);
+        return 0;
+    }
+    static int rtmp_onscript(void* /*param*/, const void* /*data*/, size_t /*bytes*/, uint32_t /*timestamp*/)
+    {
+        return 0;
+    }
+
+   private:
+    bool publish_ = false;
+    rtmp_client_t* rtmp_ = nullptr;
+};
+
+// 按收到的字节流解析的播放端
+class stream_client : public client
+{
+   public:
+    using client::client;
+
+   protected:
+    void on_data(const uint8_t* data, std::size_t bytes) override
+    {
+        buffer_.insert(buffer_.end(), data, data + bytes);
+        std::size_t used = 0;
+        while (true)
+        {
+            std::size_t const n = parse(buffer_.data() + used, buffer_.size() - used);
+            if (n == 0)
+            {
+                break;
+            }
+            used += n;
+        }
+        buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(used));
+    }
+    // 返回用掉的字节数，0 表示数据不够
+    virtual std::size_t parse(const uint8_t* data, std::size_t bytes) = 0;
+
+    // 一个完整的 rtsp/http 响应头(加上 Content-Length 的内容)的长度
+    static std::size_t response_size(const uint8_t* data, std::size_t bytes, std::string* response)
+    {
+        std::string const text(reinterpret_cast<const char*>(data), bytes);
+        auto pos = text.find("\r\n\r\n");
+        if (pos == std::string::npos)
+        {
+            return 0;
+        }
+        std::size_t size = pos + 4;
+        auto length = text.find("Content-Length: ");
+        if (length != std::string::npos && length < pos)
+        {
+            size += strtoul(text.c_str() + length + 16, nullptr, 10);
+        }
+        if (size > bytes)
+        {
+            return 0;
+        }
+        *response = text.substr(0, size);
+        return size;
+    }
+
+   private:
+    std::vector<uint8_t> buffer_;
+};
+
+class rtsp_client : public stream_client
+{
+   public:
+    explicit rtsp_client(boost::asio::io_context& io) : stream_client(io)
+    {
+    }
+
+   private:
+    void on_connect() override
+    {
+        url_ = "rtsp://127.0.0.1:" + std::to_string(kRtspPort) + "/" + kApp + "/" + kStream;
+        request("DESCRIBE", url_, "Accept: application/sdp\r\n");
+    }
+
+    void request(const std::string& method, const std::string& url, const std::string& headers)
+    {
+        std::string req = method + " " + url + " RTSP/1.0\r\n";
+        req += "CSeq: " + std::to_string(++cseq_) + "\r\n";
+        if (!session_.empty())
+        {
+            req += "Session: " + session_ + "\r\n";
+        }
+        req += headers + "\r\n";
+        send(req.data(), req.size());
+    }
+
+    std::size_t parse(const uint8_t* data, std::size_t bytes) override
+    {
+        if (bytes < 4)
+        {
+            return 0;
+        }
+        if (data[0] == '$')
+        {
+            std::size_t const size = 4 + read_be16(data + 2);
+            if (size > bytes)
+            {
+                return 0;
+            }
+            on_interleaved(data[1], data + 4, size - 4);
+            return size;
+        }
+        std::string response;
+        std::size_t const size = response_size(data, bytes, &response);
+        if (size != 0)
+        {
+            on_response(response);
+        }
+        return size;
+    }
+
+    void on_response(const std::string& response)
+    {
+        auto pos = response.find("Session: ");
+        if (session_.empty() && pos != std::string::npos)
+        {
+            auto end = response.find_first_of(";\r", pos);
+            session_ = response.substr(pos + 9, end - pos - 9);
+        }
+        if (step_ == 0)
+        {
+            video_ = response.find("a=control:track1") != std::string::npos;
+            audio_ = response.find("a=control:track2") != std::string::npos;
+        }
+        step_++;
+        if (step_ == 1 && video_)
+        {
+            request("SETUP", url_ + "/track1", "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n");
+            return;
+        }
+        if (step_ <= 2 && audio_)
+        {
+            step_ = 2;
+            request("SETUP", url_ + "/track2", "Transport: RTP/AVP/TCP;unicast;interleaved=2-3\r\n");
+            return;
+        }
+        if (step_ <= 3)
+        {
+            step_ = 3;
+            request("PLAY", url_, "Range: npt=0.000-\r\n");
+        }
+    }
+
+    void on_interleaved(int channel, const uint8_t* rtp, std::size_t bytes)
+    {
+        if (bytes < 12 || (channel != 0 && channel != 2))
+        {
+            return;
+        }
+        bool const marker = (rtp[1] & 0x80) != 0;
+        uint32_t const timestamp = read_be32(rtp + 4);
+        if (channel == 0 && marker)
+        {
+            // 服务端视频 rtp 时间戳是 pts * 90
+            stats_.on_frame(true, timestamp / 90);
+        }
+        else if (channel == 2)
+        {
+            stats_.on_frame(false, 0);
+        }
+    }
+
+   private:
+    std::string url_;
+    std::string session_;
+    int cseq_ = 0;
+    int step_ = 0;
+    bool video_ = false;
+    bool audio_ = false;
+};
+
+class flv_client : public stream_client
+{
+   public:
+    explicit flv_client(boost::asio::io_context& io) : stream_client(io)
+    {
+    }
+
+   private:
+    void on_connect() override
+    {
+        std::string req = std::string("GET /") + kApp + "/" + kStream + ".flv HTTP/1.1\r\n";
+        req += "Host: 127.0.0.1:" + std::to_string(kHttpPort) + "\r\n\r\n";
+        send(req.data(), req.size());
+    }
+
+    std::size_t parse(const uint8_t* data, std::size_t bytes) override
+    {
+        static const std::size_t kFlvHeaderSize = 9 + 4;
+        static const std::size_t kTagHeaderSize = 11;
+        if (state_ == 0)
+        {
+            std::string response;
+            std::size_t const size = response_size(data, bytes, &response);
+            state_ = size != 0 ? 1 : 0;
+            return size;
+        }
+        if (state_ == 1)
+        {
+            if (bytes < kFlvHeaderSize)
+            {
+                return 0;
+            }
+            state_ = 2;
+            return kFlvHeaderSize;
+        }
+        if (bytes < kTagHeaderSize)
+        {
+            return 0;
+        }
+        std::size_t const size = kTagHeaderSize + read_be24(data + 1) + 4;
+        if (size > bytes)
+        {
+            return 0;
+        }
+        uint32_t const timestamp = read_be24(data + 4) | (static_cast<uint32_t>(data[7]) << 24);
+        if (data[0] == FLV_TYPE_VIDEO && size > kTagHeaderSize + 4 + 1 && data[kTagHeaderSize + 1] == 1)
+        {
+            stats_.on_frame(true, timestamp);
+        }
+        else if (data[0] == FLV_TYPE_AUDIO)
+        {
+            stats_.on_frame(false, timestamp);
+        }
+        return size;
+    }
+
+   private:
+    int state_ = 0;
+};
+
+struct flv_tag
+{
+    int type;
+    uint32_t timestamp;
+    std::vector<uint8_t> data;
+};
+
+std::vector<flv_tag> load_flv(const char* file)
+{
+    std::vector<flv_tag> tags;
+    void* reader = flv_reader_create(file);
+    if (reader == nullptr)
+    {
+        return tags;
+    }
+    std::vector<uint8_t> buf(4 * 1024 * 1024);
+    int type = 0;
+    uint32_t timestamp = 0;
+    size_t taglen = 0;
+    while (flv_reader_read(reader, &type, &timestamp, &taglen, buf.data(), buf.size()) > 0)
+    {
+        tags.push_back(flv_tag{type, timestamp, std::vector<uint8_t>(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(taglen))});
+    }
+    flv_reader_destroy(reader);
+    return tags;
+}
+
+// 按文件里的时间戳实时推流，文件结束后接着从头推，时间戳连续
+class publisher
+{
+   public:
+    publisher(boost::asio::io_context& io, std::vector<flv_tag> tags) : timer_(io), tags_(std::move(tags)), rtmp_(std::make_shared<rtmp_client>(io, kPublishPort, true))
+    {
+    }
+
+   public:
+    void start()
+    {
+        rtmp_->start(kPublishPort);
+        schedule();
+    }
+
+   private:
+    void schedule()
+    {
+        timer_.expires_after(std::chrono::milliseconds(5));
+        timer_.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                if (!ec)
+                {
+                    tick();
+                    schedule();
+                }
+            });
+    }
+    void tick()
+    {
+        if (!rtmp_->ready())
+        {
+            return;
+        }
+        if (base_ == 0)
+        {
+            base_ = now_ms();
+        }
+        uint32_t const now = now_ms();
+        while (true)
+        {
+            const flv_tag& tag = tags_[index_];
+            uint32_t const timestamp = base_ + offset_ + tag.timestamp;
+            if (timestamp > now)
+            {
+                break;
+            }
+            rtmp_->push(tag.type, tag.data, timestamp);
+            if (++index_ == tags_.size())
+            {
+                index_ = 0;
+                offset_ += tags_.back().timestamp + 40;
+            }
+        }
+    }
+
+   private:
+    boost::asio::steady_timer timer_;
+    std::vector<flv_tag> tags_;
+    std::shared_ptr<rtmp_client> rtmp_;
+    std::size_t index_ = 0;
+    uint32_t base_ = 0;
+    uint32_t offset_ = 0;
+};
+
+struct process_usage
+{
+    uint64_t cpu_ticks = 0;
+    uint64_t rss_kb = 0;
+    uint64_t context_switches = 0;    // 所有线程的合计
+};
+
+process_usage read_usage(pid_t pid)
+{
+    process_usage usage;
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    std::getline(stat, line);
+    // 进程名可能带空格，从右括号后面开始数
+    auto pos = line.rfind(')');
+    if (pos != std::string::npos)
+    {
+        std::vector<std::string> fields;
+        std::string field;
+        for (std::size_t i = pos + 2; i <= line.size(); i++)
+        {
+            if (i == line.size() || line[i] == ' ')
+            {
+                fields.push_back(field);
+                field.clear();
+                continue;
+            }
+            field += line[i];
+        }
+        // utime stime 是第 14、15 个字段
+        if (fields.size() > 12)
+        {
+            usage.cpu_ticks = std::stoull(fields[11]) + std::stoull(fields[12]);
+        }
+    }
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+        {
+            usage.rss_kb = std::stoull(line.substr(6));
+        }
+    }
+    // 进程的 status 里只有主线程的切换次数，要把每个线程的加起来
+    std::string const task_dir = "/proc/" + std::to_string(pid) + "/task";
+    DIR* dir = opendir(task_dir.c_str());
+    if (dir == nullptr)
+    {
+        return usage;
+    }
+    while (dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        std::ifstream task_status(task_dir + "/" + entry->d_name + "/status");
+        while (std::getline(task_status, line))
+        {
+            if (line.find("ctxt_switches:") != std::string::npos)
+            {
+                usage.context_switches += std::stoull(line.substr(line.find(':') + 1));
+            }
+        }
+    }
+    closedir(dir);
+    return usage;
+}
+
+// 用 perf stat 统计进程所有线程在 seconds 秒内进入系统调用的次数，阻塞到统计结束，perf 不可用时返回 -1
+int64_t count_syscalls(pid_t pid, int seconds)
+{
+    std::string const cmd = "perf stat -x, -e raw_syscalls:sys_enter -p " + std::to_string(pid) + " -- sleep " + std::to_string(seconds) + " 2>&1";
+    FILE* fp = popen(cmd.c_str(), "r");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+    int64_t count = -1;
+    char buf[512];
+    while (fgets(buf, sizeof buf, fp) != nullptr)
+    {
+        // csv 格式: 计数,单位,事件名,...
+        std::string const line(buf);
+        if (line.empty() || line[0] < '0' || line[0] > '9' || line.find("raw_syscalls:sys_enter") == std::string::npos)
+        {
+            continue;
+        }
+        count = std::stoll(line.substr(0, line.find(',')));
+    }
+    pclose(fp);
+    return count;
+}
+
+uint32_t percentile(std::vector<uint32_t>& samples, double p)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    auto index = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(index), samples.end());
+    return samples[index];
+}
+
+uint64_t total_bytes(const std::vector<std::shared_ptr<client>>& clients)
+{
+    uint64_t bytes = 0;
+    for (const auto& c : clients)
+    {
+        bytes += c->stats().bytes.load();
+    }
+    return bytes;
+}
+
+void report(const char* name, std::vector<std::shared_ptr<client>>& clients, int seconds)
+{
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    std::size_t playing = 0;
+    std::vector<uint32_t> latency;
+    for (auto& c : clients)
+    {
+        player_stats& s = c->stats();
+        frames += s.frames.load();
+        bytes += s.bytes.load();
+        playing += s.playing ? 1 : 0;
+        latency.insert(latency.end(), s.latency.begin(), s.latency.end());
+    }
+    if (clients.empty())
+    {
+        return;
+    }
+    printf("%-5s players %4zu/%-4zu frames/s %10.1f (%7.1f per player)  MB/s %8.2f  latency p50 %5u ms p99 %5u ms\n",
+           name,
+           playing,
+           clients.size(),
+           static_cast<double>(frames) / seconds,
+           static_cast<double>(frames) / seconds / static_cast<double>(clients.size()),
+           static_cast<double>(bytes) / seconds / (1024.0 * 1024.0),
+           percentile(latency, 0.5),
+           percentile(latency, 0.99));
+}
+
+pid_t spawn_server(const char* path)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execl(path, path, static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+}    // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s <simple_rtmp path|server pid> <flv file> [players per protocol] [seconds]\n", argv[0]);
+        return -1;
+    }
+    int const players = argc > 3 ? atoi(argv[3]) : 10;
+    int const seconds = argc > 4 ? atoi(argv[4]) : 10;
+
+    auto tags = load_flv(argv[2]);
+    if (tags.empty())
+    {
+        fprintf(stderr, "read %s failed\n", argv[2]);
+        return -1;
+    }
+
+    bool const spawn = strspn(argv[1], "0123456789") != strlen(argv[1]);
+    pid_t const server = spawn ? spawn_server(argv[1]) : static_cast<pid_t>(atoi(argv[1]));
+    if (server <= 0)
+    {
+        fprintf(stderr, "start server %s failed\n", argv[1]);
+        return -1;
+    }
+    if (spawn)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    simple_rtmp::executors exs(std::max(2U, std::thread::hardware_concurrency() / 2));
+    exs.run();
+
+    publisher pub(exs.get_executor(), std::move(tags));
+    boost::asio::post(exs.get_executor(), [&pub] { pub.start(); });
+    // 只有推流时的 cpu 按速率算，后面从总的 cpu 里减掉
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    process_usage const base_start = read_usage(server);
+    std::this_thread::sleep_for(std::chrono::seconds(kBaselineSeconds));
+    process_usage const base = read_usage(server);
+
+    std::vector<std::shared_ptr<client>> rtmp_players;
+    std::vector<std::shared_ptr<client>> rtsp_players;
+    std::vector<std::shared_ptr<client>> flv_players;
+    for (int i = 0; i < players; i++)
+    {
+        rtmp_players.push_back(std::make_shared<rtmp_client>(exs.get_executor(), kRtmpPort, false));
+        rtsp_players.push_back(std::make_shared<rtsp_client>(exs.get_executor()));
+        flv_players.push_back(std::make_shared<flv_client>(exs.get_executor()));
+    }
+    for (int i = 0; i < players; i++)
+    {
+        boost::asio::post(rtmp_players[i]->socket_executor(), [c = rtmp_players[i]] { c->start(kRtmpPort); });
+        boost::asio::post(rtsp_players[i]->socket_executor(), [c = rtsp_players[i]] { c->start(kRtspPort); });
+        boost::asio::post(flv_players[i]->socket_executor(), [c = flv_players[i]] { c->start(kHttpPort); });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(kWarmupSeconds));
+    process_usage const start = read_usage(server);
+    recording = true;
+    auto const record_end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    int64_t const syscalls = count_syscalls(server, seconds);
+    // perf 不可用时会立刻返回
+    std::this_thread::sleep_until(record_end);
+    recording = false;
+    process_usage const end = read_usage(server);
+
+    exs.stop();
+
+    int const viewers = players * 3;
+    double const clk_tck = static_cast<double>(sysconf(_SC_CLK_TCK));
+    double const cpu = static_cast<double>(end.cpu_ticks - start.cpu_ticks) / clk_tck / seconds * 100.0;
+    double const base_cpu = static_cast<double>(base.cpu_ticks - base_start.cpu_ticks) / clk_tck / kBaselineSeconds * 100.0;
+    printf("players per protocol %d, %d s\n", players, seconds);
+    report("rtmp", rtmp_players, seconds);
+    report("rtsp", rtsp_players, seconds);
+    report("flv", flv_players, seconds);
+    printf("server cpu %.1f%% (%.3f%% per viewer over %.1f%% baseline)  rss %llu KB (%.1f KB per viewer over %llu KB baseline)\n",
+           cpu,
+           viewers == 0 ? 0.0 : (cpu - base_cpu) / viewers,
+           base_cpu,
+           static_cast<unsigned long long>(end.rss_kb),
+           viewers == 0 ? 0.0 : (static_cast<double>(end.rss_kb) - static_cast<double>(base.rss_kb)) / viewers,
+           static_cast<unsigned long long>(base.rss_kb));
+    // 回环上播放端收到的字节就是服务端发出的字节
+    double const gbits = static_cast<double>(total_bytes(rtmp_players) + total_bytes(rtsp_players) + total_bytes(flv_players)) * 8 / 1e9 / seconds;
+    if (syscalls >= 0)
+    {
+        printf("server syscalls/s %.0f  ", static_cast<double>(syscalls) / seconds);
+    }
+    else
+    {
+        printf("server syscalls/s n/a (perf stat unavailable)  ");
+    }
+    printf("context switches/s %.0f  %.3f Gbit/s  cpu %.1f%% per Gbit/s\n",
+           static_cast<double>(end.context_switches - start.context_switches) / seconds,
+           gbits,
+           gbits == 0 ? 0.0 : cpu / gbits);
+
+    if (spawn)
+    {
+        kill(server, SIGINT);
+        waitpid(server, nullptr, 0);
+    }
+    return 0;
+}
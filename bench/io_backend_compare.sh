@@ -0,0 +1,19 @@
+#!/bin/bash
+# 用同一个负载对比 asio(epoll) 和 io_uring 两种读写实现
+# io_backend_compare.sh <simple_rtmp 路径> <flv 文件> [每种协议播放者个数] [秒数]
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <simple_rtmp> <flv file> [players per protocol] [seconds]"
+    exit 1
+fi
+
+BENCH=$(dirname "$0")/fanout_bench
+if [ ! -x "${BENCH}" ]; then
+    BENCH=$(dirname "$1")/bench/fanout_bench
+fi
+
+for backend in asio io_uring; do
+    echo "== ${backend}"
+    SIMPLE_RTMP_IO_BACKEND=${backend} "${BENCH}" "$@"
+done
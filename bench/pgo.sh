@@ -0,0 +1,54 @@
+#!/bin/bash
+# PGO 构建
+# 1. 编译带插桩的版本
+# 2. 用录制好的文件推流，同时用 rtmp/rtsp/http-flv 拉流，跑一段时间后 SIGINT 退出写出 profile
+# 3. 用 profile 重新编译 Release
+#
+# bench/pgo.sh <录制的 flv/mp4 文件> [训练秒数] [每种协议的播放者个数]
+# 依赖 ffmpeg
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <media file> [seconds] [players]"
+    exit 1
+fi
+
+MEDIA=$(realpath "$1")
+SECONDS_TO_RUN=${2:-60}
+PLAYERS=${3:-4}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+TRAIN_DIR=$ROOT/_pgo_train
+BUILD_DIR=$ROOT/_pgo_build
+PROFILE_DIR=$ROOT/_pgo_profile
+STREAM=live/pgo
+
+rm -rf "$PROFILE_DIR"
+cmake -S "$ROOT" -B "$TRAIN_DIR" -DCMAKE_BUILD_TYPE=Release -DSIMPLE_RTMP_PGO=generate -DSIMPLE_RTMP_PGO_DIR="$PROFILE_DIR"
+cmake --build "$TRAIN_DIR" -j"$(nproc)"
+
+"$TRAIN_DIR/simple_rtmp" &
+SERVER=$!
+sleep 1
+
+ffmpeg -loglevel error -re -stream_loop -1 -i "$MEDIA" -c copy -f flv "rtmp://127.0.0.1:1935/$STREAM" &
+PIDS="$!"
+sleep 2
+
+for i in $(seq "$PLAYERS"); do
+    ffmpeg -loglevel error -i "rtmp://127.0.0.1:1936/$STREAM" -c copy -f null - &
+    PIDS="$PIDS $!"
+    ffmpeg -loglevel error -rtsp_transport tcp -i "rtsp://127.0.0.1:8554/$STREAM" -c copy -f null - &
+    PIDS="$PIDS $!"
+    ffmpeg -loglevel error -i "http://127.0.0.1:8081/$STREAM.flv" -c copy -f null - &
+    PIDS="$PIDS $!"
+done
+
+sleep "$SECONDS_TO_RUN"
+kill $PIDS 2>/dev/null || true
+kill -INT $SERVER
+wait $SERVER || true
+
+cmake -S "$ROOT" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DSIMPLE_RTMP_PGO=use -DSIMPLE_RTMP_PGO_DIR="$PROFILE_DIR"
+cmake --build "$BUILD_DIR" -j"$(nproc)"
+echo "pgo build: $BUILD_DIR/simple_rtmp"
@@ -0,0 +1,192 @@
+// sink 注册表查找吞吐
+// 读线程不停地 sink::get，写线程同时不停地 add/del 模拟发布、停止发布
+// 同样的负载跑一遍全局锁 + std::map 作为对照
+//
+// sink_registry_bench [读线程数] [写线程数] [秒数] [流个数]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sink.h"
+
+namespace
+{
+class bench_sink : public simple_rtmp::sink
+{
+   public:
+    explicit bench_sink(std::string id) : id_(std::move(id))
+    {
+    }
+
+   public:
+    std::string id() const override
+    {
+        return id_;
+    }
+    void write(const simple_rtmp::frame_buffer::ptr& /*frame*/, const boost::system::error_code& /*ec*/) override
+    {
+    }
+    void add_channel(const simple_rtmp::channel::ptr& /*ch*/) override
+    {
+    }
+    void del_channel(const simple_rtmp::channel::ptr& /*ch*/) override
+    {
+    }
+    void add_codec(int /*codec*/, simple_rtmp::codec_option /*op*/) override
+    {
+    }
+
+   private:
+    std::string id_;
+};
+
+// 原来的实现
+class mutex_registry
+{
+   public:
+    simple_rtmp::sink::ptr get(const std::string& id)
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        auto it = sinks_.find(id);
+        return it == sinks_.end() ? nullptr : it->second;
+    }
+    void add(simple_rtmp::sink::ptr& s)
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        sinks_[s->id()] = s;
+    }
+    void del(const std::string& id)
+    {
+        std::lock_guard<std::mutex> const lock(mutex_);
+        sinks_.erase(id);
+    }
+
+   private:
+    std::mutex mutex_;
+    std::map<std::string, simple_rtmp::sink::ptr> sinks_;
+};
+
+class shard_registry
+{
+   public:
+    simple_rtmp::sink::ptr get(const std::string& id)
+    {
+        return simple_rtmp::sink::get(id);
+    }
+    void add(simple_rtmp::sink::ptr& s)
+    {
+        simple_rtmp::sink::add(s);
+    }
+    void del(const std::string& id)
+    {
+        simple_rtmp::sink::del(id);
+    }
+};
+
+struct result
+{
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t updates = 0;
+};
+
+template <typename Registry>
+result run(Registry& registry, int readers, int writers, int seconds, int streams)
+{
+    std::vector<std::string> ids;
+    ids.reserve(streams);
+    for (int i = 0; i < streams; i++)
+    {
+        ids.push_back("rtmp_live_" + std::to_string(i));
+        simple_rtmp::sink::ptr s = std::make_shared<bench_sink>(ids.back());
+        registry.add(s);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> updates{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < readers; t++)
+    {
+        threads.emplace_back(
+            [&, t]
+            {
+                uint64_t n = 0;
+                uint64_t h = 0;
+                std::size_t i = t;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    if (registry.get(ids[i % ids.size()]))
+                    {
+                        h++;
+                    }
+                    i += 7;
+                    n++;
+                }
+                lookups += n;
+                hits += h;
+            });
+    }
+    for (int t = 0; t < writers; t++)
+    {
+        threads.emplace_back(
+            [&, t]
+            {
+                uint64_t n = 0;
+                std::size_t i = t;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    // 停止发布后马上重新发布
+                    const std::string& id = ids[i % ids.size()];
+                    registry.del(id);
+                    simple_rtmp::sink::ptr s = std::make_shared<bench_sink>(id);
+                    registry.add(s);
+                    i += 13;
+                    n++;
+                }
+                updates += n;
+            });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    for (const auto& id : ids)
+    {
+        registry.del(id);
+    }
+    return result{lookups.load(), hits.load(), updates.load()};
+}
+
+void print(const char* name, const result& r, int seconds)
+{
+    printf("%-8s lookups/s %12.0f  hit %6.2f%%  publish churn/s %10.0f\n",
+           name,
+           static_cast<double>(r.lookups) / seconds,
+           r.lookups == 0 ? 0.0 : 100.0 * static_cast<double>(r.hits) / static_cast<double>(r.lookups),
+           static_cast<double>(r.updates) / seconds);
+}
+}    // namespace
+
+int main(int argc, char* argv[])
+{
+    int const readers = argc > 1 ? atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+    int const writers = argc > 2 ? atoi(argv[2]) : 2;
+    int const seconds = argc > 3 ? atoi(argv[3]) : 5;
+    int const streams = argc > 4 ? atoi(argv[4]) : 1000;
+    printf("readers %d writers %d seconds %d streams %d\n", readers, writers, seconds, streams);
+
+    mutex_registry mutex;
+    print("mutex", run(mutex, readers, writers, seconds, streams), seconds);
+    shard_registry shard;
+    print("shard", run(shard, readers, writers, seconds, streams), seconds);
+    return 0;
+}
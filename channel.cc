@@ -14,3 +14,17 @@ void channel::write(const frame_buffer::ptr& frame, const boost::system::error_c
         output_(frame, ec);
     }
 }
+
+void channel::set_delay(delay&& d)
+{
+    delay_ = d;
+}
+
+uint64_t channel::get_delay() const
+{
+    if (delay_)
+    {
+        return delay_();
+    }
+    return 0;
+}
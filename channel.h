@@ -15,13 +15,18 @@ class channel
 
    private:
     using output = std::function<void(const frame_buffer::ptr &, const boost::system::error_code &)>;
+    using delay = std::function<uint64_t()>;
 
    public:
     void set_output(output &&out);
     void write(const frame_buffer::ptr &, const boost::system::error_code &ec);
+    // 下游积压了多少毫秒的数据还没发出去
+    void set_delay(delay &&d);
+    uint64_t get_delay() const;
 
    private:
     output output_;
+    delay delay_;
 };
 }    // namespace simple_rtmp
 
@@ -1,9 +1,15 @@
 #include <thread>
+#include <functional>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "execution.h"
+#include "log.h"
 
 using simple_rtmp::executors;
 
-executors::executors(std::size_t pool_size) : exs_(pool_size)
+executors::executors(std::size_t pool_size, bool cpu_affinity) : cpu_affinity_(cpu_affinity), exs_(pool_size)
 {
 }
 
@@ -12,6 +18,28 @@ executors::~executors()
     stop();
 }
 
+static void bind_thread_cpu(std::thread &thread, std::size_t index)
+{
+#ifdef __linux__
+    unsigned int const cpus = std::thread::hardware_concurrency();
+    if (cpus == 0)
+    {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    int ret = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (ret != 0)
+    {
+        LOG_WARN("bind executor {} to cpu {} failed {}", index, index % cpus, ret);
+    }
+#else
+    (void)thread;
+    (void)index;
+#endif
+}
+
 void executors::run()
 {
     std::lock_guard<std::mutex> const lock(mutex_);
@@ -24,6 +52,10 @@ void executors::run()
                 boost::system::error_code ignore;
                 io.run(ignore);
             });
+        if (cpu_affinity_)
+        {
+            bind_thread_cpu(threads_.back(), threads_.size() - 1);
+        }
     }
 }
 
@@ -44,10 +76,21 @@ void executors::stop()
 
 boost::asio::io_context &executors::get_executor()
 {
-    std::lock_guard<std::mutex> const lock(mutex_);
-    if (index_ == exs_.size())
-    {
-        index_ = 0;
-    }
-    return exs_[index_++];
+    uint32_t const index = index_.fetch_add(1, std::memory_order_relaxed);
+    return exs_[index % exs_.size()];
+}
+
+boost::asio::io_context &executors::get_executor(const std::string &key)
+{
+    return exs_[std::hash<std::string>{}(key) % exs_.size()];
+}
+
+boost::asio::io_context &executors::at(std::size_t index)
+{
+    return exs_[index % exs_.size()];
+}
+
+std::size_t executors::size() const
+{
+    return exs_.size();
 }
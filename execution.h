@@ -5,6 +5,8 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <string>
 #include <boost/asio.hpp>
 
 namespace simple_rtmp
@@ -15,17 +17,23 @@ class executors
     using executor = boost::asio::io_context;
 
    public:
-    explicit executors(std::size_t pool_size);
+    // cpu_affinity 为 true 时每个线程绑定到一个 cpu 上
+    explicit executors(std::size_t pool_size, bool cpu_affinity = false);
     ~executors();
 
    public:
     void run();
     void stop();
     executor &get_executor();
+    // 相同的 key 总是得到同一个 executor
+    executor &get_executor(const std::string &key);
+    executor &at(std::size_t index);
+    std::size_t size() const;
 
    private:
     using exec_work_t = boost::asio::executor_work_guard<executor::executor_type>;
-    uint32_t index_ = 0;
+    bool cpu_affinity_ = false;
+    std::atomic<uint32_t> index_{0};
     std::vector<std::thread> threads_;
     std::vector<executor> exs_;
     std::vector<exec_work_t> works_;
@@ -1,3 +1,4 @@
+#include <mutex>
 #include <boost/algorithm/string.hpp>
 #include <boost/utility/string_view.hpp>
 
@@ -6,10 +7,17 @@
 #include "flv-proto.h"
 #include "flv-header.h"
 #include "flv_forward_session.h"
+#include "stream_affinity.h"
 
 using simple_rtmp::flv_forward_session;
 using simple_rtmp::tcp_connection;
 
+// 请求已经在 http_session 里读完，播放端不再发数据，只检查写
+static const simple_rtmp::connection_timeout_option kFlvTimeout = {0, 0, 0, 15 * 1000};
+
+static std::mutex write_option_mutex;
+static simple_rtmp::write_queue_option write_option;
+
 static simple_rtmp::frame_buffer::ptr make_flv_header()
 {
     static const auto kFlvHeaderSize = 9;
@@ -20,7 +28,7 @@ static simple_rtmp::frame_buffer::ptr make_flv_header()
 }
 
 flv_forward_session::flv_forward_session(std::string target, simple_rtmp::executors::executor& ex, boost::asio::ip::tcp::socket socket)
-    : target_(std::move(target)), ex_(ex), conn_(std::make_shared<tcp_connection>(ex_, std::move(socket)))
+    : target_(std::move(target)), ex_(&ex), conn_(std::make_shared<tcp_connection>(ex, std::move(socket)))
 
 {
 }
@@ -30,7 +38,13 @@ void flv_forward_session::write(const frame_buffer::ptr& frame)
     conn_->write_frame(frame);
 }
 
-static std::string make_session_id_suffix(const std::string& target)
+void flv_forward_session::set_write_queue_option(const write_queue_option& op)
+{
+    std::lock_guard<std::mutex> lock(write_option_mutex);
+    write_option = op;
+}
+
+static std::string make_session_id_suffix(const std::string& target, std::string* app, std::string* stream)
 {
     //
     boost::string_view v(target);
@@ -43,12 +57,12 @@ static std::string make_session_id_suffix(const std::string& target)
     }
     auto app_index = results.size() - 2;
     auto stream_index = results.size() - 1;
-    std::string app = results[app_index];
-    std::string stream = results[stream_index];
-    return "rtmp_" + app + "_" + stream;
+    *app = results[app_index];
+    *stream = results[stream_index];
+    return "rtmp_" + *app + "_" + *stream;
 }
 
-static std::string make_session_id_prefix(const std::string& target)
+static std::string make_session_id_prefix(const std::string& target, std::string* app, std::string* stream)
 {
     //
     std::vector<std::string> results;
@@ -59,19 +73,21 @@ static std::string make_session_id_prefix(const std::string& target)
     }
     auto app_index = results.size() - 2;
     auto stream_index = results.size() - 1;
-    std::string app = results[app_index];
-    std::string stream = results[stream_index];
-    return "flv_" + app + "_" + stream;
+    *app = results[app_index];
+    *stream = results[stream_index];
+    return "flv_" + *app + "_" + *stream;
 }
 void flv_forward_session::start()
 {
+    std::string app;
+    std::string stream;
     if (boost::ends_with(target_, ".flv"))
     {
-        id_ = make_session_id_suffix(target_);
+        id_ = make_session_id_suffix(target_, &app, &stream);
     }
     else if (boost::starts_with(target_, "/flv"))
     {
-        id_ = make_session_id_prefix(target_);
+        id_ = make_session_id_prefix(target_, &app, &stream);
     }
     else
     {
@@ -89,10 +105,22 @@ void flv_forward_session::start()
     }
     LOG_DEBUG("{} start", id_);
     sink_ = s;
+    auto* ex = affinity::instance().get_executor(app, stream);
+    if (ex != nullptr && ex != ex_)
+    {
+        ex_ = ex;
+        conn_->migrate(*ex_);
+    }
 
     channel_ = std::make_shared<simple_rtmp::channel>();
     channel_->set_output(std::bind(&flv_forward_session::channel_out, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    channel_->set_delay(std::bind(&tcp_connection::queue_delay_ms, conn_));
 
+    conn_->set_timeout_option(kFlvTimeout);
+    {
+        std::lock_guard<std::mutex> lock(write_option_mutex);
+        conn_->set_write_queue_option(write_option);
+    }
     conn_->set_read_cb(std::bind(&flv_forward_session::on_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     conn_->set_write_cb(std::bind(&flv_forward_session::on_write, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     conn_->start();
@@ -122,7 +150,7 @@ void flv_forward_session::on_write(const boost::system::error_code& ec, std::siz
 }
 void flv_forward_session::shutdown()
 {
-    ex_.post(std::bind(&flv_forward_session::safe_shutdown, shared_from_this()));
+    boost::asio::post(*ex_, std::bind(&flv_forward_session::safe_shutdown, shared_from_this()));
 }
 
 boost::asio::ip::tcp::socket& flv_forward_session::socket()
@@ -158,6 +186,10 @@ void flv_forward_session::channel_out(const frame_buffer::ptr& frame, const boos
         shutdown();
         return;
     }
+    if (!conn_ || !conn_->admit_frame(frame))
+    {
+        return;
+    }
     auto type = FLV_TYPE_VIDEO;
     if (frame->media() == simple_rtmp::audio)
     {
@@ -182,8 +214,8 @@ void flv_forward_session::channel_out(const frame_buffer::ptr& frame, const boos
     flv_tag_header_write(&tag, buf, kFlvTagHeaderSize);
     flv_tag_size_write(buf + kFlvTagHeaderSize, 4, frame->size() + kFlvTagHeaderSize);
 
-    auto tag_header = simple_rtmp::fixed_frame_buffer::create(buf, kFlvTagHeaderSize);
-    auto tag_size = simple_rtmp::fixed_frame_buffer::create(buf + kFlvTagHeaderSize, 4);
+    auto tag_header = simple_rtmp::pooled_frame_buffer::create(buf, kFlvTagHeaderSize);
+    auto tag_size = simple_rtmp::pooled_frame_buffer::create(buf + kFlvTagHeaderSize, 4);
     write(tag_header);
     write(frame);
     write(tag_size);
@@ -22,6 +22,8 @@ class flv_forward_session : public std::enable_shared_from_this<flv_forward_sess
     void shutdown();
     boost::asio::ip::tcp::socket& socket();
     void write(const frame_buffer::ptr& frame);
+    // 在启动服务之前设置，之后新建的播放连接使用
+    static void set_write_queue_option(const write_queue_option& op);
 
    private:
     void safe_shutdown();
@@ -36,7 +38,7 @@ class flv_forward_session : public std::enable_shared_from_this<flv_forward_sess
     std::string target_;
     sink::weak sink_;
     channel::ptr channel_ = nullptr;
-    simple_rtmp::executors::executor& ex_;
+    simple_rtmp::executors::executor* ex_;
     std::shared_ptr<tcp_connection> conn_;
 };
 }    // namespace simple_rtmp
@@ -2,9 +2,11 @@
 #define SIMPLE_RTMP_FRAME_BUFFER_H
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <memory>
 #include <any>
+#include "frame_pool.h"
 
 namespace simple_rtmp
 {
@@ -47,25 +49,26 @@ class ref_frame_buffer : public frame_buffer
     using ptr = std::shared_ptr<ref_frame_buffer>;
 
    public:
-    ref_frame_buffer(const uint8_t* data, std::size_t size, const std::shared_ptr<frame_buffer>& ref) : ref_data_(const_cast<uint8_t*>(data)), ref_data_size_(size), ref_(ref)
+    ref_frame_buffer(const uint8_t* data, std::size_t size, const std::shared_ptr<frame_buffer>& ref) : ref_frame_buffer(const_cast<uint8_t*>(data), size, ref)
     {
     }
-    ref_frame_buffer(uint8_t* data, std::size_t size, const std::shared_ptr<frame_buffer>& ref) : ref_data_(data), ref_data_size_(size), ref_(ref)
+    // 切片有自己的时间戳等属性，同一个块上的多个切片互不影响
+    ref_frame_buffer(uint8_t* data, std::size_t size, const std::shared_ptr<frame_buffer>& ref)
+        : media_(ref->media()), codec_(ref->codec()), flag_(ref->flag()), pts_(ref->pts()), dts_(ref->dts()), ref_data_(data), ref_data_size_(size), ref_(ref)
     {
     }
 
     ~ref_frame_buffer() override = default;
 
    public:
+    // 切片很多(每个 chunk 一个)，对象和引用计数一起从 frame_pool 分配
     static ptr create(uint8_t* data, std::size_t size, const std::shared_ptr<frame_buffer>& ref)
     {
-        ptr f(new ref_frame_buffer(data, size, ref));
-        return f;
+        return std::allocate_shared<ref_frame_buffer>(frame_pool_allocator<ref_frame_buffer>(), data, size, ref);
     }
     static ptr create(const uint8_t* data, std::size_t size, const std::shared_ptr<frame_buffer>& ref)
     {
-        ptr f(new ref_frame_buffer(data, size, ref));
-        return f;
+        return std::allocate_shared<ref_frame_buffer>(frame_pool_allocator<ref_frame_buffer>(), data, size, ref);
     }
 
    public:
@@ -97,43 +100,43 @@ class ref_frame_buffer : public frame_buffer
     //
     int32_t media() const override
     {
-        return ref_->media();
+        return media_;
     }
     int32_t codec() const override
     {
-        return ref_->codec();
+        return codec_;
     }
     int32_t flag() const override
     {
-        return ref_->flag();
+        return flag_;
     }
     int64_t pts() const override
     {
-        return ref_->pts();
+        return pts_;
     }
     int64_t dts() const override
     {
-        return ref_->dts();
+        return dts_;
     }
     void set_media(int32_t media) override
     {
-        ref_->set_media(media);
+        media_ = media;
     }
     void set_codec(int32_t codec) override
     {
-        ref_->set_codec(codec);
+        codec_ = codec;
     }
     void set_flag(int32_t flag) override
     {
-        ref_->set_flag(flag);
+        flag_ = flag;
     }
     void set_pts(int64_t pts) override
     {
-        ref_->set_pts(pts);
+        pts_ = pts;
     }
     void set_dts(int64_t dts) override
     {
-        ref_->set_dts(dts);
+        dts_ = dts;
     }
     void append(const uint8_t* data, size_t len) override
     {
@@ -170,8 +173,17 @@ class ref_frame_buffer : public frame_buffer
         }
         ref_->append(data);
     }
+    const std::shared_ptr<frame_buffer>& ref() const
+    {
+        return ref_;
+    }
 
    private:
+    int32_t media_ = 0;
+    int32_t codec_ = 0;
+    int32_t flag_ = 0;
+    int64_t pts_ = 0;
+    int64_t dts_ = 0;
     uint8_t* ref_data_ = nullptr;
     std::size_t ref_data_size_ = 0;
     std::shared_ptr<frame_buffer> ref_ = nullptr;
@@ -349,6 +361,235 @@ class fixed_frame_buffer : public frame_buffer
         payload_.resize(size);
     }
 };
+// 内存来自 frame_pool，对象与引用计数在同一个池块里(allocate_shared)，负载按规格从 slab 分配
+class pooled_frame_buffer : public frame_buffer
+{
+   public:
+    using ptr = std::shared_ptr<pooled_frame_buffer>;
+
+   private:
+    struct token
+    {
+    };
+
+   public:
+    explicit pooled_frame_buffer(token /*unused*/)
+    {
+    }
+    pooled_frame_buffer(const pooled_frame_buffer&) = delete;
+    pooled_frame_buffer& operator=(const pooled_frame_buffer&) = delete;
+    ~pooled_frame_buffer() override
+    {
+        frame_pool::deallocate(buf_);
+    }
+
+   public:
+    static ptr create()
+    {
+        return std::allocate_shared<pooled_frame_buffer>(frame_pool_allocator<pooled_frame_buffer>(), token{});
+    }
+    static ptr create(std::size_t size)
+    {
+        ptr f = create();
+        f->reserve(size);
+        return f;
+    }
+    static ptr create(const uint8_t* data, std::size_t size)
+    {
+        ptr f = create(size);
+        f->append(data, size);
+        return f;
+    }
+    static ptr create(const void* data, std::size_t size)
+    {
+        return create(static_cast<const uint8_t*>(data), size);
+    }
+
+    uint8_t* data() override
+    {
+        return buf_ + offset_;
+    }
+    const uint8_t* data() const override
+    {
+        return buf_ + offset_;
+    }
+    size_t size() const override
+    {
+        return size_;
+    }
+    size_t capacity() const
+    {
+        return capacity_ - offset_;
+    }
+    void erase(uint32_t size) override
+    {
+        if (size_ <= size)
+        {
+            offset_ = 0;
+            size_ = 0;
+        }
+        else
+        {
+            offset_ += size;
+            size_ -= size;
+        }
+    }
+    bool empty() const override
+    {
+        return size_ == 0;
+    }
+    uint8_t peek() const override
+    {
+        return buf_[offset_];
+    }
+
+    //
+    int32_t media() const override
+    {
+        return media_;
+    }
+    int32_t codec() const override
+    {
+        return codec_;
+    }
+    int32_t flag() const override
+    {
+        return flag_;
+    }
+    int64_t pts() const override
+    {
+        return pts_;
+    }
+    int64_t dts() const override
+    {
+        return dts_;
+    }
+    void set_media(int32_t media) override
+    {
+        media_ = media;
+    }
+    void set_codec(int32_t codec) override
+    {
+        codec_ = codec;
+    }
+    void set_flag(int32_t flag) override
+    {
+        flag_ = flag;
+    }
+    void set_pts(int64_t pts) override
+    {
+        pts_ = pts;
+    }
+    void set_dts(int64_t dts) override
+    {
+        dts_ = dts;
+    }
+
+    void append(const uint8_t* data, size_t len) override
+    {
+        if (data == nullptr || len == 0)
+        {
+            return;
+        }
+        reserve(size_ + len);
+        memcpy(buf_ + offset_ + size_, data, len);
+        size_ += len;
+    }
+    void append(const void* data, size_t len) override
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+
+        append(static_cast<const uint8_t*>(data), len);
+    }
+
+    void append(const frame_buffer::ptr& frame) override
+    {
+        if (!frame)
+        {
+            return;
+        }
+        media_ = frame->media();
+        codec_ = frame->codec();
+        pts_ = frame->pts();
+        dts_ = frame->dts();
+        flag_ = frame->flag();
+        append(frame->data(), frame->size());
+    }
+
+    void append(const std::vector<uint8_t>& data) override
+    {
+        if (data.empty())
+        {
+            return;
+        }
+        append(data.data(), data.size());
+    }
+    void resize(size_t size)
+    {
+        reserve(size);
+        size_ = size;
+    }
+    void reserve(size_t size)
+    {
+        if (offset_ + size <= capacity_)
+        {
+            return;
+        }
+        std::size_t capacity = 0;
+        auto* buf = static_cast<uint8_t*>(frame_pool::allocate(size < capacity_ * 2 ? capacity_ * 2 : size, &capacity));
+        if (size_ > 0)
+        {
+            memcpy(buf, buf_ + offset_, size_);
+        }
+        frame_pool::deallocate(buf_);
+        buf_ = buf;
+        offset_ = 0;
+        capacity_ = capacity;
+    }
+
+   private:
+    int32_t media_ = 0;
+    int32_t codec_ = 0;
+    int32_t flag_ = 0;
+    int64_t pts_ = 0;
+    int64_t dts_ = 0;
+    uint8_t* buf_ = nullptr;
+    std::size_t offset_ = 0;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+// 要长期持有的帧(gop 缓存、配置帧)先经过这里，切片不到所在块的 1/max_ratio 时拷贝到刚好大小的池化块里
+// 几 KB 的帧不再占住整个读块，其它情况原样返回，属性随拷贝带过去
+// 不要传已经切好 chunk 的帧，拷贝后 chunk 信息就没了
+inline frame_buffer::ptr compact_frame(const frame_buffer::ptr& frame, std::size_t max_ratio = 4)
+{
+    const auto* slice = dynamic_cast<const ref_frame_buffer*>(frame.get());
+    if (slice == nullptr)
+    {
+        return frame;
+    }
+    const frame_buffer* root = slice->ref().get();
+    while (const auto* ref = dynamic_cast<const ref_frame_buffer*>(root))
+    {
+        root = ref->ref().get();
+    }
+    std::size_t block = root->size();
+    if (const auto* pooled = dynamic_cast<const pooled_frame_buffer*>(root))
+    {
+        block = pooled->capacity();
+    }
+    if (frame->size() * max_ratio >= block)
+    {
+        return frame;
+    }
+    auto copy = pooled_frame_buffer::create(frame->size());
+    copy->append(frame);
+    return copy;
+}
 }    // namespace simple_rtmp
 
 #endif
@@ -0,0 +1,288 @@
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#include <sys/mman.h>
+#include "frame_pool.h"
+
+namespace simple_rtmp
+{
+static const std::size_t kMinBlockShift = 6;    // 64 bytes
+static const std::size_t kSlabSize = 256 * 1024;
+
+struct alignas(16) frame_pool::block
+{
+    block* next = nullptr;
+    slab* owner = nullptr;    // nullptr 表示超过最大规格，直接走 new
+};
+
+// slab 头后面紧跟着切好的块，整块用 mmap 申请，全空后 munmap 还给系统
+struct alignas(16) frame_pool::slab
+{
+    slab* prev = nullptr;
+    slab* next = nullptr;
+    frame_pool* owner = nullptr;
+    block* free = nullptr;
+    uint32_t cls = 0;
+    uint32_t count = 0;
+    uint32_t free_count = 0;
+    std::size_t bytes = 0;
+};
+
+static std::mutex pools_mutex;
+static std::vector<frame_pool*> pools;
+// 本线程的池，只有分配时才创建，释放时只用来比较
+static thread_local frame_pool* current_pool = nullptr;
+
+static std::size_t class_size(int cls)
+{
+    return static_cast<std::size_t>(1) << (kMinBlockShift + cls);
+}
+
+static int size_class(std::size_t size)
+{
+    int cls = 0;
+    while (class_size(cls) < size)
+    {
+        cls++;
+    }
+    return cls;
+}
+
+template <typename T>
+static void list_push(T*& head, T* node)
+{
+    node->prev = nullptr;
+    node->next = head;
+    if (head != nullptr)
+    {
+        head->prev = node;
+    }
+    head = node;
+}
+
+template <typename T>
+static void list_erase(T*& head, T* node)
+{
+    if (node->prev != nullptr)
+    {
+        node->prev->next = node->next;
+    }
+    else
+    {
+        head = node->next;
+    }
+    if (node->next != nullptr)
+    {
+        node->next->prev = node->prev;
+    }
+    node->prev = nullptr;
+    node->next = nullptr;
+}
+
+frame_pool* frame_pool::local()
+{
+    if (current_pool == nullptr)
+    {
+        current_pool = new frame_pool();
+        std::lock_guard<std::mutex> const lock(pools_mutex);
+        pools.push_back(current_pool);
+    }
+    return current_pool;
+}
+
+void* frame_pool::allocate(std::size_t size, std::size_t* capacity)
+{
+    if (size == 0)
+    {
+        size = 1;
+    }
+    frame_pool* pool = local();
+    if (size > kMaxBlockSize)
+    {
+        pool->oversize_.fetch_add(1, std::memory_order_relaxed);
+        auto* b = static_cast<block*>(::operator new(sizeof(block) + size));
+        b->next = nullptr;
+        b->owner = nullptr;
+        if (capacity != nullptr)
+        {
+            *capacity = size;
+        }
+        return b + 1;
+    }
+    int const cls = size_class(size);
+    if (capacity != nullptr)
+    {
+        *capacity = class_size(cls);
+    }
+    return pool->allocate_block(cls);
+}
+
+void frame_pool::deallocate(void* p)
+{
+    if (p == nullptr)
+    {
+        return;
+    }
+    block* b = static_cast<block*>(p) - 1;
+    if (b->owner == nullptr)
+    {
+        ::operator delete(b);
+        return;
+    }
+    b->owner->owner->deallocate_block(b);
+}
+
+void* frame_pool::allocate_block(int cls)
+{
+    if (partial_[cls] == nullptr && empty_[cls] == nullptr)
+    {
+        drain_remote();
+    }
+    slab* s = partial_[cls];
+    if (s == nullptr && empty_[cls] != nullptr)
+    {
+        s = empty_[cls];
+        list_erase(empty_[cls], s);
+        empty_count_[cls]--;
+        list_push(partial_[cls], s);
+    }
+    if (s != nullptr)
+    {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        if (!carve_slab(cls))
+        {
+            throw std::bad_alloc();
+        }
+        s = partial_[cls];
+    }
+    block* b = s->free;
+    s->free = b->next;
+    s->free_count--;
+    if (s->free == nullptr)
+    {
+        // 用满了，归还第一个块时再挂回来
+        list_erase(partial_[cls], s);
+    }
+    b->next = nullptr;
+    return b + 1;
+}
+
+void frame_pool::deallocate_block(block* b)
+{
+    if (this == current_pool)
+    {
+        release_block(b);
+        return;
+    }
+    // 不是本线程分配的，挂到所属线程的回收链表
+    remote_frees_.fetch_add(1, std::memory_order_relaxed);
+    block* head = remote_.load(std::memory_order_relaxed);
+    do
+    {
+        b->next = head;
+    } while (!remote_.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void frame_pool::release_block(block* b)
+{
+    slab* s = b->owner;
+    int const cls = static_cast<int>(s->cls);
+    b->next = s->free;
+    s->free = b;
+    s->free_count++;
+    if (s->free_count == 1 && s->count != 1)
+    {
+        list_push(partial_[cls], s);
+        return;
+    }
+    if (s->free_count != s->count)
+    {
+        return;
+    }
+    // 全空了，留够了就还给系统
+    if (s->count != 1)
+    {
+        list_erase(partial_[cls], s);
+    }
+    if (empty_count_[cls] * s->bytes >= kKeepEmptyBytes)
+    {
+        release_slab(s);
+        return;
+    }
+    list_push(empty_[cls], s);
+    empty_count_[cls]++;
+}
+
+void frame_pool::drain_remote()
+{
+    block* b = remote_.exchange(nullptr, std::memory_order_acquire);
+    while (b != nullptr)
+    {
+        block* next = b->next;
+        release_block(b);
+        b = next;
+    }
+}
+
+bool frame_pool::carve_slab(int cls)
+{
+    std::size_t const block_size = sizeof(block) + class_size(cls);
+    std::size_t count = (kSlabSize - sizeof(slab)) / block_size;
+    if (count == 0)
+    {
+        count = 1;
+    }
+    std::size_t const bytes = sizeof(slab) + block_size * count;
+    void* mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+    slab_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    auto* s = new (mem) slab();
+    s->owner = this;
+    s->cls = static_cast<uint32_t>(cls);
+    s->count = static_cast<uint32_t>(count);
+    s->free_count = static_cast<uint32_t>(count);
+    s->bytes = bytes;
+    auto* base = static_cast<uint8_t*>(mem) + sizeof(slab);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto* b = new (base + i * block_size) block();
+        b->owner = s;
+        b->next = s->free;
+        s->free = b;
+    }
+    list_push(partial_[cls], s);
+    return true;
+}
+
+void frame_pool::release_slab(slab* s)
+{
+    slab_bytes_.fetch_sub(s->bytes, std::memory_order_relaxed);
+    released_slabs_.fetch_add(1, std::memory_order_relaxed);
+    ::munmap(s, s->bytes);
+}
+
+frame_pool_stats frame_pool::stats()
+{
+    frame_pool_stats s;
+    std::lock_guard<std::mutex> const lock(pools_mutex);
+    for (const auto* pool : pools)
+    {
+        s.hits += pool->hits_.load(std::memory_order_relaxed);
+        s.misses += pool->misses_.load(std::memory_order_relaxed);
+        s.remote_frees += pool->remote_frees_.load(std::memory_order_relaxed);
+        s.oversize += pool->oversize_.load(std::memory_order_relaxed);
+        s.slab_bytes += pool->slab_bytes_.load(std::memory_order_relaxed);
+        s.released_slabs += pool->released_slabs_.load(std::memory_order_relaxed);
+    }
+    s.pools = pools.size();
+    return s;
+}
+
+}    // namespace simple_rtmp
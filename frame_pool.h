@@ -0,0 +1,114 @@
+#ifndef SIMPLE_RTMP_FRAME_POOL_H
+#define SIMPLE_RTMP_FRAME_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <new>
+
+namespace simple_rtmp
+{
+struct frame_pool_stats
+{
+    uint64_t hits = 0;            // 从空闲链表拿到的块
+    uint64_t misses = 0;          // 空闲链表为空，新切 slab
+    uint64_t remote_frees = 0;    // 其他线程归还的块
+    uint64_t oversize = 0;        // 超过最大规格，直接走 malloc
+    uint64_t slab_bytes = 0;      // 当前向系统申请的 slab 字节数
+    uint64_t released_slabs = 0;  // 全空后还给系统的 slab
+    uint64_t pools = 0;           // 线程池个数
+
+    double hit_rate() const
+    {
+        uint64_t const total = hits + misses;
+        return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+    }
+};
+
+// 每个线程(executor)一个按规格分级的 slab 池
+// 块头记录所属的 slab，在其他线程释放时挂回所属池的无锁链表，由所属线程下次分配时回收
+// 池在线程第一次分配时创建，进程退出前不释放，只释放块的线程不创建池
+// 每个规格最多留 kKeepEmptyBytes 全空的 slab，多出来的还给系统，突发过后内存能降下来
+class frame_pool
+{
+   public:
+    static const std::size_t kMaxBlockSize = 256 * 1024;
+
+   public:
+    // capacity 返回实际可用的字节数
+    static void* allocate(std::size_t size, std::size_t* capacity = nullptr);
+    static void deallocate(void* p);
+    static frame_pool_stats stats();
+
+   private:
+    struct block;
+    struct slab;
+    static const int kClassCount = 13;
+    static const std::size_t kKeepEmptyBytes = 1024 * 1024;
+
+    frame_pool() = default;
+    static frame_pool* local();
+    void* allocate_block(int cls);
+    void deallocate_block(block* b);
+    void drain_remote();
+    bool carve_slab(int cls);
+    void release_block(block* b);
+    void release_slab(slab* s);
+
+   private:
+    // 每个规格部分使用的 slab 和全空的 slab 各一个链表，用满的 slab 不在链表里
+    // 分配先从部分使用的拿，全空的尽量留着，可以还给系统
+    slab* partial_[kClassCount] = {nullptr};
+    slab* empty_[kClassCount] = {nullptr};
+    std::size_t empty_count_[kClassCount] = {0};
+    std::atomic<block*> remote_{nullptr};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> remote_frees_{0};
+    std::atomic<uint64_t> oversize_{0};
+    std::atomic<uint64_t> slab_bytes_{0};
+    std::atomic<uint64_t> released_slabs_{0};
+};
+
+template <typename T>
+class frame_pool_allocator
+{
+   public:
+    using value_type = T;
+
+    frame_pool_allocator() = default;
+    template <typename U>
+    frame_pool_allocator(const frame_pool_allocator<U>& /*other*/)    // NOLINT
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(frame_pool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t /*n*/)
+    {
+        frame_pool::deallocate(p);
+    }
+
+    template <typename U>
+    struct rebind
+    {
+        using other = frame_pool_allocator<U>;
+    };
+};
+
+template <typename T, typename U>
+bool operator==(const frame_pool_allocator<T>& /*a*/, const frame_pool_allocator<U>& /*b*/)
+{
+    return true;
+}
+template <typename T, typename U>
+bool operator!=(const frame_pool_allocator<T>& /*a*/, const frame_pool_allocator<U>& /*b*/)
+{
+    return false;
+}
+
+}    // namespace simple_rtmp
+
+#endif
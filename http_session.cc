@@ -4,11 +4,16 @@
 #include "flv_forward_session.h"
 #include "log.h"
 #include "socket.h"
+#include "tcp_connection.h"
 
 using simple_rtmp::http_session;
 
 std::map<std::string, simple_rtmp::request_cb_t> http_session::request_cb_;
 
+// 读一个请求(包括 keep-alive 时等下一个请求)和写一个响应的超时
+static const std::chrono::seconds kReadTimeout(30);
+static const std::chrono::seconds kWriteTimeout(15);
+
 http_session::http_session(simple_rtmp::executors::executor& ex) : ex_(ex)
 {
     LOG_DEBUG("create {}", static_cast<void*>(this));
@@ -74,17 +79,27 @@ void http_session::do_read()
     constexpr auto kMaxBodyLimit = 1024;
     parser_->body_limit(kMaxBodyLimit);
     auto fn = boost::beast::bind_front_handler(&http_session::on_read, shared_from_this());
+    stream_->expires_after(kReadTimeout);
     boost::beast::http::async_read(*stream_, buffer_, parser_->get(), std::move(fn));
 }
 
 void http_session::on_read(const boost::beast::error_code& ec, std::size_t /*unused*/)
 {
+    if (ec == boost::beast::error::timeout)
+    {
+        LOG_INFO("{} read timeout", requested_ ? "keep-alive" : "request");
+        auto kind = requested_ ? simple_rtmp::connection_timeout::idle : simple_rtmp::connection_timeout::handshake;
+        simple_rtmp::tcp_connection::count_timeout(kind, buffer_.capacity());
+        shutdown();
+        return;
+    }
     if (ec)
     {
         LOG_ERROR("read failed {}", ec.message());
         shutdown();
         return;
     }
+    requested_ = true;
     on_request();
 }
 
@@ -148,15 +163,21 @@ void http_session::on_hls_request(http_request_ptr& req)
 void http_session::write(http_request_ptr& req, http_response_ptr& res)
 {
     auto self = shared_from_this();
+    stream_->expires_after(kWriteTimeout);
     boost::beast::http::async_write(*stream_, *res, [self, this, req, res](boost::beast::error_code ec, std::size_t bytes) { on_write(req, ec, bytes); });
 }
 void http_session::write_flv(http_request_ptr& req, http_response_ptr& res)
 {
     auto self = shared_from_this();
+    stream_->expires_after(kWriteTimeout);
     boost::beast::http::async_write(*stream_, *res, [self, this, req, res](boost::beast::error_code ec, std::size_t bytes) { on_flv_write(req, ec, bytes); });
 }
 void http_session::on_flv_write(const http_request_ptr& req, boost::beast::error_code ec, std::size_t bytes)
 {
+    if (ec == boost::beast::error::timeout)
+    {
+        simple_rtmp::tcp_connection::count_timeout(simple_rtmp::connection_timeout::write_stall, buffer_.capacity());
+    }
     if (ec)
     {
         LOG_ERROR("write failed {}", ec.message());
@@ -186,6 +207,10 @@ simple_rtmp::http_response_ptr http_session::create_response(simple_rtmp::http_r
 void http_session::on_write(const http_request_ptr& req, boost::beast::error_code ec, std::size_t bytes)
 {
     (void)bytes;
+    if (ec == boost::beast::error::timeout)
+    {
+        simple_rtmp::tcp_connection::count_timeout(simple_rtmp::connection_timeout::write_stall, buffer_.capacity());
+    }
     if (ec)
     {
         LOG_ERROR("write failed {}", ec.message());
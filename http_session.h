@@ -64,6 +64,8 @@ class http_session : public std::enable_shared_from_this<http_session>
     boost::beast::flat_buffer buffer_;
     std::shared_ptr<boost::beast::tcp_stream> stream_;
     boost::optional<http_request_parser_t> parser_;
+    // 收到过完整的请求，之后的读超时算 keep-alive 空闲
+    bool requested_ = false;
 };
 }    // namespace simple_rtmp
 
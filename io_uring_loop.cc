@@ -0,0 +1,802 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "io_uring_loop.h"
+#include "log.h"
+
+using simple_rtmp::io_uring_loop;
+
+static std::atomic<uint64_t> uring_loops{0};
+static std::atomic<uint64_t> uring_enters{0};
+static std::atomic<uint64_t> uring_sqes{0};
+static std::atomic<uint64_t> uring_cqes{0};
+static std::atomic<uint64_t> uring_recv_bytes{0};
+static std::atomic<uint64_t> uring_send_bytes{0};
+static std::atomic<uint64_t> uring_zerocopy_sends{0};
+static std::atomic<uint64_t> uring_zerocopy_copied{0};
+static std::atomic<uint64_t> uring_recv_no_buffers{0};
+static std::atomic<uint64_t> uring_recv_copied{0};
+static std::atomic<uint64_t> uring_sqe_full{0};
+
+static const unsigned kSqEntries = 1024;
+static const unsigned kCqEntries = 8192;
+static const std::size_t kMaxIov = 1024;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+struct io_uring_loop::op
+{
+    uint64_t id = 0;
+    int fd = -1;
+    bool zerocopy = false;
+    bool done = false;
+    int notify = 0;    // 还没收到的零拷贝通知
+    std::vector<frame_buffer::ptr> frames;
+    std::vector<struct iovec> iov;
+    std::size_t iov_index = 0;
+    struct msghdr msg;
+    std::size_t total = 0;
+    std::size_t sent = 0;
+    send_cb on_send;
+    recv_cb on_recv;
+    bool poll_first = false;    // 上次发送返回 EAGAIN，这次先等可写
+};
+
+// 接收缓冲的内存和归还队列，帧可能比 loop 活得久，也可能在别的线程释放
+struct io_uring_loop::recv_pool
+{
+    std::vector<uint8_t> buffers;
+    std::mutex mutex;
+    std::vector<uint16_t> returned;
+    unsigned lent = 0;    // 借出还没放回缓冲环的个数，只在 loop 线程上修改
+
+    uint8_t* buffer(uint16_t bid)
+    {
+        return buffers.data() + static_cast<std::size_t>(bid) * kRecvBufferSize;
+    }
+    void give_back(uint16_t bid)
+    {
+        std::lock_guard<std::mutex> const lock(mutex);
+        returned.push_back(bid);
+    }
+};
+
+// 直接引用接收缓冲的帧，容量就是一个接收缓冲
+class io_uring_loop::recv_frame : public frame_buffer
+{
+   public:
+    recv_frame(const std::shared_ptr<recv_pool>& pool, uint16_t bid, std::size_t size) : pool_(pool), buf_(pool->buffer(bid)), size_(size), bid_(bid)
+    {
+    }
+    recv_frame(const recv_frame&) = delete;
+    recv_frame& operator=(const recv_frame&) = delete;
+    ~recv_frame() override
+    {
+        pool_->give_back(bid_);
+    }
+
+   public:
+    uint8_t* data() override
+    {
+        return buf_ + offset_;
+    }
+    const uint8_t* data() const override
+    {
+        return buf_ + offset_;
+    }
+    size_t size() const override
+    {
+        return size_;
+    }
+    void erase(uint32_t size) override
+    {
+        if (size_ <= size)
+        {
+            offset_ = 0;
+            size_ = 0;
+        }
+        else
+        {
+            offset_ += size;
+            size_ -= size;
+        }
+    }
+    bool empty() const override
+    {
+        return size_ == 0;
+    }
+    uint8_t peek() const override
+    {
+        return buf_[offset_];
+    }
+
+    int32_t media() const override
+    {
+        return media_;
+    }
+    int32_t codec() const override
+    {
+        return codec_;
+    }
+    int32_t flag() const override
+    {
+        return flag_;
+    }
+    int64_t pts() const override
+    {
+        return pts_;
+    }
+    int64_t dts() const override
+    {
+        return dts_;
+    }
+    void set_media(int32_t media) override
+    {
+        media_ = media;
+    }
+    void set_codec(int32_t codec) override
+    {
+        codec_ = codec;
+    }
+    void set_flag(int32_t flag) override
+    {
+        flag_ = flag;
+    }
+    void set_pts(int64_t pts) override
+    {
+        pts_ = pts;
+    }
+    void set_dts(int64_t dts) override
+    {
+        dts_ = dts;
+    }
+
+    // 缓冲大小固定，超出的部分丢弃
+    void append(const uint8_t* data, size_t len) override
+    {
+        if (data == nullptr || len == 0)
+        {
+            return;
+        }
+        std::size_t const room = kRecvBufferSize - offset_ - size_;
+        if (len > room)
+        {
+            LOG_ERROR("io_uring recv frame append {} bytes over capacity {}", len, room);
+            len = room;
+        }
+        memcpy(buf_ + offset_ + size_, data, len);
+        size_ += len;
+    }
+    void append(const void* data, size_t len) override
+    {
+        append(static_cast<const uint8_t*>(data), len);
+    }
+    void append(const frame_buffer::ptr& frame) override
+    {
+        if (!frame)
+        {
+            return;
+        }
+        media_ = frame->media();
+        codec_ = frame->codec();
+        pts_ = frame->pts();
+        dts_ = frame->dts();
+        flag_ = frame->flag();
+        append(frame->data(), frame->size());
+    }
+    void append(const std::vector<uint8_t>& data) override
+    {
+        append(data.data(), data.size());
+    }
+
+   private:
+    std::shared_ptr<recv_pool> pool_;
+    uint8_t* buf_ = nullptr;
+    std::size_t offset_ = 0;
+    std::size_t size_ = 0;
+    uint16_t bid_ = 0;
+    int32_t media_ = 0;
+    int32_t codec_ = 0;
+    int32_t flag_ = 0;
+    int64_t pts_ = 0;
+    int64_t dts_ = 0;
+};
+
+bool io_uring_loop::available()
+{
+    static const bool supported = []
+    {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        int fd = sys_io_uring_setup(4, &p);
+        if (fd < 0)
+        {
+            return false;
+        }
+        std::vector<uint8_t> buf(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<struct io_uring_probe*>(buf.data());
+        bool ok = sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+        for (int opcode : {IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SENDMSG_ZC, IORING_OP_ASYNC_CANCEL})
+        {
+            ok = ok && opcode < probe->ops_len && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+        }
+        close(fd);
+        return ok;
+    }();
+    return supported;
+}
+
+io_uring_loop* io_uring_loop::local(boost::asio::io_context& io)
+{
+    thread_local std::unique_ptr<io_uring_loop> loop;
+    thread_local bool failed = false;
+    if (loop != nullptr || failed || !available())
+    {
+        return loop.get();
+    }
+    loop.reset(new io_uring_loop(io));
+    if (!loop->init())
+    {
+        LOG_WARN("io_uring init failed, fall back to asio");
+        failed = true;
+        loop.reset();
+    }
+    return loop.get();
+}
+
+simple_rtmp::io_uring_stats io_uring_loop::stats()
+{
+    io_uring_stats s;
+    s.loops = uring_loops.load(std::memory_order_relaxed);
+    s.enters = uring_enters.load(std::memory_order_relaxed);
+    s.sqes = uring_sqes.load(std::memory_order_relaxed);
+    s.cqes = uring_cqes.load(std::memory_order_relaxed);
+    s.recv_bytes = uring_recv_bytes.load(std::memory_order_relaxed);
+    s.send_bytes = uring_send_bytes.load(std::memory_order_relaxed);
+    s.zerocopy_sends = uring_zerocopy_sends.load(std::memory_order_relaxed);
+    s.zerocopy_copied = uring_zerocopy_copied.load(std::memory_order_relaxed);
+    s.recv_no_buffers = uring_recv_no_buffers.load(std::memory_order_relaxed);
+    s.recv_copied = uring_recv_copied.load(std::memory_order_relaxed);
+    s.sqe_full = uring_sqe_full.load(std::memory_order_relaxed);
+    return s;
+}
+
+io_uring_loop::io_uring_loop(boost::asio::io_context& io) : io_(io), event_(io)
+{
+}
+
+io_uring_loop::~io_uring_loop()
+{
+    boost::system::error_code ec;
+    event_.close(ec);
+    if (ring_fd_ >= 0)
+    {
+        close(ring_fd_);
+        uring_loops.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (sqes_ != nullptr)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_)
+    {
+        munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != nullptr)
+    {
+        munmap(sq_ptr_, sq_size_);
+    }
+    if (buf_ring_ != nullptr)
+    {
+        munmap(buf_ring_, buf_ring_size_);
+    }
+}
+
+bool io_uring_loop::init()
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER;
+    p.cq_entries = kCqEntries;
+    ring_fd_ = sys_io_uring_setup(kSqEntries, &p);
+    if (ring_fd_ < 0)
+    {
+        LOG_ERROR("io_uring setup failed {}", strerror(errno));
+        return false;
+    }
+    uring_loops.fetch_add(1, std::memory_order_relaxed);
+
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool const single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+    {
+        sq_ptr_ = nullptr;
+        return false;
+    }
+    cq_ptr_ = single_mmap ? sq_ptr_ : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED)
+    {
+        cq_ptr_ = nullptr;
+        return false;
+    }
+    sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<uint8_t*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+    auto* cq = static_cast<uint8_t*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = cq + p.cq_off.cqes;
+
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0 || sys_io_uring_register(ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_, 1) != 0)
+    {
+        LOG_ERROR("io_uring register eventfd failed {}", strerror(errno));
+        if (event_fd_ >= 0)
+        {
+            close(event_fd_);
+        }
+        return false;
+    }
+    event_.assign(event_fd_);
+
+    buf_ring_size_ = kRecvBuffers * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        return false;
+    }
+    buf_ring_ = static_cast<struct io_uring_buf_ring*>(ring);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = kRecvBuffers;
+    reg.bgid = kBufferGroup;
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        LOG_ERROR("io_uring register buffer ring failed {}", strerror(errno));
+        return false;
+    }
+    recv_pool_ = std::make_shared<recv_pool>();
+    recv_pool_->buffers.resize(kRecvBuffers * kRecvBufferSize);
+    for (uint16_t bid = 0; bid < kRecvBuffers; bid++)
+    {
+        recycle_buffer(bid);
+    }
+
+    wait_completion();
+    return true;
+}
+
+void io_uring_loop::recycle_buffer(uint16_t bid)
+{
+    // 只写 addr len bid，第一项的 resv 和 tail 共用
+    // 内核头文件的柔性数组在 C++ 下偏移不是 0，直接按 io_uring_buf 数组访问
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(buf_ring_) + (buf_tail_ & (kRecvBuffers - 1));
+    buf->addr = reinterpret_cast<uint64_t>(recv_pool_->buffer(bid));
+    buf->len = kRecvBufferSize;
+    buf->bid = bid;
+    buf_tail_++;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+void io_uring_loop::drain_returned()
+{
+    returned_.clear();
+    {
+        std::lock_guard<std::mutex> const lock(recv_pool_->mutex);
+        returned_.swap(recv_pool_->returned);
+    }
+    for (uint16_t bid : returned_)
+    {
+        recycle_buffer(bid);
+    }
+    recv_pool_->lent -= static_cast<unsigned>(returned_.size());
+}
+
+struct io_uring_sqe* io_uring_loop::get_sqe()
+{
+    if (*sq_tail_ + pending_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+    {
+        // 没有 SQPOLL，io_uring_enter 返回时内核已经取走了它接受的请求
+        submit();
+        if (*sq_tail_ + pending_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+        {
+            // 完成队列满时内核不再接受请求，由调用者处理失败
+            uring_sqe_full.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+    unsigned const index = (*sq_tail_ + pending_) & *sq_mask_;
+    sq_array_[index] = index;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    pending_++;
+    schedule_submit();
+    return sqe;
+}
+
+void io_uring_loop::schedule_submit()
+{
+    // 这一轮事件处理完后统一提交
+    if (submit_posted_)
+    {
+        return;
+    }
+    submit_posted_ = true;
+    boost::asio::post(io_, std::bind(&io_uring_loop::submit, this));
+}
+
+void io_uring_loop::flush()
+{
+    submit();
+}
+
+void io_uring_loop::submit()
+{
+    submit_posted_ = false;
+    if (pending_ != 0)
+    {
+        __atomic_store_n(sq_tail_, *sq_tail_ + pending_, __ATOMIC_RELEASE);
+        uring_sqes.fetch_add(pending_, std::memory_order_relaxed);
+        pending_ = 0;
+    }
+    unsigned const to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (to_submit == 0)
+    {
+        return;
+    }
+    uring_enters.fetch_add(1, std::memory_order_relaxed);
+    int r = sys_io_uring_enter(ring_fd_, to_submit, 0, 0);
+    if (r < 0 && errno == EINTR)
+    {
+        submit_posted_ = true;
+        boost::asio::post(io_, std::bind(&io_uring_loop::submit, this));
+        return;
+    }
+    if (r < 0 && errno != EAGAIN && errno != EBUSY)
+    {
+        // 请求还在提交队列里，不结束它们的话连接会一直等回调
+        LOG_ERROR("io_uring enter failed {}", strerror(errno));
+        fail_unsubmitted(errno);
+        return;
+    }
+    if (r < static_cast<int>(to_submit))
+    {
+        // 完成队列满，马上重试只会空转，on_completion 收完完成事件后再提交
+        // 期间 schedule_submit 不再投递
+        submit_posted_ = true;
+        submit_blocked_ = true;
+    }
+}
+
+void io_uring_loop::fail_unsubmitted(int err)
+{
+    unsigned const head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    std::vector<uint64_t> ids;
+    for (unsigned i = head; i != *sq_tail_; i++)
+    {
+        const struct io_uring_sqe& sqe = sqes_[sq_array_[i & *sq_mask_]];
+        // 取消请求的 user_data 是 0，结束它要取消的那个请求
+        ids.push_back(sqe.user_data != 0 ? sqe.user_data : sqe.addr);
+    }
+    // 没有 SQPOLL，出错的 io_uring_enter 没有取走任何请求，可以撤回
+    __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+    boost::asio::post(io_,
+                      [this, ids = std::move(ids), err]
+                      {
+                          for (uint64_t const id : ids)
+                          {
+                              auto it = ops_.find(id);
+                              // 同一个请求可能撤回了多个，结束过的发送只剩零拷贝通知
+                              if (it != ops_.end() && !it->second->done)
+                              {
+                                  complete(id, -err, 0);
+                              }
+                          }
+                      });
+}
+
+void io_uring_loop::wait_completion()
+{
+    event_.async_wait(boost::asio::posix::stream_descriptor::wait_read, std::bind(&io_uring_loop::on_completion, this, std::placeholders::_1));
+}
+
+void io_uring_loop::on_completion(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        return;
+    }
+    uint64_t count = 0;
+    while (read(event_fd_, &count, sizeof(count)) > 0)
+    {
+    }
+    reap();
+    if (submit_blocked_)
+    {
+        submit_blocked_ = false;
+        submit();
+    }
+    wait_completion();
+}
+
+void io_uring_loop::reap()
+{
+    drain_returned();
+    auto* cqes = static_cast<struct io_uring_cqe*>(cqes_);
+    unsigned head = *cq_head_;
+    while (true)
+    {
+        unsigned const tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            break;
+        }
+        struct io_uring_cqe const cqe = cqes[head & *cq_mask_];
+        head++;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        uring_cqes.fetch_add(1, std::memory_order_relaxed);
+
+        complete(cqe.user_data, cqe.res, cqe.flags);
+    }
+}
+
+void io_uring_loop::complete(uint64_t id, int res, uint32_t flags)
+{
+    auto it = ops_.find(id);
+    if (it == ops_.end())
+    {
+        // cancel 请求的结果，或者已经提前结束的接收后来又收到的数据，缓冲还回去
+        if ((flags & IORING_CQE_F_BUFFER) != 0)
+        {
+            recycle_buffer(static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+    op* o = it->second.get();
+    if (o->on_recv)
+    {
+        handle_recv(o, res, flags);
+    }
+    else
+    {
+        handle_send(o, res, flags);
+    }
+}
+
+void io_uring_loop::handle_recv(op* o, int res, uint32_t flags)
+{
+    frame_buffer::ptr frame;
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER) != 0)
+    {
+        auto const bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (recv_pool_->lent < kMaxLentBuffers)
+        {
+            recv_pool_->lent++;
+            frame = std::allocate_shared<recv_frame>(frame_pool_allocator<recv_frame>(), recv_pool_, bid, static_cast<std::size_t>(res));
+        }
+        else
+        {
+            frame = pooled_frame_buffer::create(recv_pool_->buffer(bid), static_cast<std::size_t>(res));
+            recycle_buffer(bid);
+            uring_recv_copied.fetch_add(1, std::memory_order_relaxed);
+        }
+        uring_recv_bytes.fetch_add(static_cast<uint64_t>(res), std::memory_order_relaxed);
+    }
+    if (res == -ENOBUFS)
+    {
+        uring_recv_no_buffers.fetch_add(1, std::memory_order_relaxed);
+    }
+    if ((flags & IORING_CQE_F_MORE) != 0)
+    {
+        o->on_recv(frame, res, true);
+        return;
+    }
+    // 先移出来，回调里可以重新发起接收
+    auto it = ops_.find(o->id);
+    std::unique_ptr<op> holder = std::move(it->second);
+    ops_.erase(it);
+    holder->on_recv(frame, res, false);
+}
+
+void io_uring_loop::handle_send(op* o, int res, uint32_t flags)
+{
+    if ((flags & IORING_CQE_F_NOTIF) != 0)
+    {
+        if ((static_cast<uint32_t>(res) & IORING_NOTIF_USAGE_ZC_COPIED) != 0)
+        {
+            uring_zerocopy_copied.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (--o->notify == 0 && o->done)
+        {
+            ops_.erase(o->id);
+        }
+        return;
+    }
+    if ((flags & IORING_CQE_F_MORE) != 0)
+    {
+        o->notify++;
+    }
+    // 网络请求不看 fd 上的 O_NONBLOCK，内核自己等就绪，EAGAIN 不应该出现
+    // 万一出现，先等可写再发一次，还不行就报错
+    if (res == -EAGAIN && !o->poll_first)
+    {
+        o->poll_first = true;
+        prep_send(o);
+        return;
+    }
+    o->poll_first = false;
+    if (res > 0)
+    {
+        o->sent += static_cast<std::size_t>(res);
+        uring_send_bytes.fetch_add(static_cast<uint64_t>(res), std::memory_order_relaxed);
+    }
+    if (res > 0 && o->sent < o->total)
+    {
+        // 短写，跳过已经发出的部分接着发
+        auto left = static_cast<std::size_t>(res);
+        while (left > 0 && left >= o->iov[o->iov_index].iov_len)
+        {
+            left -= o->iov[o->iov_index].iov_len;
+            o->iov_index++;
+        }
+        if (left > 0)
+        {
+            o->iov[o->iov_index].iov_base = static_cast<uint8_t*>(o->iov[o->iov_index].iov_base) + left;
+            o->iov[o->iov_index].iov_len -= left;
+        }
+        prep_send(o);
+        return;
+    }
+    o->done = true;
+    send_cb cb = std::move(o->on_send);
+    int const result = res < 0 ? res : static_cast<int>(o->sent);
+    if (o->notify == 0)
+    {
+        // 不再被内核引用，回调前释放
+        ops_.erase(o->id);
+    }
+    cb(result);
+}
+
+void io_uring_loop::prep_send(op* o)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        // 回调放到下一轮执行，send 的调用者不会在调用里收到回调
+        o->done = true;
+        send_cb cb = std::move(o->on_send);
+        if (o->notify == 0)
+        {
+            ops_.erase(o->id);
+        }
+        boost::asio::post(io_, [cb = std::move(cb)] { cb(-EBUSY); });
+        return;
+    }
+    memset(&o->msg, 0, sizeof(o->msg));
+    o->msg.msg_iov = &o->iov[o->iov_index];
+    o->msg.msg_iovlen = std::min(o->iov.size() - o->iov_index, kMaxIov);
+    sqe->opcode = o->zerocopy ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+    sqe->fd = o->fd;
+    sqe->ioprio = o->poll_first ? IORING_RECVSEND_POLL_FIRST : 0;
+    sqe->addr = reinterpret_cast<uint64_t>(&o->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = o->id;
+    if (o->zerocopy)
+    {
+        uring_zerocopy_sends.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void io_uring_loop::send(int fd, std::vector<frame_buffer::ptr> frames, bool zerocopy, send_cb cb)
+{
+    auto o = std::make_unique<op>();
+    o->id = next_id_++;
+    o->fd = fd;
+    o->zerocopy = zerocopy;
+    o->frames = std::move(frames);
+    o->on_send = std::move(cb);
+    o->iov.reserve(o->frames.size());
+    for (const auto& frame : o->frames)
+    {
+        if (frame->size() == 0)
+        {
+            continue;
+        }
+        o->iov.push_back(iovec{frame->data(), frame->size()});
+        o->total += frame->size();
+    }
+    if (o->total == 0)
+    {
+        o->on_send(0);
+        return;
+    }
+    op* p = o.get();
+    ops_.emplace(p->id, std::move(o));
+    prep_send(p);
+}
+
+uint64_t io_uring_loop::recv(int fd, recv_cb cb)
+{
+    drain_returned();
+    struct io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        boost::asio::post(io_, [cb = std::move(cb)] { cb(nullptr, -EBUSY, false); });
+        return 0;
+    }
+    auto o = std::make_unique<op>();
+    o->id = next_id_++;
+    o->fd = fd;
+    o->on_recv = std::move(cb);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = o->id;
+    uint64_t const id = o->id;
+    ops_.emplace(id, std::move(o));
+    return id;
+}
+
+void io_uring_loop::cancel(uint64_t id)
+{
+    if (ops_.find(id) == ops_.end())
+    {
+        return;
+    }
+    struct io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        // 等完成事件处理后再取消
+        boost::asio::post(io_, [this, id] { cancel(id); });
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = id;
+    // user_data 为 0 的完成事件不对应任何请求
+    sqe->user_data = 0;
+}
@@ -0,0 +1,132 @@
+#ifndef SIMPLE_RTMP_IO_URING_LOOP_H
+#define SIMPLE_RTMP_IO_URING_LOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include "frame_buffer.h"
+
+struct io_uring_sqe;
+struct io_uring_buf_ring;
+
+namespace simple_rtmp
+{
+struct io_uring_stats
+{
+    uint64_t loops = 0;
+    uint64_t enters = 0;            // io_uring_enter 调用次数
+    uint64_t sqes = 0;              // 提交的请求数
+    uint64_t cqes = 0;              // 收到的完成事件数
+    uint64_t recv_bytes = 0;
+    uint64_t send_bytes = 0;
+    uint64_t zerocopy_sends = 0;
+    uint64_t zerocopy_copied = 0;    // 内核回退成拷贝的零拷贝发送
+    uint64_t recv_no_buffers = 0;    // 接收缓冲环用完
+    uint64_t recv_copied = 0;        // 借出的接收缓冲太多时改成拷贝的次数
+    uint64_t sqe_full = 0;           // 提交队列满且提交后仍腾不出位置
+};
+
+// 每个 executor 线程一个 io_uring，同一轮事件里发起的请求攒到一起由一次 io_uring_enter 提交
+// 完成事件通过注册的 eventfd 唤醒 asio，回调都在这个线程上执行
+// 只用系统头文件和系统调用，不依赖 liburing
+class io_uring_loop
+{
+   public:
+    // res 大于等于 0 为发送的字节数，小于 0 为 -errno
+    using send_cb = std::function<void(int res)>;
+    // res 大于 0 时 frame 为收到的数据，直接引用接收缓冲环里的缓冲，frame 释放后(可以在任意线程)归还
+    // 0 为对端关闭，小于 0 为 -errno
+    // more 为 false 表示这次多次接收已经结束
+    using recv_cb = std::function<void(const frame_buffer::ptr& frame, int res, bool more)>;
+
+   public:
+    ~io_uring_loop();
+    io_uring_loop(const io_uring_loop&) = delete;
+    io_uring_loop& operator=(const io_uring_loop&) = delete;
+
+   public:
+    // 内核支持多次接收、接收缓冲环和零拷贝发送
+    static bool available();
+    // 当前线程的 loop，第一次调用时创建，只能在 io 线程上调用，不可用时返回 nullptr
+    static io_uring_loop* local(boost::asio::io_context& io);
+    static io_uring_stats stats();
+
+   public:
+    // 发完之前(零拷贝时直到内核通知可以复用)一直持有 frames，短写会接着发剩下的
+    void send(int fd, std::vector<frame_buffer::ptr> frames, bool zerocopy, send_cb cb);
+    // 多次接收，直到出错、对端关闭或者 cancel，返回的 id 用于 cancel
+    // 提交队列满且腾不出位置时返回 0，回调在下一轮以 -EBUSY 结束
+    uint64_t recv(int fd, recv_cb cb);
+    void cancel(uint64_t id);
+    // 立即提交攒着的请求，关闭 fd 之前调用，避免提交时 fd 已经被复用
+    void flush();
+
+   private:
+    struct op;
+    struct recv_pool;
+    class recv_frame;
+    explicit io_uring_loop(boost::asio::io_context& io);
+    bool init();
+    io_uring_sqe* get_sqe();
+    void prep_send(op* o);
+    void schedule_submit();
+    void submit();
+    // io_uring_enter 出错时没提交出去的请求从提交队列撤回，对应的请求在下一轮以 -err 结束
+    void fail_unsubmitted(int err);
+    void wait_completion();
+    void on_completion(const boost::system::error_code& ec);
+    void reap();
+    void complete(uint64_t id, int res, uint32_t flags);
+    void handle_recv(op* o, int res, uint32_t flags);
+    void handle_send(op* o, int res, uint32_t flags);
+    void recycle_buffer(uint16_t bid);
+    void drain_returned();
+
+   private:
+    boost::asio::io_context& io_;
+    int ring_fd_ = -1;
+    int event_fd_ = -1;
+    boost::asio::posix::stream_descriptor event_;
+    bool submit_posted_ = false;
+    // 完成队列满提交不进去，等收完完成事件后再提交，不原地重试
+    bool submit_blocked_ = false;
+
+    void* sq_ptr_ = nullptr;
+    std::size_t sq_size_ = 0;
+    void* cq_ptr_ = nullptr;
+    std::size_t cq_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    void* cqes_ = nullptr;
+    unsigned pending_ = 0;
+
+    // 接收缓冲环，收到的缓冲直接作为帧交出去，帧释放后归还
+    // 借出去的超过一半时改成拷贝，避免被长期持有的帧把缓冲环耗尽
+    const static unsigned kRecvBuffers = 64;
+    const static unsigned kMaxLentBuffers = kRecvBuffers / 2;
+    const static std::size_t kRecvBufferSize = 32 * 1024;
+    const static uint16_t kBufferGroup = 0;
+    io_uring_buf_ring* buf_ring_ = nullptr;
+    std::size_t buf_ring_size_ = 0;
+    std::shared_ptr<recv_pool> recv_pool_;
+    std::vector<uint16_t> returned_;
+    uint16_t buf_tail_ = 0;
+
+    uint64_t next_id_ = 1;
+    std::unordered_map<uint64_t, std::unique_ptr<op>> ops_;
+};
+
+}    // namespace simple_rtmp
+
+#endif
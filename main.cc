@@ -5,18 +5,21 @@
 #include "rtmp_publish_session.h"
 #include "rtmp_forward_session.h"
 #include "rtsp_forward_session.h"
+#include "flv_forward_session.h"
 #include "timestamp.h"
 #include "execution.h"
+#include "stream_affinity.h"
 #include "tcp_server.h"
 #include "scoped_exit.h"
-#include "timer_task_manger.h"
 #include "log.h"
 #include "api.h"
+#include "tcp_connection.h"
+#include "udp_transport.h"
+#include "rtsp_multicast.h"
 
 using simple_rtmp::rtmp_publish_session;
 using simple_rtmp::rtmp_forward_session;
 using simple_rtmp::rtsp_forward_session;
-using simple_rtmp::ttms;
 using simple_rtmp::http_session;
 using simple_rtmp::tcp_server;
 
@@ -28,6 +31,69 @@ static const uint16_t kRtmpPublishPort = 1935;
 static const uint16_t kRtmpForwardPort = 1936;
 static const uint16_t kRtspForwardPort = 8554;
 static const uint16_t kHttpServerPort = 8081;
+// executor 线程是否绑定 cpu
+static const bool kExecutorCpuAffinity = false;
+// 每个 executor 一个 acceptor，由内核做连接的负载均衡
+static const bool kReusePortAccept = true;
+// 设置 SIMPLE_RTMP_IO_BACKEND=io_uring 时连接的读写走 io_uring，内核不支持时退回 asio
+static const char* kIoBackendEnv = "SIMPLE_RTMP_IO_BACKEND";
+// 一批数据里有超过这个大小的帧(一般是高码率的关键帧)时零拷贝发送，asio 和 io_uring 都按这个判断，0 关闭
+static const std::size_t kZeroCopyThreshold = 128 * 1024;
+// 每个监听端口的 socket 参数，播放端口低延迟，http 拉流大发送缓冲
+static const simple_rtmp::socket_profile kRtmpPublishProfile = {};
+// rtmp 和 http-flv 的播放端只收不发，打开 keepalive，对端掉线后大约 60 秒回收；rtsp 有会话保活
+static const simple_rtmp::socket_profile kRtmpForwardProfile = simple_rtmp::socket_profile::latency().with_keepalive(30, 10, 3);
+static const simple_rtmp::socket_profile kRtspForwardProfile = simple_rtmp::socket_profile::latency();
+static const simple_rtmp::socket_profile kHttpServerProfile = simple_rtmp::socket_profile::throughput().with_keepalive(30, 10, 3);
+// 播放连接写队列的水位，超过后的处理方式可以用 SIMPLE_RTMP_WRITE_POLICY=drop_disposable|skip_to_keyframe|disconnect 改
+static const char* kWritePolicyEnv = "SIMPLE_RTMP_WRITE_POLICY";
+static const simple_rtmp::write_queue_option kRtmpPlayWriteQueue = {8 * 1024 * 1024, 5000, simple_rtmp::skip_to_keyframe};
+// http-flv 多在公网弱网上拉流，给大一些的缓冲
+static const simple_rtmp::write_queue_option kFlvPlayWriteQueue = {16 * 1024 * 1024, 8000, simple_rtmp::skip_to_keyframe};
+// rtsp tcp 交织播放，超过水位按 rtp 包跳到下一个关键帧
+static const simple_rtmp::write_queue_option kRtspPlayWriteQueue = {8 * 1024 * 1024, 5000, simple_rtmp::skip_to_keyframe};
+// rtsp udp 播放的服务端端口，每个 executor 占一对
+static const uint16_t kRtpUdpPortBase = 30000;
+static const uint16_t kRtpUdpPortCount = 1000;
+// rtsp 组播，每个 track 一个组播地址，本机测试时把 interface 设成 127.0.0.1
+static const simple_rtmp::multicast_option kRtspMulticastOption = {"239.255.42.1", 254, 40000, 16, ""};
+
+static simple_rtmp::io_backend io_backend_from_env()
+{
+    const char* env = getenv(kIoBackendEnv);
+    if (env != nullptr && std::string(env) == "io_uring")
+    {
+        return simple_rtmp::io_backend::io_uring;
+    }
+    return simple_rtmp::io_backend::asio;
+}
+
+static simple_rtmp::write_queue_option write_queue_option_from_env(simple_rtmp::write_queue_option op)
+{
+    const char* env = getenv(kWritePolicyEnv);
+    if (env == nullptr)
+    {
+        return op;
+    }
+    std::string const policy(env);
+    if (policy == "drop_disposable")
+    {
+        op.policy = simple_rtmp::drop_disposable;
+    }
+    else if (policy == "skip_to_keyframe")
+    {
+        op.policy = simple_rtmp::skip_to_keyframe;
+    }
+    else if (policy == "disconnect")
+    {
+        op.policy = simple_rtmp::disconnect;
+    }
+    else
+    {
+        LOG_WARN("unknown write policy {}", policy);
+    }
+    return op;
+}
 
 int main(int argc, char* argv[])
 {
@@ -37,9 +103,19 @@ int main(int argc, char* argv[])
 
     LOG_INFO("simple_rtmp start on {}", simple_rtmp::timestamp::now().fmt_micro_string());
 
+    auto backend = simple_rtmp::tcp_connection::set_io_backend(io_backend_from_env());
+    LOG_INFO("io backend {}", backend == simple_rtmp::io_backend::io_uring ? "io_uring" : "asio");
+    simple_rtmp::tcp_connection::set_zerocopy_threshold(kZeroCopyThreshold);
+    rtmp_forward_session::set_write_queue_option(write_queue_option_from_env(kRtmpPlayWriteQueue));
+    simple_rtmp::flv_forward_session::set_write_queue_option(write_queue_option_from_env(kFlvPlayWriteQueue));
+    simple_rtmp::rtsp_forward_session::set_write_queue_option(write_queue_option_from_env(kRtspPlayWriteQueue));
+    simple_rtmp::udp_transport::set_port_range(kRtpUdpPortBase, kRtpUdpPortCount);
+    simple_rtmp::rtsp_multicast::set_option(kRtspMulticastOption);
+
     uint32_t thread_num = std::thread::hardware_concurrency();
 
-    simple_rtmp::executors exs(thread_num);
+    simple_rtmp::executors exs(thread_num, kExecutorCpuAffinity);
+    simple_rtmp::affinity::instance().set_executors(&exs);
 
     std::atomic<bool> stop{false};
 
@@ -55,24 +131,33 @@ int main(int argc, char* argv[])
 
     signals.async_wait([&stop](boost::system::error_code, int) { stop = true; });
 
-    std::make_shared<tcp_server<rtmp_publish_session>>(kRtmpPublishPort, kRtmpServerName, exs.get_executor(), exs)->run();
-    std::make_shared<tcp_server<rtmp_forward_session>>(kRtmpForwardPort, kRtmpForwardServerName, exs.get_executor(), exs)->run();
-    std::make_shared<tcp_server<rtsp_forward_session>>(kRtspForwardPort, kRtspForwardServerName, exs.get_executor(), exs)->run();
-    std::make_shared<tcp_server<http_session>>(kHttpServerPort, kHttpServerName, exs.get_executor(), exs)->run();
+    if (kReusePortAccept)
+    {
+        simple_rtmp::run_reuse_port_servers<rtmp_publish_session>(kRtmpPublishPort, kRtmpServerName, exs, kRtmpPublishProfile);
+        simple_rtmp::run_reuse_port_servers<rtmp_forward_session>(kRtmpForwardPort, kRtmpForwardServerName, exs, kRtmpForwardProfile);
+        simple_rtmp::run_reuse_port_servers<rtsp_forward_session>(kRtspForwardPort, kRtspForwardServerName, exs, kRtspForwardProfile);
+        simple_rtmp::run_reuse_port_servers<http_session>(kHttpServerPort, kHttpServerName, exs, kHttpServerProfile);
+    }
+    else
+    {
+        std::make_shared<tcp_server<rtmp_publish_session>>(kRtmpPublishPort, kRtmpServerName, exs.get_executor(), exs, false, kRtmpPublishProfile)->run();
+        std::make_shared<tcp_server<rtmp_forward_session>>(kRtmpForwardPort, kRtmpForwardServerName, exs.get_executor(), exs, false, kRtmpForwardProfile)->run();
+        std::make_shared<tcp_server<rtsp_forward_session>>(kRtspForwardPort, kRtspForwardServerName, exs.get_executor(), exs, false, kRtspForwardProfile)->run();
+        std::make_shared<tcp_server<http_session>>(kHttpServerPort, kHttpServerName, exs.get_executor(), exs, false, kHttpServerProfile)->run();
+    }
 
     simple_rtmp::register_api();
 
-    ttms::instance().start();
     exs.run();
 
+    // 定时任务在各自 executor 的时间轮(timer_wheel)上执行，主线程只等待退出信号
     while (!stop)
     {
-        ttms::instance().update();
         std::this_thread::sleep_for(std::chrono::milliseconds(30));
     }
 
     exs.stop();
-    ttms::instance().stop();
+    simple_rtmp::affinity::instance().set_executors(nullptr);
 
     LOG_INFO("simple_rtmp finish on {}", simple_rtmp::timestamp::now().fmt_micro_string());
     return 0;
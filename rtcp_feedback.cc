@@ -0,0 +1,226 @@
+#include <cstring>
+#include <map>
+#include <mutex>
+#include "rtcp_feedback.h"
+
+using simple_rtmp::rtcp_feedback;
+
+static std::mutex viewers_mutex;
+static std::map<std::string, simple_rtmp::viewer_quality> viewers_map;
+
+static const uint8_t kRtcpSenderReport = 200;
+static const uint8_t kRtcpReceiverReport = 201;
+static const uint8_t kRtcpSdes = 202;
+static const uint8_t kRtcpSdesCname = 1;
+// 1900 到 1970 年的秒数
+static const uint64_t kNtpUnixOffset = 0x83AA7E80;
+static const std::size_t kRtcpHeaderSize = 4;
+static const std::size_t kReportBlockSize = 24;
+static const std::size_t kSenderInfoSize = 20;
+
+const std::size_t rtcp_feedback::kSenderReports;
+
+static uint32_t read_uint32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+static void write_uint32(uint8_t* p, uint32_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+static void write_rtcp_header(uint8_t* p, uint8_t count, uint8_t pt, std::size_t bytes)
+{
+    p[0] = static_cast<uint8_t>(0x80 | count);
+    p[1] = pt;
+    // 长度是 32 位字数减一
+    std::size_t const length = bytes / 4 - 1;
+    p[2] = static_cast<uint8_t>(length >> 8);
+    p[3] = static_cast<uint8_t>(length);
+}
+
+std::size_t simple_rtmp::write_sender_report(const rtcp_sender_info& info, const std::string& cname, uint8_t* data, std::size_t size)
+{
+    std::size_t const cname_size = cname.size() > 255 ? 255 : cname.size();
+    std::size_t const sr_bytes = kRtcpHeaderSize + 4 + kSenderInfoSize;
+    // ssrc + 类型 + 长度 + 文本 + 结束的 0，补齐到 4 字节
+    std::size_t const sdes_bytes = kRtcpHeaderSize + ((4 + 2 + cname_size + 1 + 3) / 4) * 4;
+    if (size < sr_bytes + sdes_bytes)
+    {
+        return 0;
+    }
+    uint64_t const seconds = info.clock / 1000000 + kNtpUnixOffset;
+    uint64_t const fraction = ((info.clock % 1000000) << 32) / 1000000;
+    uint8_t* p = data;
+    write_rtcp_header(p, 0, kRtcpSenderReport, sr_bytes);
+    write_uint32(p + 4, info.ssrc);
+    write_uint32(p + 8, static_cast<uint32_t>(seconds));
+    write_uint32(p + 12, static_cast<uint32_t>(fraction));
+    write_uint32(p + 16, info.rtp_timestamp);
+    write_uint32(p + 20, info.packets);
+    write_uint32(p + 24, info.octets);
+
+    p += sr_bytes;
+    std::memset(p, 0, sdes_bytes);
+    write_rtcp_header(p, 1, kRtcpSdes, sdes_bytes);
+    write_uint32(p + 4, info.ssrc);
+    p[8] = kRtcpSdesCname;
+    p[9] = static_cast<uint8_t>(cname_size);
+    std::memcpy(p + 10, cname.data(), cname_size);
+    return sr_bytes + sdes_bytes;
+}
+
+std::size_t simple_rtmp::parse_report_blocks(const uint8_t* data, std::size_t size, std::vector<rtcp_report_block>* blocks)
+{
+    std::size_t count = 0;
+    std::size_t offset = 0;
+    while (offset + kRtcpHeaderSize <= size)
+    {
+        const uint8_t* p = data + offset;
+        // 版本必须是 2
+        if ((p[0] >> 6) != 2)
+        {
+            break;
+        }
+        uint8_t const rc = p[0] & 0x1f;
+        uint8_t const pt = p[1];
+        std::size_t const length = (static_cast<std::size_t>(p[2]) << 8 | p[3]) * 4 + kRtcpHeaderSize;
+        if (offset + length > size)
+        {
+            break;
+        }
+        // 头后面是发送者的 ssrc，SR 还有 20 字节的发送者信息
+        std::size_t skip = 0;
+        if (pt == kRtcpSenderReport)
+        {
+            skip = kRtcpHeaderSize + 4 + kSenderInfoSize;
+        }
+        else if (pt == kRtcpReceiverReport)
+        {
+            skip = kRtcpHeaderSize + 4;
+        }
+        if (skip != 0 && skip + rc * kReportBlockSize <= length)
+        {
+            for (uint8_t i = 0; i < rc; i++)
+            {
+                const uint8_t* b = p + skip + i * kReportBlockSize;
+                rtcp_report_block rb;
+                rb.ssrc = read_uint32(b);
+                rb.fraction_lost = b[4];
+                // 24 位有符号数
+                uint32_t lost = read_uint32(b + 4) & 0xffffff;
+                rb.cumulative_lost = (lost & 0x800000) != 0 ? static_cast<int32_t>(lost | 0xff000000) : static_cast<int32_t>(lost);
+                rb.highest_seq = read_uint32(b + 8);
+                rb.jitter = read_uint32(b + 12);
+                rb.lsr = read_uint32(b + 16);
+                rb.dlsr = read_uint32(b + 20);
+                blocks->push_back(rb);
+                count++;
+            }
+        }
+        offset += length;
+    }
+    return count;
+}
+
+uint32_t simple_rtmp::sender_report_ntp(const uint8_t* data, std::size_t size)
+{
+    if (size < kRtcpHeaderSize + 4 + kSenderInfoSize || data[1] != kRtcpSenderReport)
+    {
+        return 0;
+    }
+    // ntp 秒的低 16 位和小数的高 16 位
+    uint32_t const msw = read_uint32(data + 8);
+    uint32_t const lsw = read_uint32(data + 12);
+    return (msw << 16) | (lsw >> 16);
+}
+
+void rtcp_feedback::on_sender_report(uint32_t ntp)
+{
+    if (ntp == 0)
+    {
+        return;
+    }
+    sent_[sent_index_ % kSenderReports] = sender_report{ntp, std::chrono::steady_clock::now()};
+    sent_index_++;
+}
+
+bool rtcp_feedback::on_report_block(const rtcp_report_block& rb, uint32_t sample_rate, uint64_t dropped)
+{
+    quality_.reports++;
+    quality_.fraction_lost = rb.fraction_lost / 256.0;
+    quality_.cumulative_lost = rb.cumulative_lost;
+    quality_.dropped = dropped;
+    if (sample_rate != 0)
+    {
+        quality_.jitter_ms = rb.jitter * 1000.0 / sample_rate;
+    }
+    // LSR 为 0 表示客户端还没有收到 SR
+    if (rb.lsr != 0)
+    {
+        for (const auto& sr : sent_)
+        {
+            if (sr.ntp != rb.lsr)
+            {
+                continue;
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sr.time).count();
+            double const rtt = elapsed / 1000.0 - rb.dlsr * 1000.0 / 65536;
+            quality_.rtt_ms = rtt > 0 ? rtt : 0;
+            break;
+        }
+    }
+    // 服务端主动丢掉的序号在客户端看来也是丢包，两次报告之间的差值里去掉
+    bool measured = false;
+    if (has_last_)
+    {
+        int64_t expected = static_cast<int64_t>(static_cast<uint32_t>(rb.highest_seq - last_highest_seq_));
+        int64_t lost = static_cast<int64_t>(rb.cumulative_lost) - last_lost_;
+        auto const skipped = static_cast<int64_t>(dropped - last_dropped_);
+        expected -= skipped;
+        lost -= skipped;
+        if (expected > 0)
+        {
+            quality_.network_loss = lost > 0 ? static_cast<double>(lost > expected ? expected : lost) / expected : 0;
+            measured = true;
+        }
+    }
+    has_last_ = true;
+    last_highest_seq_ = rb.highest_seq;
+    last_lost_ = rb.cumulative_lost;
+    last_dropped_ = dropped;
+    return measured;
+}
+
+const simple_rtmp::track_quality& rtcp_feedback::quality() const
+{
+    return quality_;
+}
+
+void rtcp_feedback::publish(const viewer_quality& q)
+{
+    std::lock_guard<std::mutex> lock(viewers_mutex);
+    viewers_map[q.session] = q;
+}
+
+void rtcp_feedback::remove(const std::string& session)
+{
+    std::lock_guard<std::mutex> lock(viewers_mutex);
+    viewers_map.erase(session);
+}
+
+std::vector<simple_rtmp::viewer_quality> rtcp_feedback::viewers()
+{
+    std::vector<viewer_quality> result;
+    std::lock_guard<std::mutex> lock(viewers_mutex);
+    result.reserve(viewers_map.size());
+    for (const auto& kv : viewers_map)
+    {
+        result.push_back(kv.second);
+    }
+    return result;
+}
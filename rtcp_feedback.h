@@ -0,0 +1,98 @@
+#ifndef SIMPLE_RTMP_RTCP_FEEDBACK_H
+#define SIMPLE_RTMP_RTCP_FEEDBACK_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace simple_rtmp
+{
+// SR/RR 里的一个接收报告块 rfc3550 6.4.1
+struct rtcp_report_block
+{
+    uint32_t ssrc = 0;
+    uint8_t fraction_lost = 0;       // 上一个报告以来的丢包率，乘了 256
+    int32_t cumulative_lost = 0;     //
+    uint32_t highest_seq = 0;        // 扩展的最大序号，高 16 位是回绕次数
+    uint32_t jitter = 0;             // rtp 时间戳单位
+    uint32_t lsr = 0;                // 最近一个 SR 的 ntp 时间戳中间 32 位
+    uint32_t dlsr = 0;               // 收到那个 SR 到发这个报告的间隔，1/65536 秒
+};
+
+struct track_quality
+{
+    uint64_t reports = 0;          // 收到的接收报告数
+    double fraction_lost = 0;      // 客户端报告的丢包率，包括服务端主动丢掉的包
+    double network_loss = 0;       // 去掉服务端主动丢掉的包后的丢包率
+    int32_t cumulative_lost = 0;   //
+    double jitter_ms = 0;          //
+    double rtt_ms = -1;            // 还没有算出来时是 -1
+    uint64_t dropped = 0;          // 只发关键帧和写队列超过水位时服务端丢掉的包
+};
+
+struct viewer_quality
+{
+    std::string session;
+    std::string stream;
+    std::string remote;
+    std::string transport;
+    bool keyframe_only = false;
+    track_quality video;
+    track_quality audio;
+};
+
+// 发送报告里的发送者信息 rfc3550 6.4.1
+struct rtcp_sender_info
+{
+    uint32_t ssrc = 0;
+    uint64_t clock = 0;            // rtp_wall_clock()，换算成 ntp 时间戳
+    uint32_t rtp_timestamp = 0;    // 和 clock 同一时刻的 rtp 时间戳
+    uint32_t packets = 0;
+    uint32_t octets = 0;           // 负载字节
+};
+
+// 写 SR 和只带 CNAME 的 SDES 组成的复合包，return 写入的字节数，空间不够时返回 0
+std::size_t write_sender_report(const rtcp_sender_info& info, const std::string& cname, uint8_t* data, std::size_t size);
+// 解析 rtcp 复合包里 SR 和 RR 带的接收报告块，遇到格式不对的包停止，return 解析出的块数
+std::size_t parse_report_blocks(const uint8_t* data, std::size_t size, std::vector<rtcp_report_block>* blocks);
+// 复合包第一个包是 SR 时返回它的 ntp 时间戳中间 32 位，否则返回 0
+uint32_t sender_report_ntp(const uint8_t* data, std::size_t size);
+
+// 一个 track 的接收报告统计，记住最近发出的几个 SR 的时间，用客户端回的 LSR/DLSR 算往返时间
+// 不依赖客户端的时钟，也不依赖 SR 里的 ntp 时间戳是不是墙上时间
+// 只在会话的线程上使用，结果通过 publish 交给 api 查看
+class rtcp_feedback
+{
+   public:
+    void on_sender_report(uint32_t ntp);
+    // dropped 是服务端主动丢掉的包的累计值，计算丢包率时从期望收到的包里去掉
+    // return 这次是否算出了丢包率，第一个报告或者两次报告之间没有发包时返回 false
+    bool on_report_block(const rtcp_report_block& rb, uint32_t sample_rate, uint64_t dropped);
+    const track_quality& quality() const;
+
+   public:
+    // 会话更新自己的数据，会话结束时删除，任意线程调用
+    static void publish(const viewer_quality& q);
+    static void remove(const std::string& session);
+    static std::vector<viewer_quality> viewers();
+
+   private:
+    struct sender_report
+    {
+        uint32_t ntp = 0;
+        std::chrono::steady_clock::time_point time;
+    };
+    const static std::size_t kSenderReports = 4;
+    sender_report sent_[kSenderReports];
+    std::size_t sent_index_ = 0;
+    bool has_last_ = false;
+    uint32_t last_highest_seq_ = 0;
+    int32_t last_lost_ = 0;
+    uint64_t last_dropped_ = 0;
+    track_quality quality_;
+};
+
+}    // namespace simple_rtmp
+
+#endif
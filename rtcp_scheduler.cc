@@ -0,0 +1,98 @@
+#include <atomic>
+#include "rtcp_scheduler.h"
+#include "timer_wheel.h"
+
+using simple_rtmp::rtcp_scheduler;
+
+static std::atomic<uint64_t> rtcp_reports{0};
+
+const int64_t rtcp_scheduler::kTickMilliseconds;
+const int64_t rtcp_scheduler::kReportIntervalMilliseconds;
+
+rtcp_scheduler::rtcp_scheduler(boost::asio::io_context& io) : io_(io), slots_(kSlots)
+{
+}
+
+rtcp_scheduler::~rtcp_scheduler()
+{
+    // 线程退出时时间轮可能已经先析构，不再删除任务
+}
+
+rtcp_scheduler* rtcp_scheduler::local(boost::asio::io_context& io)
+{
+    thread_local std::unique_ptr<rtcp_scheduler> scheduler;
+    if (scheduler == nullptr)
+    {
+        scheduler.reset(new rtcp_scheduler(io));
+    }
+    return scheduler.get();
+}
+
+uint64_t rtcp_scheduler::reports()
+{
+    return rtcp_reports.load(std::memory_order_relaxed);
+}
+
+uint64_t rtcp_scheduler::add(report_cb&& cb)
+{
+    if (!cb)
+    {
+        return 0;
+    }
+    uint64_t const id = next_id_++;
+    // 放进下一个要处理的槽，播放开始后很快就有第一个报告
+    slots_[cursor_].emplace(id, std::move(cb));
+    index_.emplace(id, cursor_);
+    if (task_ == 0)
+    {
+        task_ = timer_wheel::local(io_)->add_task(std::chrono::milliseconds(kTickMilliseconds), std::bind(&rtcp_scheduler::on_tick, this), -1);
+    }
+    return id;
+}
+
+void rtcp_scheduler::del(uint64_t id)
+{
+    auto it = index_.find(id);
+    if (it == index_.end())
+    {
+        return;
+    }
+    slots_[it->second].erase(id);
+    index_.erase(it);
+    if (index_.empty() && task_ != 0)
+    {
+        timer_wheel::local(io_)->del_task(task_);
+        task_ = 0;
+    }
+}
+
+std::size_t rtcp_scheduler::size() const
+{
+    return index_.size();
+}
+
+void rtcp_scheduler::on_tick()
+{
+    auto& slot = slots_[cursor_];
+    cursor_ = (cursor_ + 1) % kSlots;
+    // 回调里可能删除自己或者别的会话，先把 id 取出来
+    due_.clear();
+    for (const auto& pair : slot)
+    {
+        due_.push_back(pair.first);
+    }
+    for (uint64_t id : due_)
+    {
+        auto it = slot.find(id);
+        if (it == slot.end())
+        {
+            continue;
+        }
+        // 回调里可能删除自己，先复制一份
+        report_cb cb = it->second;
+        if (cb())
+        {
+            rtcp_reports.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
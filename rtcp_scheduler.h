@@ -0,0 +1,57 @@
+#ifndef SIMPLE_RTMP_RTCP_SCHEDULER_H
+#define SIMPLE_RTMP_RTCP_SCHEDULER_H
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace simple_rtmp
+{
+// rtcp 发送报告的调度，每个 executor 一个，挂在 timer_wheel 上一个周期任务
+// 报告间隔分成若干个槽，每个刻度只处理一个槽里的会话，同一个会话每个间隔报告一次
+// 媒体数据的发送路径上不再读时钟、不再判断是否该发报告
+// 只能在所属的 io 线程上调用
+class rtcp_scheduler
+{
+   public:
+    // return 是否发出了报告，还没有数据时返回 false
+    using report_cb = std::function<bool(void)>;
+    const static int64_t kTickMilliseconds = 250;
+    const static int64_t kReportIntervalMilliseconds = 5000;
+
+   public:
+    ~rtcp_scheduler();
+    rtcp_scheduler(const rtcp_scheduler&) = delete;
+    rtcp_scheduler& operator=(const rtcp_scheduler&) = delete;
+
+   public:
+    static rtcp_scheduler* local(boost::asio::io_context& io);
+    // 所有线程累计发出的报告数
+    static uint64_t reports();
+
+   public:
+    // 下一个刻度第一次报告，之后每个间隔一次，return id
+    uint64_t add(report_cb&& cb);
+    void del(uint64_t id);
+    std::size_t size() const;
+
+   private:
+    explicit rtcp_scheduler(boost::asio::io_context& io);
+    void on_tick();
+
+   private:
+    const static std::size_t kSlots = kReportIntervalMilliseconds / kTickMilliseconds;
+    boost::asio::io_context& io_;
+    uint64_t task_ = 0;
+    uint64_t next_id_ = 1;
+    std::size_t cursor_ = 0;
+    std::vector<std::unordered_map<uint64_t, report_cb>> slots_;
+    std::unordered_map<uint64_t, std::size_t> index_;    // id -> 槽
+    std::vector<uint64_t> due_;                          // on_tick 里复用
+};
+
+}    // namespace simple_rtmp
+
+#endif
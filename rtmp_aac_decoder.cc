@@ -63,7 +63,7 @@ void rtmp_aac_decoder::write(const frame_buffer::ptr& frame, boost::system::erro
         mpeg4_aac_audio_specific_config_load(data + n, bytes - n, &args_->aac);
         return;
     }
-    auto aac_frame = fixed_frame_buffer::create();
+    auto aac_frame = pooled_frame_buffer::create();
     aac_frame->resize(args_->aac.npce + 7 + 1);
     aac_frame->set_media(simple_rtmp::rtmp_tag::audio);
     aac_frame->set_codec(simple_rtmp::rtmp_codec::aac);
@@ -29,3 +29,62 @@ std::string simple_rtmp::rtmp_codec_to_str(int codec)
     }
     return "unknown";
 }
+
+bool simple_rtmp::rtmp_config_frame(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    if (frame->size() < 2)
+    {
+        return false;
+    }
+    if (frame->media() == simple_rtmp::rtmp_tag::video)
+    {
+        return frame->data()[1] == 0;
+    }
+    if (frame->media() == simple_rtmp::rtmp_tag::audio)
+    {
+        return (frame->codec() == simple_rtmp::rtmp_codec::aac || frame->codec() == simple_rtmp::rtmp_codec::opus) && frame->data()[1] == 0;
+    }
+    return false;
+}
+
+bool simple_rtmp::rtmp_disposable_frame(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    static const int kVideoTagSize = 5;
+    static const int kDisposableInterFrame = 3;
+    if (frame->media() != simple_rtmp::rtmp_tag::video || frame->size() < kVideoTagSize)
+    {
+        return false;
+    }
+    const uint8_t* data = frame->data();
+    if ((data[0] >> 4) == kDisposableInterFrame)
+    {
+        return true;
+    }
+    if (frame->codec() != simple_rtmp::rtmp_codec::h264 || data[1] != 1)
+    {
+        return false;
+    }
+    // avcc 4 字节长度
+    const uint8_t* p = data + kVideoTagSize;
+    const uint8_t* end = data + frame->size();
+    bool vcl = false;
+    while (p + 5 <= end)
+    {
+        uint32_t const n = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        if (n == 0 || n > static_cast<uint32_t>(end - p - 4))
+        {
+            return false;
+        }
+        uint8_t const nalu_type = p[4] & 0x1F;
+        if (nalu_type >= 1 && nalu_type <= 5)
+        {
+            if ((p[4] & 0x60) != 0)
+            {
+                return false;
+            }
+            vcl = true;
+        }
+        p += 4 + n;
+    }
+    return vcl;
+}
@@ -9,6 +9,11 @@ namespace simple_rtmp
 {
 std::string rtmp_tag_to_str(int tag);
 std::string rtmp_codec_to_str(int codec);
+// flv 格式的音视频帧
+// 配置帧(sequence header)
+bool rtmp_config_frame(const frame_buffer::ptr& frame);
+// 丢掉后不影响后续帧解码的视频帧，disposable inter frame 或 h264 里 nal_ref_idc 全为 0
+bool rtmp_disposable_frame(const frame_buffer::ptr& frame);
 
 struct codec_option
 {
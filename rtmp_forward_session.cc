@@ -1,6 +1,8 @@
+#include <mutex>
 #include "rtmp_forward_session.h"
 #include "rtmp_codec.h"
 #include "socket.h"
+#include "stream_affinity.h"
 #include "log.h"
 #include "sink.h"
 #include "frame_buffer.h"
@@ -9,6 +11,12 @@
 using simple_rtmp::rtmp_forward_session;
 using namespace std::placeholders;
 
+// 从连接到 play 最多 10 秒，播放端平时不发数据不检查空闲，一批数据 15 秒写不完断开
+static const simple_rtmp::connection_timeout_option kPlayTimeout = {10 * 1000, 0, 0, 15 * 1000};
+
+static std::mutex write_option_mutex;
+static simple_rtmp::write_queue_option write_option;
+
 struct simple_rtmp::forward_args
 {
     std::string app;
@@ -16,7 +24,7 @@ struct simple_rtmp::forward_args
     rtmp_server_context* rtmp_ctx = nullptr;
 };
 
-rtmp_forward_session::rtmp_forward_session(simple_rtmp::executors::executor& ex) : ex_(ex), conn_(std::make_shared<tcp_connection>(ex_))
+rtmp_forward_session::rtmp_forward_session(simple_rtmp::executors::executor& ex) : ex_(&ex), conn_(std::make_shared<tcp_connection>(ex))
 {
     LOG_DEBUG("create {}", static_cast<void*>(this));
 };
@@ -39,10 +47,17 @@ boost::asio::ip::tcp::socket& rtmp_forward_session::socket()
     return conn_->socket();
 }
 
+void rtmp_forward_session::set_write_queue_option(const write_queue_option& op)
+{
+    std::lock_guard<std::mutex> lock(write_option_mutex);
+    write_option = op;
+}
+
 void rtmp_forward_session::start()
 {
     rtmp_server_context_handler ctx_handler;
     ctx_handler.send = std::bind(&rtmp_forward_session::rtmp_server_send, shared_from_this(), _1);
+    ctx_handler.send_frames = std::bind(&rtmp_forward_session::rtmp_server_send_frames, shared_from_this(), _1);
     ctx_handler.onplay = std::bind(&rtmp_forward_session::rtmp_server_onplay, shared_from_this(), _1, _2, _3, _4, _5);
     ctx_handler.onpause = std::bind(&rtmp_forward_session::rtmp_server_onpause, shared_from_this(), _1, _2);
     ctx_handler.onseek = std::bind(&rtmp_forward_session::rtmp_server_onseek, shared_from_this(), _1);
@@ -52,6 +67,12 @@ void rtmp_forward_session::start()
     args_->rtmp_ctx = new rtmp_server_context(std::move(ctx_handler));
     channel_ = std::make_shared<simple_rtmp::channel>();
     channel_->set_output(std::bind(&rtmp_forward_session::channel_out, shared_from_this(), _1, _2));
+    channel_->set_delay(std::bind(&tcp_connection::queue_delay_ms, conn_));
+    conn_->set_timeout_option(kPlayTimeout);
+    {
+        std::lock_guard<std::mutex> lock(write_option_mutex);
+        conn_->set_write_queue_option(write_option);
+    }
     conn_->set_read_cb(std::bind(&rtmp_forward_session::on_read, shared_from_this(), _1, _2));
     conn_->set_write_cb(std::bind(&rtmp_forward_session::on_write, shared_from_this(), _1, _2));
     conn_->start();
@@ -65,6 +86,10 @@ void rtmp_forward_session::channel_out(const frame_buffer::ptr& frame, const boo
         shutdown();
         return;
     }
+    if (!conn_ || !conn_->admit_frame(frame))
+    {
+        return;
+    }
     if (frame->media() == simple_rtmp::rtmp_tag::video)
     {
         args_->rtmp_ctx->rtmp_server_send_video(frame);
@@ -87,7 +112,7 @@ void rtmp_forward_session::on_read(const simple_rtmp::frame_buffer::ptr& frame,
         shutdown();
         return;
     }
-    args_->rtmp_ctx->rtmp_server_input(frame->data(), frame->size());
+    args_->rtmp_ctx->rtmp_server_input(frame);
 }
 
 void rtmp_forward_session::on_write(const boost::system::error_code& ec, std::size_t /*bytes*/)
@@ -102,7 +127,7 @@ void rtmp_forward_session::on_write(const boost::system::error_code& ec, std::si
 
 void rtmp_forward_session::shutdown()
 {
-    ex_.post(std::bind(&rtmp_forward_session::safe_shutdown, shared_from_this()));
+    boost::asio::post(*ex_, std::bind(&rtmp_forward_session::safe_shutdown, shared_from_this()));
 }
 
 void rtmp_forward_session::safe_shutdown()
@@ -134,6 +159,15 @@ int rtmp_forward_session::rtmp_server_send(const simple_rtmp::frame_buffer::ptr&
     return static_cast<int>(frame->size());
 }
 
+int rtmp_forward_session::rtmp_server_send_frames(std::vector<simple_rtmp::frame_buffer::ptr>&& frames)
+{
+    if (conn_)
+    {
+        conn_->write_frames(frames);
+    }
+    return 0;
+}
+
 int rtmp_forward_session::rtmp_server_onplay(const std::string& app, const std::string& stream, double start, double duration, uint8_t reset)
 {
     std::string id = "rtmp_" + app + "_" + stream;
@@ -147,10 +181,17 @@ int rtmp_forward_session::rtmp_server_onplay(const std::string& app, const std::
         shutdown();
         return 0;
     }
+    conn_->handshake_done();
     sink_ = s;
     stream_id_ = id;
     args_->app = app;
     args_->stream = stream;
+    auto* ex = affinity::instance().get_executor(app, stream);
+    if (ex != nullptr && ex != ex_)
+    {
+        ex_ = ex;
+        conn_->migrate(*ex_);
+    }
     s->add_channel(channel_);
     return 0;
 }
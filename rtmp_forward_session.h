@@ -24,6 +24,8 @@ class rtmp_forward_session : public std::enable_shared_from_this<rtmp_forward_se
     void start();
     void shutdown();
     boost::asio::ip::tcp::socket& socket();
+    // 在启动服务之前设置，之后新建的播放连接使用
+    static void set_write_queue_option(const write_queue_option& op);
 
    private:
     void startup();
@@ -34,6 +36,7 @@ class rtmp_forward_session : public std::enable_shared_from_this<rtmp_forward_se
 
    private:
     int rtmp_server_send(const simple_rtmp::frame_buffer::ptr& frame);
+    int rtmp_server_send_frames(std::vector<simple_rtmp::frame_buffer::ptr>&& frames);
     int rtmp_server_onplay(const std::string& app, const std::string& stream, double start, double duration, uint8_t reset);
     int rtmp_server_onpause(int, uint32_t);
     int rtmp_server_onseek(uint32_t);
@@ -43,7 +46,8 @@ class rtmp_forward_session : public std::enable_shared_from_this<rtmp_forward_se
     std::string stream_id_;
     sink::weak sink_;
     channel::ptr channel_ = nullptr;
-    simple_rtmp::executors::executor& ex_;
+    // 播放后换到这一路流的 executor
+    simple_rtmp::executors::executor* ex_;
     std::shared_ptr<tcp_connection> conn_;
     std::vector<frame_buffer::ptr> write_queue_;
     std::vector<frame_buffer::ptr> writing_queue_;
@@ -126,7 +126,7 @@ void rtmp_h264_decoder::demuxer_avpacket(const uint8_t* data, size_t bytes, int6
         if (nalu_type == 5 && args_->sps_pps_flag == 0)    // idr
         {
             int avc_length = h264_sps_pps_size(&args_->avc);
-            auto frame = fixed_frame_buffer::create(avc_length);
+            auto frame = pooled_frame_buffer::create(avc_length);
             frame->set_media(simple_rtmp::rtmp_tag::video);
             frame->set_codec(simple_rtmp::rtmp_codec::h264);
             frame->set_flag(keyframe);
@@ -143,7 +143,7 @@ void rtmp_h264_decoder::demuxer_avpacket(const uint8_t* data, size_t bytes, int6
         }
 
         const static uint8_t header[] = {0x00, 0x00, 0x00, 0x01};
-        auto frame = fixed_frame_buffer::create(nalu_size + 4);
+        auto frame = pooled_frame_buffer::create(nalu_size + 4);
         frame->set_media(simple_rtmp::rtmp_tag::video);
         frame->set_codec(simple_rtmp::rtmp_codec::h264);
         frame->set_pts(timestamp + cts);
@@ -129,7 +129,7 @@ void rtmp_h265_decoder::demuxer_avpacket(const uint8_t* data, size_t bytes, int6
         if (irap && args_->vps_sps_pps_flag == 0)
         {
             int n = h265_vps_sps_pps_size(&args_->hevc);
-            auto frame = fixed_frame_buffer::create(data_offset, n);
+            auto frame = pooled_frame_buffer::create(data_offset, n);
             frame->set_media(simple_rtmp::rtmp_tag::video);
             frame->set_codec(simple_rtmp::rtmp_codec::h265);
             frame->set_flag(keyframe);
@@ -147,7 +147,7 @@ void rtmp_h265_decoder::demuxer_avpacket(const uint8_t* data, size_t bytes, int6
         }
         static const uint8_t h265_start_code[] = {0x00, 0x00, 0x00, 0x01};
         data_offset += offset;
-        auto frame = fixed_frame_buffer::create(data_offset, length);
+        auto frame = pooled_frame_buffer::create(data_offset, length);
         frame->set_media(simple_rtmp::rtmp_tag::video);
         frame->set_codec(simple_rtmp::rtmp_codec::h265);
         frame->set_flag(keyframe);
@@ -1,17 +1,21 @@
 #include "rtmp_publish_session.h"
 #include "rtmp_server_context.h"
 #include "socket.h"
+#include "stream_affinity.h"
 #include "log.h"
 
 using simple_rtmp::rtmp_publish_session;
 using namespace std::placeholders;
 
+// 从连接到 publish 最多 10 秒，推流 20 秒没有任何数据断开
+static const simple_rtmp::connection_timeout_option kPublishTimeout = {10 * 1000, 20 * 1000, 0, 0};
+
 struct simple_rtmp::publish_args
 {
     rtmp_server_context* rtmp_ctx;
 };
 
-rtmp_publish_session::rtmp_publish_session(executors::executor& ex) : ex_(ex), conn_(std::make_shared<tcp_connection>(ex))
+rtmp_publish_session::rtmp_publish_session(executors::executor& ex) : ex_(&ex), conn_(std::make_shared<tcp_connection>(ex))
 {
     LOG_DEBUG("create {}", static_cast<void*>(this));
 }
@@ -28,6 +32,7 @@ boost::asio::ip::tcp::socket& rtmp_publish_session::socket()
 void rtmp_publish_session::start()
 {
     startup();
+    conn_->set_timeout_option(kPublishTimeout);
     conn_->set_read_cb(std::bind(&rtmp_publish_session::on_read, shared_from_this(), _1, _2));
     conn_->set_write_cb(std::bind(&rtmp_publish_session::on_write, shared_from_this(), _1, _2));
     conn_->start();
@@ -61,12 +66,12 @@ void rtmp_publish_session::on_read(const simple_rtmp::frame_buffer::ptr& frame,
         shutdown();
         return;
     }
-    args_->rtmp_ctx->rtmp_server_input(frame->data(), frame->size());
+    args_->rtmp_ctx->rtmp_server_input(frame);
 }
 
 void rtmp_publish_session::shutdown()
 {
-    boost::asio::post(ex_, std::bind(&rtmp_publish_session::safe_shutdown, shared_from_this()));
+    boost::asio::post(*ex_, std::bind(&rtmp_publish_session::safe_shutdown, shared_from_this()));
 }
 
 void rtmp_publish_session::safe_shutdown()
@@ -92,10 +97,17 @@ int rtmp_publish_session::rtmp_do_send(const simple_rtmp::frame_buffer::ptr& fra
 
 int rtmp_publish_session::rtmp_on_publish(const std::string& app, const std::string& stream, const std::string& type)
 {
+    conn_->handshake_done();
     app_ = app;
     stream_ = stream;
     std::string const id = app + "_" + stream;
-    source_ = std::make_shared<rtmp_source>(id, ex_);
+    auto* ex = affinity::instance().get_executor(app, stream);
+    if (ex != nullptr && ex != ex_)
+    {
+        ex_ = ex;
+        conn_->migrate(*ex_);
+    }
+    source_ = std::make_shared<rtmp_source>(id, *ex_);
     LOG_DEBUG("publish app {} stream {} type {}", app, stream, type);
     return 0;
 }
@@ -43,7 +43,8 @@ class rtmp_publish_session : public std::enable_shared_from_this<rtmp_publish_se
     std::string app_;
     std::string stream_;
     rtmp_source::prt source_;
-    executors::executor& ex_;
+    // 发布后换到这一路流的 executor
+    executors::executor* ex_;
     std::shared_ptr<tcp_connection> conn_;
     std::shared_ptr<struct publish_args> args_;
 };
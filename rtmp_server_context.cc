@@ -12,6 +12,7 @@ extern "C"
 #include "frame_buffer.h"
 #include "rtmp_codec.h"
 #include "rtmp_server_context.h"
+#include <map>
 #include <cstring>
 #include <cassert>
 
@@ -20,6 +21,9 @@ extern "C"
 #define RTMP_OUTPUT_CHUNK_SIZE 65535
 #define RTMP_SERVER_ASYNC_START 0x12345678    // magic number, user call rtmp_server_start
 
+// 不超过这个大小的消息发送时连头带负载拷贝成一块，更大的按 chunk 切片引用负载
+static const uint32_t kCopyMessageBytes = 4 * 1024;
+
 enum
 {
     RTMP_SERVER_ONPLAY = 1,
@@ -29,9 +33,38 @@ enum
 using simple_rtmp::rtmp_server_context_handler;
 using simple_rtmp::rtmp_server_context;
 
+// 接收方向的 chunk stream 状态
+struct rtmp_in_chunk_stream
+{
+    struct rtmp_chunk_header_t header;
+    uint32_t delta = 0;
+    uint32_t clock = 0;
+    bool extended = false;
+    uint32_t bytes = 0;                                  // 当前消息已收到的字节数
+    simple_rtmp::pooled_frame_buffer::ptr payload;    // 跨 chunk/跨读取时的重组缓冲
+};
+
+enum
+{
+    RTMP_CHUNK_PARSE_HEADER = 0,
+    RTMP_CHUNK_PARSE_PAYLOAD = 1,
+};
+
+// 代替 librtmp 的 rtmp_chunk_read，音视频消息直接切片/重组到池化的块里
+struct rtmp_chunk_reader
+{
+    int state = RTMP_CHUNK_PARSE_HEADER;
+    uint8_t header[MAX_CHUNK_HEADER] = {0};
+    uint32_t header_bytes = 0;
+    uint32_t chunk_left = 0;    // 当前 chunk 还差的负载字节数
+    rtmp_in_chunk_stream* stream = nullptr;
+    std::map<uint32_t, rtmp_in_chunk_stream> streams;
+};
+
 struct simple_rtmp::rtmp_server_context_args
 {
     struct rtmp_t rtmp;
+    rtmp_chunk_reader reader;
     uint32_t recv_bytes[2];
     uint8_t payload[2 * 1024];
     uint8_t handshake[2 * RTMP_HANDSHAKE_SIZE + 1];
@@ -75,6 +108,7 @@ struct simple_rtmp::rtmp_server_context_args
     static int rtmp_server_onreceive_audio(void* param, int r, double transaction, uint8_t audio);
     static int rtmp_server_onreceive_video(void* param, int r, double transaction, uint8_t video);
     static int rtmp_server_send(void* param, const uint8_t* header, uint32_t headerBytes, const uint8_t* payload, uint32_t payloadBytes);
+    static int rtmp_server_onmessage(simple_rtmp::rtmp_server_context_args* ctx, const struct rtmp_chunk_header_t* header, const simple_rtmp::frame_buffer::ptr& frame);
     void init(rtmp_server_context* ctx, rtmp_server_context_handler handler);
 };
 static struct rtmp_packet_t* rtmp_packet_find_help(struct rtmp_t* rtmp, uint32_t cid)
@@ -134,11 +168,48 @@ static const struct rtmp_chunk_header_t* rtmp_chunk_header_zip_help(struct rtmp_
     return &pkt->header;
 }
 
+static int rtmp_chunk_send_help(simple_rtmp::rtmp_server_context_args* args, std::vector<simple_rtmp::frame_buffer::ptr>&& frames)
+{
+    if (args->handler_.send_frames)
+    {
+        args->handler_.send_frames(std::move(frames));
+        return 0;
+    }
+    for (const auto& frame : frames)
+    {
+        args->handler_.send(frame);
+    }
+    return 0;
+}
+
+// 后续 chunk 的 type 3 头，最多 3 字节 basic header 加 4 字节扩展时间戳
+static uint32_t rtmp_chunk_continuation_header_write(uint8_t* p, const struct rtmp_chunk_header_t* header)
+{
+    uint32_t size = rtmp_chunk_basic_header_write(p, RTMP_CHUNK_TYPE_3, header->cid);
+    if (header->timestamp >= 0xFFFFFF)
+    {
+        size += rtmp_chunk_extended_timestamp_write(p + size, header->timestamp);
+    }
+    return size;
+}
+
 int rtmp_chunk_write_help(simple_rtmp::rtmp_server_context_args* args, const struct rtmp_chunk_header_t* h, const simple_rtmp::frame_buffer::ptr& frame)
 {
     uint8_t p[MAX_CHUNK_HEADER] = {0};
     const struct rtmp_chunk_header_t* header;
 
+    // 预先切好的 type 3 头带着扩展时间戳时，第一个 chunk 用 type 0 头写绝对时间戳，两者才一致
+    // type 1/2 头的时间戳差值不到 24 位，不带扩展时间戳，后面的 type 3 头也不能带
+    const auto* chunk_frame = dynamic_cast<const simple_rtmp::rtmp_chunk_frame_buffer*>(frame.get());
+    bool const prechunked = chunk_frame != nullptr && chunk_frame->chunk_size() == args->rtmp.out_chunk_size && chunk_frame->cid() == h->cid;
+    struct rtmp_chunk_header_t absolute;
+    if (prechunked && chunk_frame->extended_timestamp() != 0)
+    {
+        absolute = *h;
+        absolute.fmt = RTMP_CHUNK_TYPE_0;
+        h = &absolute;
+    }
+
     // compression rtmp chunk header
     header = rtmp_chunk_header_zip_help(&args->rtmp, h);
     if ((header == nullptr) || header->length >= 0xFFFFFF)
@@ -152,30 +223,288 @@ int rtmp_chunk_write_help(simple_rtmp::rtmp_server_context_args* args, const str
         headerSize += rtmp_chunk_extended_timestamp_write(p + headerSize, header->timestamp);
     }
 
+    // 预先切好的消息只需要发送本会话的第一个 chunk 头，只有一个 chunk 时没有 type 3 头要对上
+    uint32_t const extended = header->timestamp >= 0xFFFFFF ? header->timestamp : 0;
+    if (prechunked && (extended == chunk_frame->extended_timestamp() || header->length <= chunk_frame->chunk_size()))
+    {
+        return rtmp_chunk_send_help(args, {simple_rtmp::pooled_frame_buffer::create(p, headerSize), chunk_frame->chunks()});
+    }
+
+    uint32_t const chunkSize = args->rtmp.out_chunk_size;
+    uint32_t const chunks = header->length == 0 ? 1 : (header->length + chunkSize - 1) / chunkSize;
+    // 小消息(控制消息、脚本、需要扩展时间戳的音频)连头带负载拷到一个池化块里，只分配一次
+    if (header->length <= kCopyMessageBytes)
+    {
+        auto message = simple_rtmp::pooled_frame_buffer::create(headerSize + header->length + (chunks - 1) * 7);
+        message->append(p, headerSize);
+        const uint8_t* payload = frame->data();
+        uint32_t payloadSize = header->length;
+        for (uint32_t i = 0; i < chunks; i++)
+        {
+            if (i != 0)
+            {
+                message->append(p, rtmp_chunk_continuation_header_write(p, header));
+            }
+            uint32_t const size = std::min(payloadSize, chunkSize);
+            message->append(payload, size);
+            payload += size;
+            payloadSize -= size;
+        }
+        return rtmp_chunk_send_help(args, {message});
+    }
+
+    // 大消息不拷贝负载，所有 chunk 头写到同一块内存里，切片从 frame_pool 分配
+    auto arena = simple_rtmp::pooled_frame_buffer::create(headerSize + (chunks - 1) * 7);
+    std::vector<uint32_t> offsets;
+    offsets.reserve(chunks + 1);
+    offsets.push_back(0);
+    arena->append(p, headerSize);
+    for (uint32_t i = 1; i < chunks; i++)
+    {
+        offsets.push_back(static_cast<uint32_t>(arena->size()));
+        arena->append(p, rtmp_chunk_continuation_header_write(p, header));
+    }
+    offsets.push_back(static_cast<uint32_t>(arena->size()));
+
+    std::vector<simple_rtmp::frame_buffer::ptr> frames;
+    frames.reserve(chunks * 2);
     const uint8_t* payload = frame->data();
     uint32_t payloadSize = header->length;
+    for (uint32_t i = 0; i < chunks; i++)
+    {
+        frames.push_back(simple_rtmp::ref_frame_buffer::create(arena->data() + offsets[i], offsets[i + 1] - offsets[i], arena));
+        uint32_t const size = std::min(payloadSize, chunkSize);
+        if (size > 0)
+        {
+            frames.push_back(simple_rtmp::ref_frame_buffer::create(payload, size, frame));
+        }
+        payload += size;
+        payloadSize -= size;
+    }
+    return rtmp_chunk_send_help(args, std::move(frames));
+}
+
+static uint32_t rtmp_read_be24(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+}
+
+static uint32_t rtmp_read_be32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static uint32_t rtmp_read_le32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[3]) << 24) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[0];
+}
+
+static const uint32_t kRtmpMessageHeaderSize[] = {11, 7, 3, 0};
+
+// 已收到的头部字节还不够时返回 false，need 为目前能确定的头部长度
+static bool rtmp_chunk_header_need(rtmp_chunk_reader* reader, uint32_t* need)
+{
+    const uint8_t* h = reader->header;
+    *need = 1;
+    if (reader->header_bytes < 1)
+    {
+        return false;
+    }
+    uint32_t const id = h[0] & 0x3F;
+    uint32_t const fmt = h[0] >> 6;
+    uint32_t const basic = id == 0 ? 2 : (id == 1 ? 3 : 1);
+    *need = basic;
+    if (reader->header_bytes < basic)
+    {
+        return false;
+    }
+    *need = basic + kRtmpMessageHeaderSize[fmt];
+    if (reader->header_bytes < *need)
+    {
+        return false;
+    }
+    uint32_t cid = id;
+    if (id == 0)
+    {
+        cid = 64 + h[1];
+    }
+    else if (id == 1)
+    {
+        cid = 64 + h[1] + (h[2] << 8);
+    }
+    bool extended = false;
+    if (fmt < RTMP_CHUNK_TYPE_3)
+    {
+        extended = rtmp_read_be24(h + basic) == 0xFFFFFF;
+    }
+    else
+    {
+        auto it = reader->streams.find(cid);
+        extended = it != reader->streams.end() && it->second.extended;
+    }
+    if (extended)
+    {
+        *need += 4;
+    }
+    return reader->header_bytes >= *need;
+}
 
-    while (payloadSize > 0)
+static int rtmp_chunk_header_parse(rtmp_chunk_reader* reader, uint32_t in_chunk_size)
+{
+    const uint8_t* h = reader->header;
+    uint32_t const id = h[0] & 0x3F;
+    uint8_t const fmt = h[0] >> 6;
+    uint32_t basic = 1;
+    uint32_t cid = id;
+    if (id == 0)
     {
-        uint32_t chunkSize = std::min(payloadSize, args->rtmp.out_chunk_size);
-        auto ref_frame = simple_rtmp::ref_frame_buffer::create(payload, chunkSize, frame);
-        auto header_frame = simple_rtmp::fixed_frame_buffer::create(p, headerSize);
-        args->handler_.send(header_frame);
-        args->handler_.send(ref_frame);
+        basic = 2;
+        cid = 64 + h[1];
+    }
+    else if (id == 1)
+    {
+        basic = 3;
+        cid = 64 + h[1] + (h[2] << 8);
+    }
 
-        payload += chunkSize;
-        payloadSize -= chunkSize;
+    rtmp_in_chunk_stream& s = reader->streams[cid];
+    if (fmt == RTMP_CHUNK_TYPE_3 && s.header.cid != cid)
+    {
+        return -EINVAL;    // 第一个 chunk 不能是 type 3
+    }
+    const uint8_t* p = h + basic;
+    uint32_t timestamp = 0;
+    if (fmt < RTMP_CHUNK_TYPE_3)
+    {
+        timestamp = rtmp_read_be24(p);
+        s.extended = timestamp == 0xFFFFFF;
+    }
+    if (s.extended)
+    {
+        uint32_t const extended = rtmp_read_be32(p + kRtmpMessageHeaderSize[fmt]);
+        if (fmt < RTMP_CHUNK_TYPE_3)
+        {
+            timestamp = extended;
+        }
+    }
+    if (fmt < RTMP_CHUNK_TYPE_3 && s.bytes != 0)
+    {
+        // 上一个消息还没收完就来了新的消息头，丢掉残包
+        s.bytes = 0;
+        s.payload.reset();
+    }
+    if (fmt <= RTMP_CHUNK_TYPE_1)
+    {
+        s.header.length = rtmp_read_be24(p + 3);
+        s.header.type = p[6];
+    }
+    if (fmt == RTMP_CHUNK_TYPE_0)
+    {
+        s.header.stream_id = rtmp_read_le32(p + 7);
+    }
+    s.header.cid = cid;
+    s.header.fmt = fmt;
 
-        if (payloadSize > 0)
+    if (s.bytes == 0)
+    {
+        // 新消息开始，计算绝对时间戳
+        if (fmt == RTMP_CHUNK_TYPE_0)
         {
-            headerSize = rtmp_chunk_basic_header_write(p, RTMP_CHUNK_TYPE_3, header->cid);
-            if (header->timestamp >= 0xFFFFFF)
+            s.clock = timestamp;
+            s.delta = 0;
+        }
+        else
+        {
+            if (fmt != RTMP_CHUNK_TYPE_3)
             {
-                headerSize += rtmp_chunk_extended_timestamp_write(p + headerSize, header->timestamp);
+                s.delta = timestamp;
             }
+            s.clock += s.delta;
         }
     }
+    reader->stream = &s;
+    reader->chunk_left = std::min(s.header.length - s.bytes, in_chunk_size);
+    reader->header_bytes = 0;
+    reader->state = RTMP_CHUNK_PARSE_PAYLOAD;
+    return 0;
+}
 
+static int rtmp_chunk_read_help(simple_rtmp::rtmp_server_context_args* args, const simple_rtmp::frame_buffer::ptr& frame, const uint8_t* p, const uint8_t* end)
+{
+    rtmp_chunk_reader* reader = &args->reader;
+    while (p < end || reader->state == RTMP_CHUNK_PARSE_PAYLOAD)
+    {
+        if (reader->state == RTMP_CHUNK_PARSE_HEADER)
+        {
+            uint32_t need = 0;
+            while (!rtmp_chunk_header_need(reader, &need))
+            {
+                if (p == end)
+                {
+                    return 0;    // 等待更多数据
+                }
+                auto n = static_cast<uint32_t>(std::min<size_t>(need - reader->header_bytes, end - p));
+                memcpy(reader->header + reader->header_bytes, p, n);
+                reader->header_bytes += n;
+                p += n;
+            }
+            int r = rtmp_chunk_header_parse(reader, args->rtmp.in_chunk_size);
+            if (r != 0)
+            {
+                return r;
+            }
+            continue;
+        }
+
+        rtmp_in_chunk_stream* s = reader->stream;
+        auto n = static_cast<uint32_t>(std::min<size_t>(reader->chunk_left, end - p));
+        if (s->bytes == 0 && n == s->header.length)
+        {
+            // 整个消息在一个 chunk 里且就在这次读到的块中，直接切片，不拷贝
+            struct rtmp_chunk_header_t header = s->header;
+            header.timestamp = s->clock;
+            auto message = simple_rtmp::ref_frame_buffer::create(p, n, frame);
+            p += n;
+            reader->chunk_left = 0;
+            reader->state = RTMP_CHUNK_PARSE_HEADER;
+            int r = args->rtmp_server_onmessage(args, &header, message);
+            if (r != 0)
+            {
+                return r;
+            }
+            continue;
+        }
+        if (n == 0 && reader->chunk_left > 0)
+        {
+            return 0;    // 等待更多数据
+        }
+        if (!s->payload)
+        {
+            s->payload = simple_rtmp::pooled_frame_buffer::create(s->header.length);
+        }
+        s->payload->append(p, n);
+        s->bytes += n;
+        reader->chunk_left -= n;
+        p += n;
+        if (reader->chunk_left > 0)
+        {
+            continue;
+        }
+        reader->state = RTMP_CHUNK_PARSE_HEADER;
+        if (s->bytes < s->header.length)
+        {
+            continue;
+        }
+        struct rtmp_chunk_header_t header = s->header;
+        header.timestamp = s->clock;
+        simple_rtmp::frame_buffer::ptr message = std::move(s->payload);
+        s->bytes = 0;
+        int r = args->rtmp_server_onmessage(args, &header, message);
+        if (r != 0)
+        {
+            return r;
+        }
+    }
     return 0;
 }
 
@@ -341,7 +670,7 @@ void simple_rtmp::rtmp_server_context_args::rtmp_server_onabort(void* param, uin
 int simple_rtmp::rtmp_server_context_args::rtmp_server_onaudio(void* param, const uint8_t* data, size_t bytes, uint32_t timestamp)
 {
     simple_rtmp::rtmp_server_context_args* ctx = (simple_rtmp::rtmp_server_context_args*)param;
-    auto frame = fixed_frame_buffer::create();
+    auto frame = pooled_frame_buffer::create();
     frame->append(data, bytes);
     frame->set_pts(timestamp);
     frame->set_dts(timestamp);
@@ -352,7 +681,7 @@ int simple_rtmp::rtmp_server_context_args::rtmp_server_onaudio(void* param, cons
 int simple_rtmp::rtmp_server_context_args::rtmp_server_onvideo(void* param, const uint8_t* data, size_t bytes, uint32_t timestamp)
 {
     simple_rtmp::rtmp_server_context_args* ctx = (simple_rtmp::rtmp_server_context_args*)param;
-    auto frame = fixed_frame_buffer::create();
+    auto frame = pooled_frame_buffer::create();
     frame->append(data, bytes);
     frame->set_pts(timestamp);
     frame->set_dts(timestamp);
@@ -374,6 +703,31 @@ int simple_rtmp::rtmp_server_context_args::rtmp_server_onscript(void* param, con
     return ctx->handler_.onscript(frame);
 }
 
+int simple_rtmp::rtmp_server_context_args::rtmp_server_onmessage(simple_rtmp::rtmp_server_context_args* ctx,
+                                                                 const struct rtmp_chunk_header_t* header,
+                                                                 const simple_rtmp::frame_buffer::ptr& frame)
+{
+    if (header->type == RTMP_TYPE_VIDEO || header->type == RTMP_TYPE_AUDIO)
+    {
+        frame->set_pts(header->timestamp);
+        frame->set_dts(header->timestamp);
+        frame->set_codec(header->type == RTMP_TYPE_VIDEO ? simple_rtmp::rtmp_tag::video : simple_rtmp::rtmp_tag::audio);
+        return header->type == RTMP_TYPE_VIDEO ? ctx->handler_.onvideo(frame) : ctx->handler_.onaudio(frame);
+    }
+    if (header->type == RTMP_TYPE_ABORT && frame->size() >= 4)
+    {
+        auto it = ctx->reader.streams.find(rtmp_read_be32(frame->data()));
+        if (it != ctx->reader.streams.end())
+        {
+            it->second.bytes = 0;
+            it->second.payload.reset();
+        }
+    }
+    // 控制/命令消息还是交给 librtmp 处理
+    struct rtmp_chunk_header_t h = *header;
+    return rtmp_handler(&ctx->rtmp, &h, frame->data());
+}
+
 // 7.2.1.1. connect (p29)
 // _result/_error
 int simple_rtmp::rtmp_server_context_args::rtmp_server_onconnect(void* param, int r, double transaction, const struct rtmp_connect_t* connect)
@@ -639,13 +993,13 @@ int rtmp_server_context::rtmp_server_start(int r, const std::string& msg)
     return r;
 }
 
-int rtmp_server_context::rtmp_server_input(const uint8_t* data, size_t bytes)
+int rtmp_server_context::rtmp_server_input(const simple_rtmp::frame_buffer::ptr& frame)
 {
     int r;
     size_t n;
-    const uint8_t* p;
+    const uint8_t* p = frame->data();
+    size_t bytes = frame->size();
 
-    p = data;
     while (bytes > 0)
     {
         switch (args_->handshake_state)
@@ -698,7 +1052,7 @@ int rtmp_server_context::rtmp_server_input(const uint8_t* data, size_t bytes)
             case RTMP_HANDSHAKE_2:
             default:
                 args_->rtmp_server_send_acknowledgement(args_, bytes);
-                return rtmp_chunk_read(&args_->rtmp, (const uint8_t*)p, bytes);
+                return rtmp_chunk_read_help(args_, frame, p, p + bytes);
         }
     }
 
@@ -769,3 +1123,53 @@ int rtmp_server_context::rtmp_server_send_script(const simple_rtmp::frame_buffer
     header.stream_id = args_->stream_id;
     return rtmp_chunk_write_help(args_, &header, frame);
 }
+
+simple_rtmp::frame_buffer::ptr rtmp_server_context::rtmp_chunk_frame(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    uint32_t cid = 0;
+    if (frame->media() == simple_rtmp::rtmp_tag::video)
+    {
+        cid = RTMP_CHANNEL_VIDEO;
+    }
+    else if (frame->media() == simple_rtmp::rtmp_tag::audio)
+    {
+        cid = RTMP_CHANNEL_AUDIO;
+    }
+    if (cid == 0 || frame->size() == 0 || frame->size() >= 0xFFFFFF)
+    {
+        return frame;
+    }
+
+    const uint32_t chunk_size = RTMP_OUTPUT_CHUNK_SIZE;
+    auto bytes = static_cast<uint32_t>(frame->size());
+    if (bytes <= chunk_size)
+    {
+        // 只有一个 chunk，负载本身就是第一个头之后的全部字节
+        return std::make_shared<rtmp_chunk_frame_buffer>(frame, frame, chunk_size, cid);
+    }
+
+    // 时间戳超过 24 位时扩展时间戳跟在每个 type 3 头后面，一条消息的都一样
+    auto const timestamp = static_cast<uint32_t>(frame->pts());
+    uint32_t const extended = timestamp >= 0xFFFFFF ? timestamp : 0;
+    uint8_t header[MAX_CHUNK_HEADER] = {0};
+    uint32_t header_size = rtmp_chunk_basic_header_write(header, RTMP_CHUNK_TYPE_3, cid);
+    if (extended != 0)
+    {
+        header_size += rtmp_chunk_extended_timestamp_write(header + header_size, extended);
+    }
+    uint32_t const count = (bytes + chunk_size - 1) / chunk_size;
+    auto chunks = pooled_frame_buffer::create(bytes + (count - 1) * header_size);
+    const uint8_t* payload = frame->data();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i != 0)
+        {
+            chunks->append(header, header_size);
+        }
+        uint32_t const n = std::min(bytes, chunk_size);
+        chunks->append(payload, n);
+        payload += n;
+        bytes -= n;
+    }
+    return std::make_shared<rtmp_chunk_frame_buffer>(frame, chunks, chunk_size, cid, extended);
+}
@@ -2,7 +2,9 @@
 #define SIMPLE_RTMP_RTMP_SERVER_CONTEXT_H
 
 #include <string>
+#include <vector>
 #include <functional>
+#include <utility>
 #include "frame_buffer.h"
 
 namespace simple_rtmp
@@ -11,6 +13,8 @@ namespace simple_rtmp
 struct rtmp_server_context_handler
 {
     std::function<int(const simple_rtmp::frame_buffer::ptr& frame)> send;
+    // 可选，一个消息的所有 chunk 头和负载一次交给连接，没有设置时逐个调用 send
+    std::function<int(std::vector<simple_rtmp::frame_buffer::ptr>&& frames)> send_frames;
     std::function<int(const std::string& app, const std::string& stream, double start, double duration, uint8_t reset)> onplay;
     std::function<int(int pause, uint32_t ms)> onpause;
     std::function<int(uint32_t ms)> onseek;
@@ -21,6 +25,48 @@ struct rtmp_server_context_handler
     std::function<int(const std::string& app, const std::string& stream, double* duration)> ongetduration;
 };
 
+// 按 chunk size 预先切好的音视频消息，同一路流的所有播放者共用
+// data() 还是原始消息负载，chunks() 是第一个 chunk 头之后的全部字节(负载中间已插好 type 3 头)
+// 每个会话只需要生成自己的第一个 chunk 头
+// 时间戳超过 24 位时 type 3 头后面带着扩展时间戳，会话的第一个 chunk 头要带同样的扩展时间戳
+class rtmp_chunk_frame_buffer : public ref_frame_buffer
+{
+   public:
+    using ptr = std::shared_ptr<rtmp_chunk_frame_buffer>;
+
+   public:
+    rtmp_chunk_frame_buffer(const frame_buffer::ptr& frame, frame_buffer::ptr chunks, uint32_t chunk_size, uint32_t cid, uint32_t extended_timestamp = 0)
+        : ref_frame_buffer(frame->data(), frame->size(), frame), chunks_(std::move(chunks)), chunk_size_(chunk_size), cid_(cid), extended_timestamp_(extended_timestamp)
+    {
+    }
+    ~rtmp_chunk_frame_buffer() override = default;
+
+   public:
+    const frame_buffer::ptr& chunks() const
+    {
+        return chunks_;
+    }
+    uint32_t chunk_size() const
+    {
+        return chunk_size_;
+    }
+    uint32_t cid() const
+    {
+        return cid_;
+    }
+    // type 3 头里的扩展时间戳，0 表示没有
+    uint32_t extended_timestamp() const
+    {
+        return extended_timestamp_;
+    }
+
+   private:
+    frame_buffer::ptr chunks_;
+    uint32_t chunk_size_ = 0;
+    uint32_t cid_ = 0;
+    uint32_t extended_timestamp_ = 0;
+};
+
 class rtmp_server_context
 {
    public:
@@ -28,12 +74,16 @@ class rtmp_server_context
 
    public:
     int rtmp_server_start(int r, const std::string& msg);
-    int rtmp_server_input(const uint8_t* data, size_t bytes);
+    int rtmp_server_input(const simple_rtmp::frame_buffer::ptr& frame);
     int rtmp_server_stop();
     int rtmp_server_send_audio(const simple_rtmp::frame_buffer::ptr& frame);
     int rtmp_server_send_video(const simple_rtmp::frame_buffer::ptr& frame);
     int rtmp_server_send_script(const simple_rtmp::frame_buffer::ptr& frame);
 
+   public:
+    // 音视频帧按服务端的输出 chunk size 预先切好，不是音视频或时间戳需要扩展时原样返回
+    static simple_rtmp::frame_buffer::ptr rtmp_chunk_frame(const simple_rtmp::frame_buffer::ptr& frame);
+
    private:
     struct rtmp_server_context_args* args_;
 };
@@ -2,6 +2,7 @@
 #include "rtmp_codec.h"
 #include "rtmp_h264_encoder.h"
 #include "rtmp_aac_encoder.h"
+#include "rtmp_server_context.h"
 #include "log.h"
 
 using simple_rtmp::rtmp_sink;
@@ -47,16 +48,20 @@ static bool video_config_frame(const simple_rtmp::frame_buffer::ptr& frame)
     return frame->data()[1] == 0;
 }
 
-void rtmp_sink::on_frame(const frame_buffer::ptr& frame, const boost::system::error_code& ec)
+void rtmp_sink::on_frame(const frame_buffer::ptr& in, const boost::system::error_code& ec)
 {
     if (ec)
     {
         for (const auto& ch : chs_)
         {
-            ch->write(frame, ec);
+            ch.first->write(in, ec);
         }
         return;
     }
+    // 视频帧会进 gop 缓存，音频配置帧一直持有，读块上的小切片先拷出来
+    bool const retained = in->media() == simple_rtmp::rtmp_tag::video || (in->media() == simple_rtmp::rtmp_tag::audio && in->size() >= 2 && audio_config_frame(in));
+    // 只切一次 chunk，所有播放者共用同一份
+    auto frame = rtmp_server_context::rtmp_chunk_frame(retained ? compact_frame(in) : in);
     if (frame->media() == simple_rtmp::rtmp_tag::video)
     {
         on_video_frame(frame);
@@ -66,9 +71,32 @@ void rtmp_sink::on_frame(const frame_buffer::ptr& frame, const boost::system::er
         on_audio_frame(frame);
     }
 
-    for (const auto& ch : chs_)
+    bool const keyframe = frame->media() == simple_rtmp::rtmp_tag::video && frame->flag() == 1 && !video_config_frame(frame);
+    bool const config = frame == video_config_ || frame == audio_config_;
+    for (auto& ch : chs_)
     {
-        ch->write(frame, ec);
+        subscriber& sub = ch.second;
+        if (!config)
+        {
+            uint64_t const delay = ch.first->get_delay();
+            if (!sub.wait_keyframe && delay > kMaxLagMs)
+            {
+                LOG_WARN("{} subscriber {} lag {}ms, skip to next keyframe", id_, static_cast<void*>(ch.first.get()), delay);
+                sub.wait_keyframe = true;
+            }
+            if (sub.wait_keyframe && (!keyframe || delay > kMaxLagMs))
+            {
+                sub.dropped++;
+                continue;
+            }
+            if (sub.wait_keyframe)
+            {
+                LOG_INFO("{} subscriber {} resume on keyframe, dropped {} frames", id_, static_cast<void*>(ch.first.get()), sub.dropped);
+                sub.wait_keyframe = false;
+                sub.dropped = 0;
+            }
+        }
+        ch.first->write(frame, ec);
     }
 }
 void rtmp_sink::on_video_frame(const frame_buffer::ptr& frame)
@@ -129,7 +157,7 @@ void rtmp_sink::safe_add_channel(const channel::ptr& ch)
     {
         ch->write(frame, {});
     }
-    chs_.insert(ch);
+    chs_.emplace(ch, subscriber{});
 }
 
 void rtmp_sink::write(const frame_buffer::ptr& frame, const boost::system::error_code& ec)
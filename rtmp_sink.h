@@ -3,7 +3,7 @@
 
 #include <string>
 #include <memory>
-#include <set>
+#include <map>
 #include <utility>
 #include "frame_buffer.h"
 #include "channel.h"
@@ -35,10 +35,19 @@ class rtmp_sink : public sink
     void safe_add_channel(const channel::ptr& ch);
     void safe_del_channel(const channel::ptr& ch);
 
+   private:
+    // 订阅者落后直播超过这个时间，丢掉后续的帧直到下一个关键帧
+    const static uint64_t kMaxLagMs = 2000;
+    struct subscriber
+    {
+        bool wait_keyframe = false;
+        uint64_t dropped = 0;
+    };
+
    private:
     std::string id_;
     simple_rtmp::executors::executor& ex_;
-    std::set<channel::ptr> chs_;
+    std::map<channel::ptr, subscriber> chs_;
     frame_buffer::ptr video_config_;
     frame_buffer::ptr audio_config_;
     std::vector<frame_buffer::ptr> gop_cache_;
@@ -13,9 +13,6 @@ extern "C"
 
 using simple_rtmp::rtsp_aac_encoder;
 
-static void* rtp_alloc(void* param, int bytes);
-static void rtp_free(void* param, void* packet);
-
 rtsp_aac_encoder::rtsp_aac_encoder(std::string id) : id_(std::move(id))
 {
 }
@@ -36,7 +33,12 @@ void simple_rtmp::rtsp_aac_encoder::set_output(const simple_rtmp::channel::ptr&
 int rtsp_aac_encoder::rtp_encode_packet(void* param, const void* packet, int bytes, uint32_t timestamp, int flags)
 {
     auto* self = static_cast<rtsp_aac_encoder*>(param);
-    auto frame = fixed_frame_buffer::create(packet, bytes);
+    // 打包器直接写在 rtp_alloc 分配的池化块里，补上交织头就是所有播放者共用的帧
+    auto frame = self->allocator_.packet(packet, bytes);
+    if (bytes > static_cast<int>(kRtpHeaderSize))
+    {
+        self->track_->on_packet(bytes - kRtpHeaderSize, timestamp, self->clock_);
+    }
     frame->set_pts(timestamp);
     frame->set_dts(timestamp);
     frame->set_media(simple_rtmp::rtmp_tag::audio);
@@ -82,14 +84,15 @@ void simple_rtmp::rtsp_aac_encoder::write(const simple_rtmp::frame_buffer::ptr&
     {
         return;
     }
+    clock_ = rtp_wall_clock();
     rtp_payload_encode_input(ctx_, frame->data(), static_cast<int>(frame->size()), frame->pts() * sample_rate_ / 1000);
 }
-static void* rtp_alloc(void* /*param*/, int bytes)
+void* rtsp_aac_encoder::rtp_alloc(void* param, int bytes)
 {
-    return malloc(bytes);
+    return static_cast<rtsp_aac_encoder*>(param)->allocator_.alloc(bytes);
 }
 
-static void rtp_free(void* /*param*/, void* packet)
+void rtsp_aac_encoder::rtp_free(void* param, void* packet)
 {
-    free(packet);
+    static_cast<rtsp_aac_encoder*>(param)->allocator_.free(packet);
 }
@@ -6,6 +6,7 @@
 #include <vector>
 #include <sstream>
 #include "rtsp_encoder.h"
+#include "rtsp_packet_allocator.h"
 #include "rtsp_track.h"
 
 namespace simple_rtmp
@@ -24,6 +25,8 @@ class rtsp_aac_encoder : public rtsp_encoder
 
    private:
     static int rtp_encode_packet(void* param, const void* packet, int bytes, uint32_t timestamp, int /*flags*/);
+    static void* rtp_alloc(void* param, int bytes);
+    static void rtp_free(void* param, void* packet);
 
    private:
     std::string id_;
@@ -32,6 +35,9 @@ class rtsp_aac_encoder : public rtsp_encoder
     int channel_count_ = 0;
     rtsp_track::ptr track_;
     void* ctx_ = nullptr;
+    // 当前帧开始打包时的 rtp_wall_clock()，这一帧的包共用
+    uint64_t clock_ = 0;
+    rtsp_packet_allocator allocator_{kRtpAudioChannel};
 };
 }    // namespace simple_rtmp
 #endif
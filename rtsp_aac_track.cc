@@ -2,9 +2,9 @@
 
 using simple_rtmp::rtsp_aac_track;
 
-std::string simple_rtmp::rtsp_aac_track::sdp() const
+const std::string& simple_rtmp::rtsp_aac_track::sdp() const
 {
-    return ss_.str();
+    return sdp_;
 }
 
 std::string simple_rtmp::rtsp_aac_track::id() const
@@ -24,14 +24,15 @@ int32_t rtsp_aac_track::sample_rate() const
 
 rtsp_aac_track::rtsp_aac_track(const std::string& cfg, int sample_rate, int channels, int bitrate)
 {
-    ss_ << "m=audio 0 RTP/AVP 98\r\n";
-    ss_ << "c=IN IP4 0.0.0.0\r\n";
+    std::stringstream ss;
+    ss << "m=audio 0 RTP/AVP 98\r\n";
+    ss << "c=IN IP4 0.0.0.0\r\n";
 
     if (bitrate != 0)
     {
-        ss_ << "b=AS:" << bitrate << "\r\n";
+        ss << "b=AS:" << bitrate << "\r\n";
     }
-    ss_ << "a=rtpmap:98 mpeg4-generic/" << sample_rate << "/" << channels << "\r\n";
+    ss << "a=rtpmap:98 mpeg4-generic/" << sample_rate << "/" << channels << "\r\n";
     std::string config;
     char buf[8] = {0};
     for (const auto& ch : cfg)
@@ -39,9 +40,10 @@ rtsp_aac_track::rtsp_aac_track(const std::string& cfg, int sample_rate, int chan
         snprintf(buf, sizeof(buf), "%02X", static_cast<uint8_t>(ch));
         config.append(buf);
     }
-    ss_ << "a=fmtp:98 streamtype=5;profile-level-id=1;mode=AAC-hbr;"
+    ss << "a=fmtp:98 streamtype=5;profile-level-id=1;mode=AAC-hbr;"
         << "sizelength=13;indexlength=3;indexdeltalength=3;config=" << config << "\r\n";
-    ss_ << "a=control:" << kRtspAudioTrackId << "\r\n";
+    ss << "a=control:" << kRtspAudioTrackId << "\r\n";
+    sdp_ = ss.str();
     ssrc_ = rtsp_track::audio_ssrc();
     sample_rate_ = sample_rate;
 }
@@ -1,5 +1,9 @@
 #include <ctime>
+#include <charconv>
+#include <mutex>
+#include <type_traits>
 #include <boost/algorithm/string.hpp>
+#include <boost/utility/string_view.hpp>
 #include "rtsp_forward_session.h"
 #include "socket.h"
 #include "log.h"
@@ -8,31 +12,43 @@
 #include "frame_buffer.h"
 #include "rtsp_server_context.h"
 #include "timestamp.h"
+#include "stream_affinity.h"
+#include "rtcp_scheduler.h"
 
 extern "C"
 {
 #include "rtp-payload.h"
 #include "rtp-profile.h"
-#include "rtp-internal.h"
 #include "rtp.h"
 }
 
 using simple_rtmp::rtsp_forward_session;
 using namespace std::placeholders;
-static void on_rtcp_event(void* param, const struct rtcp_msg_t* msg);
 struct simple_rtmp::rtsp_forward_args
 {
     std::string app;
     std::string stream;
     std::shared_ptr<rtsp_server_context> ctx;
 };
+// SETUP 里告诉客户端的会话超时，这段时间内没有请求或者 rtcp 就断开
+static const uint64_t kSessionTimeoutSeconds = 65;
+// 从连接到 PLAY 最多 10 秒，一批数据 15 秒写不完断开
+static const simple_rtmp::connection_timeout_option kRtspTimeout = {10 * 1000, 0, kSessionTimeoutSeconds * 1000, 15 * 1000};
+// 视频丢包率超过 10% 只发关键帧，连续 3 个报告低于 2% 恢复
+static const double kKeyframeOnlyEnterLoss = 0.10;
+static const double kKeyframeOnlyLeaveLoss = 0.02;
+static const int kKeyframeOnlyLeaveReports = 3;
+
+static std::mutex write_option_mutex;
+static simple_rtmp::write_queue_option write_option;
+
 static std::string make_session_id()
 {
-    std::atomic<uint64_t> id = 0xff1fcc;
+    static std::atomic<uint64_t> id{0xff1fcc};
     return std::to_string(id++);
 }
 
-rtsp_forward_session::rtsp_forward_session(simple_rtmp::executors::executor& ex) : ex_(ex), conn_(std::make_shared<tcp_connection>(ex_))
+rtsp_forward_session::rtsp_forward_session(simple_rtmp::executors::executor& ex) : ex_(&ex), conn_(std::make_shared<tcp_connection>(ex))
 {
     LOG_DEBUG("create {}", static_cast<void*>(this));
 };
@@ -50,6 +66,12 @@ boost::asio::ip::tcp::socket& rtsp_forward_session::socket()
 {
     return conn_->socket();
 }
+
+void rtsp_forward_session::set_write_queue_option(const write_queue_option& op)
+{
+    std::lock_guard<std::mutex> lock(write_option_mutex);
+    write_option = op;
+}
 void rtsp_forward_session::start()
 {
     rtsp_server_context_handler handler;
@@ -58,75 +80,125 @@ void rtsp_forward_session::start()
     handler.on_setup = std::bind(&rtsp_forward_session::on_setup, this, _1, _2, _3);
     handler.on_play = std::bind(&rtsp_forward_session::on_play, this, _1, _2);
     handler.on_teardown = std::bind(&rtsp_forward_session::on_teardown, this, _1, _2);
+    handler.on_parameter = std::bind(&rtsp_forward_session::on_parameter, this, _1, _2);
     handler.on_rtcp = std::bind(&rtsp_forward_session::on_rtcp, this, _1, _2);
     args_ = std::make_shared<simple_rtmp::rtsp_forward_args>();
     args_->ctx = std::make_shared<simple_rtmp::rtsp_server_context>(std::move(handler));
     channel_ = std::make_shared<simple_rtmp::channel>();
     channel_->set_output(std::bind(&rtsp_forward_session::channel_out, shared_from_this(), _1, _2));
+    conn_->set_timeout_option(kRtspTimeout);
+    {
+        std::lock_guard<std::mutex> lock(write_option_mutex);
+        conn_->set_write_queue_option(write_option);
+    }
     conn_->set_read_cb(std::bind(&rtsp_forward_session::on_read, shared_from_this(), _1, _2));
     conn_->set_write_cb(std::bind(&rtsp_forward_session::on_write, shared_from_this(), _1, _2));
+    conn_->set_drop_cb(std::bind(&rtsp_forward_session::on_drop, shared_from_this(), _1));
     conn_->start();
 }
 
-static simple_rtmp::frame_buffer::ptr make_frame_header(int channle, const simple_rtmp::frame_buffer::ptr& frame)
-{
-    uint32_t bytes = frame->size();
-    uint8_t rtp_header[4] = {0};
-    rtp_header[0] = '$';
-    rtp_header[1] = channle;
-    rtp_header[2] = (bytes >> 8) & 0xFF;
-    rtp_header[3] = bytes & 0xff;
-    return simple_rtmp::fixed_frame_buffer::create(rtp_header, 4);
-}
-
-void rtsp_forward_session::send_video_rtcp(const frame_buffer::ptr& frame)
+bool rtsp_forward_session::send_report(rtcp_sender* sender, const rtsp_track::ptr& track, int rtcp_channel)
 {
-    if (video_rtcp_ctx_ == nullptr)
+    if (conn_ == nullptr || track == nullptr)
+    {
+        return false;
+    }
+    // 包数和字节数用流的统计减去开始播放时的值，再去掉这个会话丢掉的包
+    auto stats = track->sender_stats();
+    rtcp_sender_info info;
+    info.ssrc = track->ssrc();
+    info.packets = static_cast<uint32_t>(stats.packets - sender->base.packets - sender->dropped_packets.load(std::memory_order_relaxed));
+    info.octets = static_cast<uint32_t>(stats.octets - sender->base.octets - sender->dropped_octets.load(std::memory_order_relaxed));
+    // 播放后还没有包时不发
+    if (stats.clock == 0 || info.packets == 0)
     {
-        struct rtp_event_t event;
-        event.on_rtcp = on_rtcp_event;
-        video_rtcp_ctx_ = rtp_create(&event, this, video_track_->ssrc(), frame->dts() * 1000 / video_track_->sample_rate(), video_track_->sample_rate(), 4 * 1024 * 1024, 1);
-        rtp_set_info(video_rtcp_ctx_, "SimpleRtsp", "vx");
+        return false;
     }
-    auto now = rtpclock();
-    auto interval = rtp_rtcp_interval(video_rtcp_ctx_);
+    // 时间戳从流最近一个包按时钟推到现在
+    info.clock = rtp_wall_clock();
+    uint64_t const elapsed = info.clock > stats.clock ? info.clock - stats.clock : 0;
+    info.rtp_timestamp = stats.timestamp + static_cast<uint32_t>(elapsed * static_cast<uint64_t>(track->sample_rate()) / 1000000);
 
-    if (video_rtcp_time_ == 0 || video_rtcp_time_ + (uint64_t)interval * 1000 <= now)
+    uint8_t buffer[128];
+    std::size_t n = write_sender_report(info, "SimpleRtsp", buffer, sizeof(buffer));
+    sender->feedback.on_sender_report(sender_report_ntp(buffer, n));
+    auto frame = make_interleaved_packet(rtcp_channel, buffer, n);
+    int const rtp_channel = rtcp_channel == kRtcpVideoChannel ? kRtpVideoChannel : kRtpAudioChannel;
+    if (udp_ != nullptr && udp_peers_[rtp_channel].port() != 0)
     {
-        video_rtcp_time_ = now;
+        udp_->send_rtcp(udp_peers_[rtcp_channel], frame, kRtspInterleavedHeaderSize);
+    }
+    else
+    {
+        conn_->write_frame(frame);
+    }
+    return true;
+}
 
-        char buffer[1024] = {0};
-        size_t n = rtp_rtcp_report(video_rtcp_ctx_, buffer, sizeof(buffer));
-        auto rtcp_frame = fixed_frame_buffer::create(buffer, n);
-        auto header_frame = make_frame_header(kRtcpVideoChannel, rtcp_frame);
-        conn_->write_frame(header_frame);
-        conn_->write_frame(rtcp_frame);
+void rtsp_forward_session::reset_report_base(rtcp_sender* sender, const rtsp_track::ptr& track)
+{
+    // 之前丢掉的包也算在基准里，发送报告只减这次播放以后丢的
+    sender->base = track->sender_stats();
+    sender->base.packets -= static_cast<uint32_t>(sender->dropped_packets.load(std::memory_order_relaxed));
+    sender->base.octets -= sender->dropped_octets.load(std::memory_order_relaxed);
+}
+
+void rtsp_forward_session::count_dropped(rtcp_sender* sender, const frame_buffer::ptr& frame)
+{
+    if (frame->size() < kRtspInterleavedHeaderSize + kRtpHeaderSize)
+    {
+        return;
     }
-    rtp_onsend(video_rtcp_ctx_, (const void*)frame->data(), frame->size());
+    sender->dropped_packets.fetch_add(1, std::memory_order_relaxed);
+    sender->dropped_octets.fetch_add(frame->size() - kRtspInterleavedHeaderSize - kRtpHeaderSize, std::memory_order_relaxed);
 }
 
-void rtsp_forward_session::send_audio_rtcp(const frame_buffer::ptr& frame)
+void rtsp_forward_session::on_drop(const frame_buffer::ptr& frame)
 {
-    if (audio_rtcp_ctx_ == nullptr)
+    // 连接只丢 rtp 包，rtcp 包没有媒体类型
+    if (frame->media() == simple_rtmp::rtmp_tag::video)
     {
-        struct rtp_event_t event;
-        event.on_rtcp = on_rtcp_event;
-        audio_rtcp_ctx_ = rtp_create(&event, this, audio_track_->ssrc(), frame->dts() * 1000 / audio_track_->sample_rate(), audio_track_->sample_rate(), 128 * 1024, 1);
-        rtp_set_info(audio_rtcp_ctx_, "SimpleRtsp", "ax");
+        count_dropped(&video_rtcp_, frame);
     }
-    auto now = rtpclock();
-    auto interval = rtp_rtcp_interval(audio_rtcp_ctx_);
-    if (audio_rtcp_time_ == 0 || audio_rtcp_time_ + (uint64_t)interval * 1000 <= now)
+    else if (frame->media() == simple_rtmp::rtmp_tag::audio)
     {
-        audio_rtcp_time_ = now;
-        char buffer[1024] = {0};
-        size_t n = rtp_rtcp_report(audio_rtcp_ctx_, buffer, sizeof(buffer));
-        auto rtcp_frame = fixed_frame_buffer::create(buffer, n);
-        auto header_frame = make_frame_header(kRtcpAudioChannel, rtcp_frame);
-        conn_->write_frame(header_frame);
-        conn_->write_frame(rtcp_frame);
+        count_dropped(&audio_rtcp_, frame);
+    }
+}
+
+void rtsp_forward_session::start_rtcp()
+{
+    auto* scheduler = rtcp_scheduler::local(*ex_);
+    std::weak_ptr<rtsp_forward_session> self = shared_from_this();
+    if (video_track_ != nullptr && !multicast_[kRtpVideoChannel] && video_rtcp_.task == 0)
+    {
+        reset_report_base(&video_rtcp_, video_track_);
+        video_rtcp_.task = scheduler->add(
+            [self]()
+            {
+                auto session = self.lock();
+                return session != nullptr && session->send_report(&session->video_rtcp_, session->video_track_, kRtcpVideoChannel);
+            });
+    }
+    if (audio_track_ != nullptr && !multicast_[kRtpAudioChannel] && audio_rtcp_.task == 0)
+    {
+        reset_report_base(&audio_rtcp_, audio_track_);
+        audio_rtcp_.task = scheduler->add(
+            [self]()
+            {
+                auto session = self.lock();
+                return session != nullptr && session->send_report(&session->audio_rtcp_, session->audio_track_, kRtcpAudioChannel);
+            });
     }
-    rtp_onsend(audio_rtcp_ctx_, (const void*)frame->data(), frame->size());
+}
+
+void rtsp_forward_session::stop_rtcp()
+{
+    auto* scheduler = rtcp_scheduler::local(*ex_);
+    scheduler->del(video_rtcp_.task);
+    scheduler->del(audio_rtcp_.task);
+    video_rtcp_.task = 0;
+    audio_rtcp_.task = 0;
 }
 
 void rtsp_forward_session::channel_out(const frame_buffer::ptr& frame, const boost::system::error_code& ec)
@@ -138,27 +210,82 @@ void rtsp_forward_session::channel_out(const frame_buffer::ptr& frame, const boo
         return;
     }
 
-    // 收到编码后的数据包
-    if (frame->media() == simple_rtmp::rtmp_tag::video)
+    // 编码器输出的包已经带了交织头，通道号在 SETUP 时由服务端定好
+    // rtcp 发送报告由 rtcp_scheduler 定时发，这里只把共用的包交出去
+    int rtp_channel = kRtpVideoChannel;
+    if (frame->media() == simple_rtmp::rtmp_tag::audio)
     {
-        send_video_rtcp(frame);
-        auto header_frame = make_frame_header(kRtpVideoChannel, frame);
-        conn_->write_frame(header_frame);
+        rtp_channel = kRtpAudioChannel;
     }
-    else if (frame->media() == simple_rtmp::rtmp_tag::audio)
+    else if (frame->media() != simple_rtmp::rtmp_tag::video)
+    {
+        return;
+    }
+    if (multicast_[rtp_channel])
     {
-        send_audio_rtcp(frame);
-        auto header_frame = make_frame_header(kRtpAudioChannel, frame);
-        conn_->write_frame(header_frame);
+        return;
     }
-    else
+    if (rtp_channel == kRtpVideoChannel && !deliver_video(frame))
+    {
+        count_dropped(&video_rtcp_, frame);
+        return;
+    }
+    if (udp_ != nullptr && udp_peers_[rtp_channel].port() != 0)
+    {
+        if (!ex_->get_executor().running_in_this_thread())
+        {
+            // 流没有固定的 executor 时 sink 在别的线程输出，udp_transport 只能在自己的线程上用
+            boost::asio::post(*ex_, std::bind(&rtsp_forward_session::send_udp, shared_from_this(), rtp_channel, frame));
+            return;
+        }
+        send_udp(rtp_channel, frame);
+        return;
+    }
+    // 超过写队列水位丢掉的包由 on_drop 计入发送报告
+    if (!conn_->admit_rtp_packet(frame))
     {
         return;
     }
-
     conn_->write_frame(frame);
 }
 
+bool rtsp_forward_session::deliver_video(const frame_buffer::ptr& frame)
+{
+    bool const keyframe = frame->flag() == 1;
+    if (keyframe_only_.load(std::memory_order_relaxed))
+    {
+        skipping_ = true;
+        last_keyframe_ = keyframe;
+        return keyframe;
+    }
+    if (!skipping_)
+    {
+        return true;
+    }
+    // 跳过的帧还被后面的帧参考，恢复时上一个发出的包是关键帧才接着发，否则等下一个关键帧
+    if (keyframe)
+    {
+        last_keyframe_ = true;
+        return true;
+    }
+    if (!last_keyframe_)
+    {
+        return false;
+    }
+    skipping_ = false;
+    return true;
+}
+
+void rtsp_forward_session::send_udp(int rtp_channel, const frame_buffer::ptr& frame)
+{
+    if (udp_ == nullptr)
+    {
+        return;
+    }
+    // 交给当前线程的 udp_transport，这一轮事件结束时和其它会话的包一起 sendmmsg
+    udp_->send_rtp(udp_peers_[rtp_channel], frame, kRtspInterleavedHeaderSize);
+}
+
 void rtsp_forward_session::on_read(const simple_rtmp::frame_buffer::ptr& frame, boost::system::error_code ec)
 {
     if (ec)
@@ -188,12 +315,16 @@ void rtsp_forward_session::on_write(const boost::system::error_code& ec, std::si
 
 void rtsp_forward_session::shutdown()
 {
-    ex_.post(std::bind(&rtsp_forward_session::safe_shutdown, shared_from_this()));
+    boost::asio::post(*ex_, std::bind(&rtsp_forward_session::safe_shutdown, shared_from_this()));
 }
 
 void rtsp_forward_session::safe_shutdown()
 {
     LOG_DEBUG("shutdown {}", static_cast<void*>(this));
+    stop_rtcp();
+    rtcp_feedback::remove(session_id_);
+    quality_.session.clear();
+    leave_multicast();
     auto s = sink_.lock();
     if (s)
     {
@@ -204,58 +335,114 @@ void rtsp_forward_session::safe_shutdown()
         channel_.reset();
     }
 
+    if (udp_ != nullptr)
+    {
+        udp_->del_peer(udp_peers_[kRtcpVideoChannel]);
+        udp_->del_peer(udp_peers_[kRtcpAudioChannel]);
+        udp_ = nullptr;
+    }
+
     if (conn_)
     {
         conn_->shutdown();
         conn_.reset();
     }
 }
-std::string rfc822_now_format()
+// Date 头每秒格式化一次，每个线程一份
+static const std::string& rfc822_now_format()
 {
     static const char* s_month[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
     static const char* s_week[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
 
+    thread_local time_t cached = 0;
+    thread_local std::string date;
     time_t t = ::time(nullptr);
-    struct tm* tm = gmtime(&t);
+    if (t == cached)
+    {
+        return date;
+    }
+    struct tm tm;
+    gmtime_r(&t, &tm);
     char buf[64] = {0};
     snprintf(buf,
              sizeof(buf),
              "%s, %02d %s %04d %02d:%02d:%02d GMT",
-             s_week[(unsigned int)tm->tm_wday % 7],
-             tm->tm_mday,
-             s_month[(unsigned int)tm->tm_mon % 12],
-             tm->tm_year + 1900,
-             tm->tm_hour,
-             tm->tm_min,
-             tm->tm_sec);
-    return buf;
-}
-static simple_rtmp::fixed_frame_buffer::ptr make_461_response(int req)
-{
-    std::stringstream ss;
-    ss << "RTSP/1.0 461 Unsupported Transport\r\n";
-    ss << "CSeq: " << req << "\r\n";
-    ss << "Date: " << rfc822_now_format().data() << "\r\n";
-    ss << "User-Agent: Simple/Rtsp\r\n\r\n";
-    std::string response = ss.str();
-    return simple_rtmp::fixed_frame_buffer::create(response.data(), response.size());
+             s_week[(unsigned int)tm.tm_wday % 7],
+             tm.tm_mday,
+             s_month[(unsigned int)tm.tm_mon % 12],
+             tm.tm_year + 1900,
+             tm.tm_hour,
+             tm.tm_min,
+             tm.tm_sec);
+    cached = t;
+    date = buf;
+    return date;
+}
+
+// 响应直接写进预先申请的池化块，写完就是要发送的帧，不经过 stringstream 和中间的 string
+class response_writer
+{
+   public:
+    explicit response_writer(std::size_t reserve = 1024) : frame_(simple_rtmp::pooled_frame_buffer::create(reserve))
+    {
+    }
+
+   public:
+    response_writer& operator<<(boost::string_view s)
+    {
+        frame_->append(s.data(), s.size());
+        return *this;
+    }
+    template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    response_writer& operator<<(T v)
+    {
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        frame_->append(buf, r.ptr - buf);
+        return *this;
+    }
+    // 状态行、CSeq 和 Date
+    response_writer& status(int code, boost::string_view reason, int seq)
+    {
+        return *this << "RTSP/1.0 " << code << " " << reason << "\r\nCSeq: " << seq << "\r\nDate: " << rfc822_now_format() << "\r\n";
+    }
+    simple_rtmp::frame_buffer::ptr frame() const
+    {
+        return frame_;
+    }
+
+   private:
+    simple_rtmp::pooled_frame_buffer::ptr frame_;
+};
+
+static simple_rtmp::frame_buffer::ptr make_461_response(int req)
+{
+    response_writer w(256);
+    w.status(461, "Unsupported Transport", req);
+    w << "User-Agent: Simple/Rtsp\r\n\r\n";
+    return w.frame();
+}
+
+const std::string& rtsp_forward_session::local_ip()
+{
+    if (local_ip_.empty())
+    {
+        local_ip_ = get_socket_local_ip(conn_->socket());
+    }
+    return local_ip_;
 }
 
 int rtsp_forward_session::on_options(const std::string& url)
 {
     LOG_INFO("options {}", url);
+    conn_->keepalive();
 
-    const static char* option_fmt =
-        "RTSP/1.0 200 OK\r\n"
-        "CSeq: %d\r\n"
-        "Date: %s\r\n"
-        "Content-Length: 0\r\n"
-        "Public: OPTIONS, DESCRIBE, SETUP, TEARDOWN, PLAY, SET_PARAMETER\r\n\r\n";
-    char buffer[1024] = {0};
-    int n = snprintf(buffer, sizeof buffer, option_fmt, args_->ctx->seq(), rfc822_now_format().data());
-    auto frame = fixed_frame_buffer::create(buffer, n);
-    conn_->write_frame(frame);
+    response_writer w(256);
+    w.status(200, "OK", args_->ctx->seq());
+    w << "Content-Length: 0\r\n"
+         "Public: OPTIONS, DESCRIBE, SETUP, TEARDOWN, PLAY, GET_PARAMETER, SET_PARAMETER\r\n\r\n";
+    conn_->write_frame(w.frame());
     return 0;
 }
 
@@ -272,6 +459,7 @@ int rtsp_forward_session::on_describe(const std::string& url)
         return -1;
     }
     std::string sink_id = "rtsp_" + result[result.size() - 2] + "_" + result[result.size() - 1];
+    stream_id_ = result[result.size() - 2] + "/" + result[result.size() - 1];
     auto s = simple_rtmp::sink::get(sink_id);
     if (s == nullptr)
     {
@@ -284,50 +472,59 @@ int rtsp_forward_session::on_describe(const std::string& url)
         shutdown();
         return -1;
     }
-    rtsp_s->tracks(std::bind(&rtsp_forward_session::on_track, shared_from_this(), url, _1));
+    auto* ex = affinity::instance().get_executor(result[result.size() - 2], result[result.size() - 1]);
+    if (ex != nullptr && ex != ex_)
+    {
+        ex_ = ex;
+        conn_->migrate(*ex_);
+    }
+    rtsp_s->tracks(std::bind(&rtsp_forward_session::on_track, shared_from_this(), url, _1, _2));
     sink_ = s;
     return 0;
 }
-void rtsp_forward_session::on_track(const std::string& url, std::vector<rtsp_track::ptr> tracks)
+void rtsp_forward_session::on_track(const std::string& url, std::vector<rtsp_track::ptr> tracks, const std::shared_ptr<const std::string>& media)
 {
-    uint64_t now = timestamp::now().milliseconds();
-    std::stringstream ss;
-    ss << "v=0\n";
-    ss << "o=- " << now << " " << now << " IN IP4 " << get_socket_local_ip(conn_->socket()) << "\n";
-    ss << "s=Simple\n";
-    ss << "t=0 0\n";
-    ss << "a=range:npt=now-\n";
-    ss << "a=control:*\n";
-    ss << "a=x-qt-text-nam:Simple/Media\n";
-    ss << "a=x-qt-text-inf:" << url << "\n";
     for (const auto& track : tracks)
     {
         if (track == nullptr)
         {
             continue;
         }
-        ss << track->sdp();
         std::string id = url + "/" + track->id();
         tracks_[id] = track;
     }
-    std::string sdp = ss.str();
-    // clear stringstream
-    ss.str("");
-    ss << "RTSP/1.0 200 OK\r\n";
-    ss << "CSeq: " << args_->ctx->seq() << "\r\n";
-    ss << "Date: " << rfc822_now_format().data() << "\r\n";
-    ss << "Content-Base: " << url << "\r\n";
-    ss << "Content-Type: application/sdp\r\n";
-    ss << "Content-Length: " << sdp.length() << "\r\n\r\n";
-    ss << sdp;
-    std::string response = ss.str();
-    auto frame = fixed_frame_buffer::create(response.data(), response.size());
+    // 会话级的几行每个连接不同，媒体描述用 sink 缓存好的
+    uint64_t now = timestamp::now().milliseconds();
+    response_writer head(256 + url.size());
+    head << "v=0\n";
+    head << "o=- " << now << " " << now << " IN IP4 " << local_ip() << "\n";
+    head << "s=Simple\n";
+    head << "t=0 0\n";
+    head << "a=range:npt=now-\n";
+    head << "a=control:*\n";
+    head << "a=x-qt-text-nam:Simple/Media\n";
+    head << "a=x-qt-text-inf:" << url << "\n";
+    auto sdp_head = head.frame();
+    std::size_t const media_size = media != nullptr ? media->size() : 0;
+
+    response_writer w(512 + url.size() + sdp_head->size() + media_size);
+    w.status(200, "OK", args_->ctx->seq());
+    w << "Content-Base: " << url << "\r\n";
+    w << "Content-Type: application/sdp\r\n";
+    w << "Content-Length: " << sdp_head->size() + media_size << "\r\n\r\n";
+    w << boost::string_view(reinterpret_cast<const char*>(sdp_head->data()), sdp_head->size());
+    if (media != nullptr)
+    {
+        w << *media;
+    }
+    auto frame = w.frame();
     conn_->write_frame(frame);
-    LOG_DEBUG("{} describe response -> {}", url, response);
+    LOG_DEBUG("{} describe response {} bytes", url, frame->size());
 }
 int rtsp_forward_session::on_setup(const std::string& url, const std::string& session, rtsp_transport* transport)
 {
     LOG_INFO("setup {} session {} transport {}", url, session, transport->transport);
+    conn_->keepalive();
     std::string track_id = url;
     auto track = tracks_[track_id];
     if (track == nullptr)
@@ -350,50 +547,170 @@ int rtsp_forward_session::on_setup(const std::string& url, const std::string& se
         shutdown();
         return -1;
     }
+    bool const video = boost::algorithm::ends_with(track_id, kRtspVideoTrackId);
+    int const rtp_channel = video ? kRtpVideoChannel : kRtpAudioChannel;
+    int const rtcp_channel = video ? kRtcpVideoChannel : kRtcpAudioChannel;
     if (transport->multicast != 0)
     {
-        auto frame = make_461_response(args_->ctx->seq());
-        conn_->write_frame(frame);
-        LOG_ERROR("{} no support multicast {}", url, track_id);
-        shutdown();
-        return -1;
+        return setup_multicast(url, track, rtp_channel);
     }
-    if (transport->transport == 0)
+    if (transport->transport == 0 && setup_udp(transport, rtp_channel, rtcp_channel) != 0)
     {
         auto frame = make_461_response(args_->ctx->seq());
         conn_->write_frame(frame);
-        LOG_ERROR("{} no support udp {}", url, track_id);
+        LOG_ERROR("{} udp transport unavailable {}", url, track_id);
         return -1;
     }
 
-    std::stringstream ss;
-    ss << "RTSP/1.0 200 OK\r\n";
-    ss << "CSeq: " << args_->ctx->seq() << "\r\n";
-    ss << "Date: " << rfc822_now_format().data() << "\r\n";
-    ss << "Transport: RTP/AVP/TCP;unicast;destination=" << get_socket_local_ip(conn_->socket()) << ";";
-    ss << "source=" << get_socket_remote_ip(conn_->socket()) << ";";
-    if (boost::algorithm::ends_with(track_id, kRtspVideoTrackId))
+    if (session_id_.empty())
     {
-        ss << "interleaved=" << kRtpVideoChannel << "-" << kRtcpVideoChannel << ";ssrc=" << track->ssrc() << "\r\n";
+        session_id_ = make_session_id();
+    }
+    response_writer w;
+    w.status(200, "OK", args_->ctx->seq());
+    if (transport->transport == 0)
+    {
+        w << "Transport: RTP/AVP;unicast;client_port=" << transport->client_port1 << "-" << transport->client_port2;
+        w << ";server_port=" << udp_->rtp_port() << "-" << udp_->rtcp_port() << ";ssrc=" << track->ssrc() << "\r\n";
     }
     else
     {
-        ss << "interleaved=" << kRtpAudioChannel << "-" << kRtcpAudioChannel << ";ssrc=" << track->ssrc() << "\r\n";
+        w << "Transport: RTP/AVP/TCP;unicast;destination=" << local_ip() << ";";
+        w << "source=" << get_socket_remote_ip(conn_->socket()) << ";";
+        w << "interleaved=" << rtp_channel << "-" << rtcp_channel << ";ssrc=" << track->ssrc() << "\r\n";
+    }
+    w << "x-Dynamic-Rate: 1\r\n";
+    w << "x-Transport-Options: late-tolerance=1.400000\r\n";
+    w << "Session: " << session_id_ << ";timeout=" << kSessionTimeoutSeconds << "\r\n\r\n";
+    auto frame = w.frame();
+    conn_->write_frame(frame);
+    LOG_DEBUG("{} setup response {} bytes", url, frame->size());
+    return 0;
+}
+
+int rtsp_forward_session::setup_udp(rtsp_transport* transport, int rtp_channel, int rtcp_channel)
+{
+    if (transport->client_port1 == 0 || transport->client_port2 == 0)
+    {
+        return -1;
+    }
+    boost::system::error_code ec;
+    auto address = conn_->socket().remote_endpoint(ec).address();
+    if (ec)
+    {
+        return -1;
+    }
+    if (address.is_v6() && address.to_v6().is_v4_mapped())
+    {
+        address = boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address.to_v6());
+    }
+    // udp socket 只绑定了 ipv4
+    if (!address.is_v4())
+    {
+        return -1;
+    }
+    if (udp_ == nullptr)
+    {
+        udp_ = udp_transport::local(*ex_);
+    }
+    if (udp_ == nullptr)
+    {
+        return -1;
+    }
+    // 播放前已经迁移到流所在的 executor，udp_transport 和 sink 的输出在同一个线程
+    udp_->del_peer(udp_peers_[rtcp_channel]);
+    udp_peers_[rtp_channel] = boost::asio::ip::udp::endpoint(address, transport->client_port1);
+    udp_peers_[rtcp_channel] = boost::asio::ip::udp::endpoint(address, transport->client_port2);
+    std::weak_ptr<rtsp_forward_session> self = shared_from_this();
+    udp_->add_peer(udp_peers_[rtcp_channel],
+                   [self, rtcp_channel](const frame_buffer::ptr& frame)
+                   {
+                       auto session = self.lock();
+                       if (session != nullptr && session->conn_ != nullptr)
+                       {
+                           session->on_rtcp(rtcp_channel, frame);
+                       }
+                   });
+    return 0;
+}
+
+int rtsp_forward_session::setup_multicast(const std::string& url, const rtsp_track::ptr& track, int rtp_channel)
+{
+    auto s = std::dynamic_pointer_cast<simple_rtmp::rtsp_sink>(sink_.lock());
+    if (s == nullptr)
+    {
+        LOG_ERROR("{} multicast setup sink not found", url);
+        shutdown();
+        return -1;
     }
     if (session_id_.empty())
     {
         session_id_ = make_session_id();
     }
-    ss << "x-Dynamic-Rate: 1\r\n";
-    ss << "x-Transport-Options: late-tolerance=1.400000\r\n";
-    ss << "Session: " << session_id_ << ";timeout=65\r\n\r\n";
-    std::string response = ss.str();
-    auto frame = fixed_frame_buffer::create(response.data(), response.size());
-    conn_->write_frame(frame);
-    LOG_DEBUG("{} setup response -> {}", url, response);
+    int const seq = args_->ctx->seq();
+    // 组由 sink 在自己的线程上打开，结果回到会话的线程再回复
+    auto self = shared_from_this();
+    auto* ex = ex_;
+    int const media = rtp_channel == kRtpVideoChannel ? simple_rtmp::rtmp_tag::video : simple_rtmp::rtmp_tag::audio;
+    s->join_multicast(media,
+                      [self, ex, seq, rtp_channel, track](int ret, const multicast_group& group)
+                      { boost::asio::post(*ex, std::bind(&rtsp_forward_session::on_multicast_setup, self, seq, rtp_channel, track, ret, group)); });
     return 0;
 }
 
+void rtsp_forward_session::on_multicast_setup(int seq, int rtp_channel, const rtsp_track::ptr& track, int ret, const multicast_group& group)
+{
+    bool const joined = multicast_[rtp_channel];
+    if (ret == 0)
+    {
+        multicast_[rtp_channel] = true;
+    }
+    if (conn_ == nullptr)
+    {
+        // 等待期间会话已经关闭，退出刚加入的组
+        leave_multicast();
+        return;
+    }
+    if (ret != 0)
+    {
+        conn_->write_frame(make_461_response(seq));
+        LOG_ERROR("{} multicast unavailable {}", static_cast<void*>(this), track->id());
+        return;
+    }
+    if (joined)
+    {
+        // 重复 SETUP 只算一次播放者
+        auto s = std::dynamic_pointer_cast<simple_rtmp::rtsp_sink>(sink_.lock());
+        if (s != nullptr)
+        {
+            s->leave_multicast(rtp_channel == kRtpVideoChannel ? simple_rtmp::rtmp_tag::video : simple_rtmp::rtmp_tag::audio);
+        }
+    }
+    response_writer w;
+    w.status(200, "OK", seq);
+    w << "Transport: RTP/AVP;multicast;destination=" << group.address << ";port=" << group.port << "-" << group.port + 1;
+    w << ";ttl=" << group.ttl << ";ssrc=" << track->ssrc() << "\r\n";
+    w << "Session: " << session_id_ << ";timeout=" << kSessionTimeoutSeconds << "\r\n\r\n";
+    auto frame = w.frame();
+    conn_->write_frame(frame);
+    LOG_INFO("{} multicast setup {} group {}:{}", static_cast<void*>(this), track->id(), group.address, group.port);
+}
+
+void rtsp_forward_session::leave_multicast()
+{
+    auto s = std::dynamic_pointer_cast<simple_rtmp::rtsp_sink>(sink_.lock());
+    if (multicast_[kRtpVideoChannel] && s != nullptr)
+    {
+        s->leave_multicast(simple_rtmp::rtmp_tag::video);
+    }
+    if (multicast_[kRtpAudioChannel] && s != nullptr)
+    {
+        s->leave_multicast(simple_rtmp::rtmp_tag::audio);
+    }
+    multicast_[kRtpVideoChannel] = false;
+    multicast_[kRtpAudioChannel] = false;
+}
+
 int rtsp_forward_session::on_play(const std::string& url, const std::string& session)
 {
     if (session != session_id_)
@@ -409,17 +726,26 @@ int rtsp_forward_session::on_play(const std::string& url, const std::string& ses
         shutdown();
         return -1;
     }
-    std::stringstream ss;
-    ss << "RTSP/1.0 200 OK\r\n";
-    ss << "CSeq: " << args_->ctx->seq() << "\r\n";
-    ss << "Date: " << rfc822_now_format().data() << "\r\n";
-    ss << "Range: npt=0.000-\r\n";
-    ss << "Session: " << session_id_ << "\r\n\r\n";
-    std::string response = ss.str();
-    auto frame = fixed_frame_buffer::create(response.data(), response.size());
-    conn_->write_frame(frame);
+    response_writer w(256);
+    w.status(200, "OK", args_->ctx->seq());
+    w << "Range: npt=0.000-\r\n";
+    w << "Session: " << session_id_ << "\r\n\r\n";
+    conn_->write_frame(w.frame());
+    conn_->keepalive();
+    conn_->handshake_done();
     LOG_INFO("play {} session {}", url, session);
-    s->add_channel(channel_);
+    // 全部 track 都是组播时不需要单独的输出
+    bool const unicast = (video_track_ != nullptr && !multicast_[kRtpVideoChannel]) || (audio_track_ != nullptr && !multicast_[kRtpAudioChannel]);
+    if (unicast)
+    {
+        s->add_channel(channel_);
+        start_rtcp();
+        quality_.session = session_id_;
+        quality_.stream = stream_id_;
+        quality_.remote = get_socket_remote_address(conn_->socket());
+        quality_.transport = udp_ != nullptr ? "udp" : "tcp";
+        rtcp_feedback::publish(quality_);
+    }
 
     return 0;
 }
@@ -434,36 +760,87 @@ int rtsp_forward_session::on_teardown(const std::string& url, const std::string&
     }
 
     LOG_INFO("play {} teardown {}", url, session);
-    std::stringstream ss;
-    ss << "RTSP/1.0 200 OK\r\n";
-    ss << "CSeq: " << args_->ctx->seq() << "\r\n";
-    ss << "Date: " << rfc822_now_format().data() << "\r\n\r\n";
-    std::string response = ss.str();
-    auto frame = fixed_frame_buffer::create(response.data(), response.size());
-    conn_->write_frame(frame);
+    response_writer w(256);
+    w.status(200, "OK", args_->ctx->seq());
+    w << "\r\n";
+    conn_->write_frame(w.frame());
+    stop_rtcp();
+    rtcp_feedback::remove(session_id_);
+    quality_.session.clear();
+    leave_multicast();
     s->del_channel(channel_);
     sink_.reset();
     return 0;
 }
-int rtsp_forward_session::on_rtcp(int channel, const simple_rtmp::frame_buffer::ptr& frame)
+int rtsp_forward_session::on_parameter(const std::string& url, const std::string& session)
 {
-    void* rtcp_ctx = nullptr;
-    if (channel == kRtcpVideoChannel && video_rtcp_ctx_ != nullptr)
+    LOG_DEBUG("parameter {} session {}", url, session);
+    if (!session.empty() && session != session_id_)
     {
-        rtcp_ctx = video_rtcp_ctx_;
+        LOG_ERROR("parameter {} invalid session {}", url, session);
+        return -1;
     }
-    if (channel == kRtcpAudioChannel && audio_rtcp_ctx_ != nullptr)
+    conn_->keepalive();
+    response_writer w(256);
+    w.status(200, "OK", args_->ctx->seq());
+    if (!session_id_.empty())
     {
-        rtcp_ctx = audio_rtcp_ctx_;
+        w << "Session: " << session_id_ << "\r\n";
     }
-    if (rtcp_ctx != nullptr)
+    w << "Content-Length: 0\r\n\r\n";
+    conn_->write_frame(w.frame());
+    return 0;
+}
+int rtsp_forward_session::on_rtcp(int channel, const simple_rtmp::frame_buffer::ptr& frame)
+{
+    // 客户端的 rtcp 也算会话保活
+    conn_->keepalive();
+    (void)channel;
+    // 接收报告块自己解析，按 ssrc 对应到 track
+    std::vector<rtcp_report_block> blocks;
+    parse_report_blocks(frame->data(), frame->size(), &blocks);
+    for (const auto& rb : blocks)
     {
-        rtp_onreceived_rtcp(rtcp_ctx, (const void*)frame->data(), (int)frame->size());
+        on_receiver_report(rb);
     }
     return 0;
 }
-static void on_rtcp_event(void* param, const struct rtcp_msg_t* msg)
+
+void rtsp_forward_session::on_receiver_report(const rtcp_report_block& rb)
 {
-    (void)param;
-    (void)msg;
+    if (quality_.session.empty())
+    {
+        return;
+    }
+    if (audio_track_ != nullptr && rb.ssrc == audio_track_->ssrc())
+    {
+        audio_rtcp_.feedback.on_report_block(rb, audio_track_->sample_rate(), audio_rtcp_.dropped_packets.load(std::memory_order_relaxed));
+        quality_.audio = audio_rtcp_.feedback.quality();
+        rtcp_feedback::publish(quality_);
+        return;
+    }
+    if (video_track_ == nullptr || rb.ssrc != video_track_->ssrc())
+    {
+        return;
+    }
+    bool const measured = video_rtcp_.feedback.on_report_block(rb, video_track_->sample_rate(), video_rtcp_.dropped_packets.load(std::memory_order_relaxed));
+    quality_.video = video_rtcp_.feedback.quality();
+    double const loss = quality_.video.network_loss;
+    if (measured && !keyframe_only_ && loss >= kKeyframeOnlyEnterLoss)
+    {
+        LOG_WARN("{} session {} video loss {:.1f}% jitter {:.1f}ms, keyframe only", stream_id_, session_id_, loss * 100, quality_.video.jitter_ms);
+        keyframe_only_ = true;
+        good_reports_ = 0;
+    }
+    else if (measured && keyframe_only_)
+    {
+        good_reports_ = loss <= kKeyframeOnlyLeaveLoss ? good_reports_ + 1 : 0;
+        if (good_reports_ >= kKeyframeOnlyLeaveReports)
+        {
+            LOG_INFO("{} session {} video loss {:.1f}%, resume all frames", stream_id_, session_id_, loss * 100);
+            keyframe_only_ = false;
+        }
+    }
+    quality_.keyframe_only = keyframe_only_;
+    rtcp_feedback::publish(quality_);
 }
@@ -13,6 +13,9 @@
 #include "rtsp_track.h"
 #include "sink.h"
 #include "tcp_connection.h"
+#include "udp_transport.h"
+#include "rtsp_multicast.h"
+#include "rtcp_feedback.h"
 
 namespace simple_rtmp
 {
@@ -28,6 +31,8 @@ class rtsp_forward_session : public std::enable_shared_from_this<rtsp_forward_se
     void start();
     void shutdown();
     boost::asio::ip::tcp::socket& socket();
+    // 在启动服务之前设置，之后新建的 tcp 交织播放连接使用
+    static void set_write_queue_option(const write_queue_option& op);
 
    private:
     void startup();
@@ -35,31 +40,66 @@ class rtsp_forward_session : public std::enable_shared_from_this<rtsp_forward_se
     void on_write(const boost::system::error_code& ec, std::size_t bytes);
     void channel_out(const frame_buffer::ptr& frame, const boost::system::error_code& ec);
     void safe_shutdown();
-    void send_video_rtcp(const frame_buffer::ptr& frame);
-    void send_audio_rtcp(const frame_buffer::ptr& frame);
+    struct rtcp_sender
+    {
+        uint64_t task = 0;         // rtcp_scheduler 里的 id
+        rtp_sender_stats base;    // 开始播放时流的统计减去当时已经丢掉的包
+        rtcp_feedback feedback;   // 播放端对这个 track 的接收报告
+        // 只发关键帧跳过的和写队列超过水位丢掉的包，发送报告里不算，channel_out 和连接的线程上累加
+        std::atomic<uint64_t> dropped_packets{0};
+        std::atomic<uint64_t> dropped_octets{0};
+    };
+    // rtcp_scheduler 定时调用，用流的统计生成发送报告
+    bool send_report(rtcp_sender* sender, const rtsp_track::ptr& track, int rtcp_channel);
+    static void reset_report_base(rtcp_sender* sender, const rtsp_track::ptr& track);
+    static void count_dropped(rtcp_sender* sender, const frame_buffer::ptr& frame);
+    void on_drop(const frame_buffer::ptr& frame);
+    void start_rtcp();
+    void stop_rtcp();
+    void send_udp(int rtp_channel, const frame_buffer::ptr& frame);
+    // 收到接收报告后更新播放质量，视频丢包严重时切到只发关键帧
+    void on_receiver_report(const rtcp_report_block& rb);
+    bool deliver_video(const frame_buffer::ptr& frame);
+    int setup_udp(rtsp_transport* transport, int rtp_channel, int rtcp_channel);
+    int setup_multicast(const std::string& url, const rtsp_track::ptr& track, int rtp_channel);
+    void on_multicast_setup(int seq, int rtp_channel, const rtsp_track::ptr& track, int ret, const multicast_group& group);
+    void leave_multicast();
    private:
     int on_options(const std::string& url);
     int on_describe(const std::string& url);
     int on_setup(const std::string& url, const std::string& session, rtsp_transport* transport);
     int on_play(const std::string& url, const std::string& session);
     int on_teardown(const std::string& url, const std::string& session);
-    void on_track(const std::string& url, std::vector<rtsp_track::ptr> track);
+    int on_parameter(const std::string& url, const std::string& session);
+    void on_track(const std::string& url, std::vector<rtsp_track::ptr> track, const std::shared_ptr<const std::string>& media);
+    const std::string& local_ip();
     int on_rtcp(int channel, const simple_rtmp::frame_buffer::ptr& frame);
 
    private:
     std::string stream_id_;
     std::string session_id_;
+    std::string local_ip_;
     sink::weak sink_;
     channel::ptr channel_ = nullptr;
     std::map<std::string, rtsp_track::ptr> tracks_;
     rtsp_track::ptr audio_track_ = nullptr;
     rtsp_track::ptr video_track_ = nullptr;
-    void* video_rtcp_ctx_ = nullptr;
-    void* audio_rtcp_ctx_ = nullptr;
-    uint64_t video_rtcp_time_ = 0;
-    uint64_t audio_rtcp_time_ = 0;
-    simple_rtmp::executors::executor& ex_;
+    rtcp_sender video_rtcp_;
+    rtcp_sender audio_rtcp_;
+    simple_rtmp::executors::executor* ex_;
     std::shared_ptr<tcp_connection> conn_;
+    // udp 播放时客户端的地址，按交织通道号存放，端口为 0 的通道走 tcp
+    udp_transport* udp_ = nullptr;
+    boost::asio::ip::udp::endpoint udp_peers_[4];
+    // 组播的 track 由 sink 统一发送，按 rtp 通道号标记
+    bool multicast_[4] = {false, false, false, false};
+    viewer_quality quality_;
+    // rtcp 在会话的线程上修改，channel_out 可能在 sink 的线程上读
+    std::atomic<bool> keyframe_only_{false};
+    int good_reports_ = 0;
+    // 只在 channel_out 里使用
+    bool skipping_ = false;
+    bool last_keyframe_ = false;
     std::vector<frame_buffer::ptr> write_queue_;
     std::vector<frame_buffer::ptr> writing_queue_;
     std::shared_ptr<struct rtsp_forward_args> args_;
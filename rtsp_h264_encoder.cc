@@ -13,8 +13,6 @@ using simple_rtmp::rtsp_h264_encoder;
 
 static const auto kHz = 90;    // 90KHz
 
-static void* rtp_alloc(void* param, int bytes);
-static void rtp_free(void* param, void* packet);
 static const uint8_t* h264_startcode(const uint8_t* data, size_t bytes);
 
 rtsp_h264_encoder::rtsp_h264_encoder(std::string id) : id_(std::move(id))
@@ -35,14 +33,20 @@ simple_rtmp::rtsp_track::ptr rtsp_h264_encoder::track()
     return track_;
 }
 
-int rtsp_h264_encoder::rtp_encode_packet(void* param, const void* packet, int bytes, uint32_t timestamp, int flags)
+int rtsp_h264_encoder::rtp_encode_packet(void* param, const void* packet, int bytes, uint32_t timestamp, int /*flags*/)
 {
     auto* self = static_cast<rtsp_h264_encoder*>(param);
-    auto frame = fixed_frame_buffer::create(packet, bytes);
+    // 打包器直接写在 rtp_alloc 分配的池化块里，补上交织头就是所有播放者共用的帧
+    auto frame = self->allocator_.packet(packet, bytes);
+    if (bytes > static_cast<int>(kRtpHeaderSize))
+    {
+        self->track_->on_packet(bytes - kRtpHeaderSize, timestamp, self->clock_);
+    }
     frame->set_pts(timestamp);
     frame->set_dts(timestamp);
     frame->set_media(simple_rtmp::rtmp_tag::video);
-    frame->set_flag(flags);
+    // 关键帧的每个包都带标记，播放端丢包严重时只发这些包
+    frame->set_flag(self->keyframe_ ? 1 : 0);
     self->ch_->write(frame, {});
     return 0;
 }
@@ -114,6 +118,8 @@ void rtsp_h264_encoder::write(const frame_buffer::ptr& frame, const boost::syste
     {
         return;
     }
+    clock_ = rtp_wall_clock();
+    keyframe_ = frame->flag() == 1;
     rtp_payload_encode_input(ctx_, frame->data(), static_cast<int>(frame->size()), frame->pts() * kHz);
 }
 
@@ -131,12 +137,12 @@ static const uint8_t* h264_startcode(const uint8_t* data, size_t bytes)
     return nullptr;
 }
 
-static void* rtp_alloc(void* /*param*/, int bytes)
+void* rtsp_h264_encoder::rtp_alloc(void* param, int bytes)
 {
-    return malloc(bytes);
+    return static_cast<rtsp_h264_encoder*>(param)->allocator_.alloc(bytes);
 }
 
-static void rtp_free(void* /*param*/, void* packet)
+void rtsp_h264_encoder::rtp_free(void* param, void* packet)
 {
-    free(packet);
+    static_cast<rtsp_h264_encoder*>(param)->allocator_.free(packet);
 }
@@ -5,6 +5,7 @@
 #include <memory>
 #include <vector>
 #include "rtsp_encoder.h"
+#include "rtsp_packet_allocator.h"
 #include "rtsp_h264_track.h"
 
 namespace simple_rtmp
@@ -26,6 +27,8 @@ class rtsp_h264_encoder : public rtsp_encoder
 
    private:
     static int rtp_encode_packet(void* param, const void* packet, int bytes, uint32_t timestamp, int /*flags*/);
+    static void* rtp_alloc(void* param, int bytes);
+    static void rtp_free(void* param, void* packet);
 
    private:
     std::string id_;
@@ -34,6 +37,10 @@ class rtsp_h264_encoder : public rtsp_encoder
     frame_buffer::ptr pps_;
     rtsp_track::ptr track_;
     void* ctx_ = nullptr;
+    // 当前帧开始打包时的 rtp_wall_clock()，这一帧的包共用
+    uint64_t clock_ = 0;
+    bool keyframe_ = false;
+    rtsp_packet_allocator allocator_{kRtpVideoChannel};
 };
 }    // namespace simple_rtmp
 #endif
@@ -8,9 +8,9 @@ std::string simple_rtmp::rtsp_h264_track::id() const
 {
     return kRtspVideoTrackId;
 }
-std::string simple_rtmp::rtsp_h264_track::sdp() const
+const std::string& simple_rtmp::rtsp_h264_track::sdp() const
 {
-    return ss_.str();
+    return sdp_;
 }
 uint32_t simple_rtmp::rtsp_h264_track::ssrc() const
 {
@@ -23,10 +23,11 @@ int32_t rtsp_h264_track::sample_rate() const
 
 rtsp_h264_track::rtsp_h264_track(const frame_buffer::ptr &sps, const frame_buffer::ptr &pps)
 {
-    ss_ << "m=video 0 RTP/AVP 96\r\n";
-    ss_ << "c=IN IP4 0.0.0.0\n";
-    ss_ << "a=rtpmap:96 H264/90000\r\n";
-    ss_ << "a=fmtp:96 packetization-mode=1; profile-level-id=";
+    std::stringstream ss;
+    ss << "m=video 0 RTP/AVP 96\r\n";
+    ss << "c=IN IP4 0.0.0.0\n";
+    ss << "a=rtpmap:96 H264/90000\r\n";
+    ss << "a=fmtp:96 packetization-mode=1; profile-level-id=";
     uint32_t profile_level_id = 0;
     const uint8_t *sps_data = sps->data();
     if (sps->size() >= 4)
@@ -36,8 +37,9 @@ rtsp_h264_track::rtsp_h264_track(const frame_buffer::ptr &sps, const frame_buffe
 
     char profile[32] = {0};
     snprintf(profile, sizeof(profile), "%06X", profile_level_id);
-    ss_ << profile << "; sprop-parameter-sets=";
-    ss_ << base64_encode(sps->data(), sps->size()) << "," << base64_encode(pps->data(), pps->size()) << "\r\n";
-    ss_ << "a=control:" << kRtspVideoTrackId << "\r\n";
+    ss << profile << "; sprop-parameter-sets=";
+    ss << base64_encode(sps->data(), sps->size()) << "," << base64_encode(pps->data(), pps->size()) << "\r\n";
+    ss << "a=control:" << kRtspVideoTrackId << "\r\n";
+    sdp_ = ss.str();
     ssrc_ = rtsp_track::video_ssrc();
 }
@@ -9,9 +9,9 @@ std::string simple_rtmp::rtsp_hevc_track::id() const
 {
     return kRtspVideoTrackId;
 }
-std::string simple_rtmp::rtsp_hevc_track::sdp() const
+const std::string& simple_rtmp::rtsp_hevc_track::sdp() const
 {
-    return ss_.str();
+    return sdp_;
 }
 uint32_t simple_rtmp::rtsp_hevc_track::ssrc() const
 {
@@ -24,13 +24,15 @@ int32_t rtsp_hevc_track::sample_rate() const
 
 rtsp_hevc_track::rtsp_hevc_track(const frame_buffer::ptr &vps, const frame_buffer::ptr &sps, const frame_buffer::ptr &pps)
 {
-    ss_ << "m=video 0 RTP/AVP 96\r\n";
-    ss_ << "c=IN IP4 0.0.0.0\n";
-    ss_ << "a=rtpmap:96 H265/90000\r\n";
-    ss_ << "a=fmtp:96 ";
-    ss_ << "sprop-vps=" << base64_encode(vps->data(), vps->size()) << "; ";
-    ss_ << "sprop-sps=" << base64_encode(sps->data(), sps->size()) << "; ";
-    ss_ << "sprop-pps=" << base64_encode(pps->data(), pps->size()) << "\r\n";
-    ss_ << "a=control:" << kRtspVideoTrackId << "\r\n";
+    std::stringstream ss;
+    ss << "m=video 0 RTP/AVP 96\r\n";
+    ss << "c=IN IP4 0.0.0.0\n";
+    ss << "a=rtpmap:96 H265/90000\r\n";
+    ss << "a=fmtp:96 ";
+    ss << "sprop-vps=" << base64_encode(vps->data(), vps->size()) << "; ";
+    ss << "sprop-sps=" << base64_encode(sps->data(), sps->size()) << "; ";
+    ss << "sprop-pps=" << base64_encode(pps->data(), pps->size()) << "\r\n";
+    ss << "a=control:" << kRtspVideoTrackId << "\r\n";
+    sdp_ = ss.str();
     ssrc_ = rtsp_track::video_ssrc();
 }
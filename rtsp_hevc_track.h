@@ -18,7 +18,7 @@ class rtsp_hevc_track : public rtsp_track
     ~rtsp_hevc_track() override = default;
 
    public:
-    std::string sdp() const override;
+    const std::string& sdp() const override;
     uint32_t ssrc() const override;
     std::string id() const override;
     int32_t sample_rate() const override;
@@ -26,7 +26,8 @@ class rtsp_hevc_track : public rtsp_track
    private:
     int32_t sample_rate_ = 0;
     uint32_t ssrc_ = 0;
-    std::stringstream ss_;
+    // 构造时生成，之后不变
+    std::string sdp_;
 };
 
 }    // namespace simple_rtmp
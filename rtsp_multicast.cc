@@ -0,0 +1,235 @@
+#include <atomic>
+#include <mutex>
+#include <set>
+#include "rtsp_multicast.h"
+#include "rtcp_scheduler.h"
+#include "rtcp_feedback.h"
+#include "log.h"
+
+using simple_rtmp::rtsp_multicast;
+
+static std::mutex option_mutex;
+static simple_rtmp::multicast_option option;
+// 正在使用的地址序号
+static std::set<uint32_t> allocated;
+static uint32_t next_index = 0;
+
+static std::atomic<uint64_t> multicast_groups{0};
+static std::atomic<uint64_t> multicast_viewers{0};
+static std::atomic<uint64_t> multicast_packets{0};
+static std::atomic<uint64_t> multicast_bytes{0};
+static std::atomic<uint64_t> multicast_dropped{0};
+
+static const int kSendBufferSize = 4 * 1024 * 1024;
+
+void rtsp_multicast::set_option(const multicast_option& op)
+{
+    std::lock_guard<std::mutex> lock(option_mutex);
+    option = op;
+}
+
+simple_rtmp::multicast_stats rtsp_multicast::stats()
+{
+    multicast_stats s;
+    s.groups = multicast_groups.load(std::memory_order_relaxed);
+    s.viewers = multicast_viewers.load(std::memory_order_relaxed);
+    s.packets = multicast_packets.load(std::memory_order_relaxed);
+    s.bytes = multicast_bytes.load(std::memory_order_relaxed);
+    s.dropped = multicast_dropped.load(std::memory_order_relaxed);
+    return s;
+}
+
+rtsp_multicast::ptr rtsp_multicast::create(boost::asio::io_context& io, const rtsp_track::ptr& track)
+{
+    if (track == nullptr)
+    {
+        return nullptr;
+    }
+    uint32_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(option_mutex);
+        if (option.address_count == 0 || allocated.size() >= option.address_count)
+        {
+            LOG_ERROR("multicast address exhausted {} {}", option.address, option.address_count);
+            return nullptr;
+        }
+        while (allocated.count(next_index % option.address_count) != 0)
+        {
+            next_index++;
+        }
+        index = next_index++ % option.address_count;
+        allocated.insert(index);
+    }
+    ptr m(new rtsp_multicast(io, track));
+    m->index_ = index;
+    m->allocated_ = true;
+    if (!m->open(index))
+    {
+        return nullptr;
+    }
+    m->rtcp_base_ = track->sender_stats();
+    std::weak_ptr<rtsp_multicast> weak = m;
+    m->rtcp_task_ = rtcp_scheduler::local(io)->add(
+        [weak]()
+        {
+            auto self = weak.lock();
+            return self != nullptr && self->send_report();
+        });
+    return m;
+}
+
+rtsp_multicast::rtsp_multicast(boost::asio::io_context& io, rtsp_track::ptr track) : io_(io), socket_(io), track_(std::move(track))
+{
+}
+
+rtsp_multicast::~rtsp_multicast()
+{
+    if (rtcp_task_ != 0)
+    {
+        // sink 可能在别的线程析构，调度器只能在自己的线程上操作
+        uint64_t const task = rtcp_task_;
+        auto* io = &io_;
+        boost::asio::post(io_, [io, task]() { rtcp_scheduler::local(*io)->del(task); });
+    }
+    if (socket_.is_open())
+    {
+        boost::system::error_code ec;
+        socket_.close(ec);
+        multicast_groups.fetch_sub(1, std::memory_order_relaxed);
+        LOG_INFO("multicast close {}:{}", group_.address, group_.port);
+    }
+    multicast_viewers.fetch_sub(viewers_, std::memory_order_relaxed);
+    if (allocated_)
+    {
+        std::lock_guard<std::mutex> lock(option_mutex);
+        allocated.erase(index_);
+    }
+}
+
+bool rtsp_multicast::open(uint32_t index)
+{
+    multicast_option op;
+    {
+        std::lock_guard<std::mutex> lock(option_mutex);
+        op = option;
+    }
+    boost::system::error_code ec;
+    auto base = boost::asio::ip::make_address_v4(op.address, ec);
+    if (ec || !base.is_multicast())
+    {
+        LOG_ERROR("multicast invalid address {}", op.address);
+        return false;
+    }
+    auto address = boost::asio::ip::address_v4(base.to_uint() + index);
+    group_.address = address.to_string();
+    group_.port = op.port;
+    group_.ttl = op.ttl;
+    rtp_ep_ = boost::asio::ip::udp::endpoint(address, op.port);
+    rtcp_ep_ = boost::asio::ip::udp::endpoint(address, op.port + 1);
+
+    socket_.open(boost::asio::ip::udp::v4(), ec);
+    if (ec)
+    {
+        LOG_ERROR("multicast open {} failed {}", group_.address, ec.message());
+        return false;
+    }
+    multicast_groups.fetch_add(1, std::memory_order_relaxed);
+    socket_.set_option(boost::asio::ip::multicast::hops(op.ttl), ec);
+    if (!ec)
+    {
+        // 本机的解码器也要能收到
+        socket_.set_option(boost::asio::ip::multicast::enable_loopback(true), ec);
+    }
+    if (!ec && !op.interface.empty())
+    {
+        auto local = boost::asio::ip::make_address_v4(op.interface, ec);
+        if (!ec)
+        {
+            socket_.set_option(boost::asio::ip::multicast::outbound_interface(local), ec);
+        }
+    }
+    if (ec)
+    {
+        LOG_ERROR("multicast {} set option failed {}", group_.address, ec.message());
+        return false;
+    }
+    socket_.non_blocking(true, ec);
+    socket_.set_option(boost::asio::socket_base::send_buffer_size(kSendBufferSize), ec);
+    LOG_INFO("multicast open {}:{} ttl {} track {}", group_.address, group_.port, group_.ttl, track_->id());
+    return true;
+}
+
+const simple_rtmp::multicast_group& rtsp_multicast::group() const
+{
+    return group_;
+}
+
+void rtsp_multicast::add_viewer()
+{
+    viewers_++;
+    multicast_viewers.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::size_t rtsp_multicast::del_viewer()
+{
+    if (viewers_ > 0)
+    {
+        viewers_--;
+        multicast_viewers.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return viewers_;
+}
+
+void rtsp_multicast::send(const frame_buffer::ptr& frame)
+{
+    if (frame->size() <= kRtspInterleavedHeaderSize)
+    {
+        return;
+    }
+    std::size_t const bytes = frame->size() - kRtspInterleavedHeaderSize;
+    if (!send_to(rtp_ep_, frame->data() + kRtspInterleavedHeaderSize, bytes) && bytes > kRtpHeaderSize)
+    {
+        dropped_packets_.fetch_add(1, std::memory_order_relaxed);
+        dropped_octets_.fetch_add(bytes - kRtpHeaderSize, std::memory_order_relaxed);
+    }
+}
+
+bool rtsp_multicast::send_report()
+{
+    // 包数和字节数去掉发送失败的包
+    auto stats = track_->sender_stats();
+    rtcp_sender_info info;
+    info.ssrc = track_->ssrc();
+    info.packets = static_cast<uint32_t>(stats.packets - rtcp_base_.packets - dropped_packets_.load(std::memory_order_relaxed));
+    info.octets = static_cast<uint32_t>(stats.octets - rtcp_base_.octets - dropped_octets_.load(std::memory_order_relaxed));
+    if (stats.clock == 0 || info.packets == 0)
+    {
+        return false;
+    }
+    info.clock = rtp_wall_clock();
+    uint64_t const elapsed = info.clock > stats.clock ? info.clock - stats.clock : 0;
+    info.rtp_timestamp = stats.timestamp + static_cast<uint32_t>(elapsed * static_cast<uint64_t>(track_->sample_rate()) / 1000000);
+    uint8_t buffer[128];
+    std::size_t n = write_sender_report(info, "SimpleRtsp", buffer, sizeof(buffer));
+    send_to(rtcp_ep_, buffer, n);
+    return true;
+}
+
+bool rtsp_multicast::send_to(const boost::asio::ip::udp::endpoint& to, const uint8_t* data, std::size_t bytes)
+{
+    boost::system::error_code ec;
+    bytes = socket_.send_to(boost::asio::buffer(data, bytes), to, 0, ec);
+    if (ec)
+    {
+        // 组播没有重传，缓冲满时直接丢
+        if (ec != boost::asio::error::would_block)
+        {
+            LOG_DEBUG("multicast {} send failed {}", group_.address, ec.message());
+        }
+        multicast_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    multicast_packets.fetch_add(1, std::memory_order_relaxed);
+    multicast_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    return true;
+}
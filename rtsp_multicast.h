@@ -0,0 +1,93 @@
+#ifndef SIMPLE_RTMP_RTSP_MULTICAST_H
+#define SIMPLE_RTMP_RTSP_MULTICAST_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include "frame_buffer.h"
+#include "rtsp_track.h"
+
+namespace simple_rtmp
+{
+struct multicast_option
+{
+    std::string address = "239.255.42.1";    // 第一个组播地址，之后的地址依次分给各个 track
+    uint32_t address_count = 254;            //
+    uint16_t port = 40000;                   // rtp 端口，rtcp 端口加 1
+    int ttl = 16;                            //
+    std::string interface;                   // 发送用的本地地址，空时按路由选择，本机测试用 127.0.0.1
+};
+
+struct multicast_group
+{
+    std::string address;
+    uint16_t port = 0;
+    int ttl = 0;
+};
+
+struct multicast_stats
+{
+    uint64_t groups = 0;     // 当前打开的组
+    uint64_t viewers = 0;    // 当前的组播播放者
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped = 0;    // 发送缓冲满丢掉的包
+};
+
+// 一个 track 的组播发送端，由 rtsp_sink 在第一个组播播放者 SETUP 时创建，最后一个离开时关闭
+// 每个 rtp 包只发一次，和播放者数量无关，rtcp 发送报告由 rtcp_scheduler 定时发到 port + 1
+// 只能在 sink 所在的 executor 上使用
+class rtsp_multicast
+{
+   public:
+    using ptr = std::shared_ptr<rtsp_multicast>;
+
+   public:
+    ~rtsp_multicast();
+    rtsp_multicast(const rtsp_multicast&) = delete;
+    rtsp_multicast& operator=(const rtsp_multicast&) = delete;
+
+   public:
+    // 在创建 sink 之前设置
+    static void set_option(const multicast_option& op);
+    static multicast_stats stats();
+    // 分配组播地址并打开 socket，地址用完或者打开失败返回 nullptr
+    static ptr create(boost::asio::io_context& io, const rtsp_track::ptr& track);
+
+   public:
+    const multicast_group& group() const;
+    // frame 带交织头，发送时跳过
+    void send(const frame_buffer::ptr& frame);
+    void add_viewer();
+    // return 剩余的播放者数
+    std::size_t del_viewer();
+
+   private:
+    rtsp_multicast(boost::asio::io_context& io, rtsp_track::ptr track);
+    bool open(uint32_t index);
+    bool send_report();
+    // return 是否发出去了
+    bool send_to(const boost::asio::ip::udp::endpoint& to, const uint8_t* data, std::size_t bytes);
+
+   private:
+    boost::asio::io_context& io_;
+    boost::asio::ip::udp::socket socket_;
+    rtsp_track::ptr track_;
+    uint32_t index_ = 0;
+    bool allocated_ = false;
+    multicast_group group_;
+    boost::asio::ip::udp::endpoint rtp_ep_;
+    boost::asio::ip::udp::endpoint rtcp_ep_;
+    std::size_t viewers_ = 0;
+    uint64_t rtcp_task_ = 0;
+    rtp_sender_stats rtcp_base_;
+    // 发送失败的 rtp 包，发送报告里不算，send 的线程上累加
+    std::atomic<uint64_t> dropped_packets_{0};
+    std::atomic<uint64_t> dropped_octets_{0};
+};
+
+}    // namespace simple_rtmp
+
+#endif
@@ -0,0 +1,51 @@
+#include "rtsp_packet_allocator.h"
+#include "rtsp_track.h"
+
+using simple_rtmp::rtsp_packet_allocator;
+
+rtsp_packet_allocator::rtsp_packet_allocator(int channel) : channel_(channel)
+{
+}
+
+void* rtsp_packet_allocator::alloc(int bytes)
+{
+    if (bytes <= 0)
+    {
+        return nullptr;
+    }
+    auto frame = pooled_frame_buffer::create(kRtspInterleavedHeaderSize + bytes);
+    frame->resize(kRtspInterleavedHeaderSize + bytes);
+    outstanding_.push_back(frame);
+    return frame->data() + kRtspInterleavedHeaderSize;
+}
+
+void rtsp_packet_allocator::free(void* packet)
+{
+    for (auto it = outstanding_.begin(); it != outstanding_.end(); ++it)
+    {
+        if ((*it)->data() + kRtspInterleavedHeaderSize == packet)
+        {
+            outstanding_.erase(it);
+            return;
+        }
+    }
+}
+
+simple_rtmp::frame_buffer::ptr rtsp_packet_allocator::packet(const void* packet, int bytes)
+{
+    for (const auto& frame : outstanding_)
+    {
+        if (frame->data() + kRtspInterleavedHeaderSize != packet)
+        {
+            continue;
+        }
+        uint8_t* header = frame->data();
+        header[0] = '$';
+        header[1] = static_cast<uint8_t>(channel_);
+        header[2] = static_cast<uint8_t>((bytes >> 8) & 0xFF);
+        header[3] = static_cast<uint8_t>(bytes & 0xFF);
+        frame->resize(kRtspInterleavedHeaderSize + bytes);
+        return frame;
+    }
+    return make_interleaved_packet(channel_, packet, bytes);
+}
@@ -0,0 +1,32 @@
+#ifndef SIMPLE_RTMP_RTSP_PACKET_ALLOCATOR_H
+#define SIMPLE_RTMP_RTSP_PACKET_ALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "frame_buffer.h"
+
+namespace simple_rtmp
+{
+// rtp_payload_t 的 alloc/free，打包器直接写进池化块，前面留出交织头的位置
+// 包写完后补上交织头就是要发送的帧，不再 malloc 和复制
+class rtsp_packet_allocator
+{
+   public:
+    explicit rtsp_packet_allocator(int channel);
+
+   public:
+    void* alloc(int bytes);
+    // 只释放分配器持有的引用，帧可能还在发送队列里
+    void free(void* packet);
+    // packet 不是 alloc 出来的时候复制一份
+    frame_buffer::ptr packet(const void* packet, int bytes);
+
+   private:
+    int channel_;
+    // 已经分配出去还没 free 的块，打包器一般同时只有一个
+    std::vector<pooled_frame_buffer::ptr> outstanding_;
+};
+
+}    // namespace simple_rtmp
+
+#endif
@@ -13,7 +13,7 @@ static const int kRtcpPrefixLength = 4;
 
 rtsp_server_context::rtsp_server_context(rtsp_server_context_handler handler) : handler_(std::move(handler))
 {
-    cache_ = fixed_frame_buffer::create();
+    cache_ = pooled_frame_buffer::create();
 }
 
 int rtsp_server_context::input(const simple_rtmp::frame_buffer::ptr& frame)
@@ -122,6 +122,10 @@ void rtsp_server_context::process_request(const simple_rtmp::rtsp_parser& parser
     {
         teardown_request(parser);
     }
+    else if (method == "GET_PARAMETER" || method == "SET_PARAMETER")
+    {
+        parameter_request(parser);
+    }
 }
 
 void rtsp_server_context::options_request(const simple_rtmp::rtsp_parser& parser)
@@ -213,3 +217,13 @@ void rtsp_server_context::teardown_request(const simple_rtmp::rtsp_parser& parse
     std::string s = parser.header("Session");
     handler_.on_teardown(parser.url(), s);
 }
+
+void rtsp_server_context::parameter_request(const simple_rtmp::rtsp_parser& parser)
+{
+    if (!handler_.on_parameter)
+    {
+        return;
+    }
+    std::string s = parser.header("Session");
+    handler_.on_parameter(parser.url(), s);
+}
@@ -26,6 +26,8 @@ struct rtsp_server_context_handler
     std::function<int(const std::string& url, const std::string& session)> on_play;
     std::function<int(int channel, const simple_rtmp::frame_buffer::ptr& frame)> on_rtcp;
     std::function<int(const std::string& url, const std::string& session)> on_teardown;
+    // GET_PARAMETER 和 SET_PARAMETER，客户端一般用来保活
+    std::function<int(const std::string& url, const std::string& session)> on_parameter;
 };
 
 class rtsp_server_context
@@ -51,6 +53,7 @@ class rtsp_server_context
     void setup_request(const simple_rtmp::rtsp_parser& parser);
     void play_request(const simple_rtmp::rtsp_parser& parser);
     void teardown_request(const simple_rtmp::rtsp_parser& parser);
+    void parameter_request(const simple_rtmp::rtsp_parser& parser);
 
    private:
     int seq_ = -1;
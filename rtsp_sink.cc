@@ -69,6 +69,18 @@ void simple_rtmp::rtsp_sink::add_codec(int codec, codec_option op)
 }
 void rtsp_sink::on_frame(const frame_buffer::ptr& frame, const boost::system::error_code& ec)
 {
+    if (!ec)
+    {
+        // 组播每个包只发一次，单播的播放者各自发
+        if (video_multicast_ && frame->media() == simple_rtmp::rtmp_tag::video)
+        {
+            video_multicast_->send(frame);
+        }
+        else if (audio_multicast_ && frame->media() == simple_rtmp::rtmp_tag::audio)
+        {
+            audio_multicast_->send(frame);
+        }
+    }
     for (const auto& ch : chs_)
     {
         ch->write(frame, ec);
@@ -91,8 +103,57 @@ void simple_rtmp::rtsp_sink::tracks(const simple_rtmp::rtsp_sink::track_cb& cb)
                 {
                     tracks.push_back(audio_encoder_->track());
                 }
-
-                cb(tracks);
+                // 编码器拿到参数集后才有 track，换了 track 才重新拼
+                if (sdp_ == nullptr || tracks != sdp_tracks_)
+                {
+                    auto sdp = std::make_shared<std::string>();
+                    for (const auto& track : tracks)
+                    {
+                        if (track != nullptr)
+                        {
+                            sdp->append(track->sdp());
+                        }
+                    }
+                    sdp_tracks_ = tracks;
+                    sdp_ = sdp;
+                    LOG_DEBUG("{} rebuild sdp {} bytes", id_, sdp_->size());
+                }
+                cb(tracks, sdp_);
+            }
+        });
+}
+void simple_rtmp::rtsp_sink::join_multicast(int media, const multicast_cb& cb)
+{
+    auto self = shared_from_this();
+    ex_.post(
+        [this, self, media, cb]()
+        {
+            bool const video = media == simple_rtmp::rtmp_tag::video;
+            auto& encoder = video ? video_encoder_ : audio_encoder_;
+            auto& multicast = video ? video_multicast_ : audio_multicast_;
+            if (multicast == nullptr && encoder != nullptr)
+            {
+                multicast = rtsp_multicast::create(ex_, encoder->track());
+            }
+            if (multicast == nullptr)
+            {
+                cb(-1, multicast_group{});
+                return;
+            }
+            multicast->add_viewer();
+            cb(0, multicast->group());
+        });
+}
+void simple_rtmp::rtsp_sink::leave_multicast(int media)
+{
+    auto self = shared_from_this();
+    ex_.post(
+        [this, self, media]()
+        {
+            auto& multicast = media == simple_rtmp::rtmp_tag::video ? video_multicast_ : audio_multicast_;
+            if (multicast != nullptr && multicast->del_viewer() == 0)
+            {
+                multicast.reset();
             }
         });
 }
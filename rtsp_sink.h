@@ -13,6 +13,7 @@
 #include "execution.h"
 #include "rtsp_encoder.h"
 #include "rtsp_track.h"
+#include "rtsp_multicast.h"
 #include "rtmp_codec.h"
 
 namespace simple_rtmp
@@ -33,8 +34,14 @@ class rtsp_sink : public sink
     void on_frame(const frame_buffer::ptr& frame, const boost::system::error_code& ec);
 
    public:
-    using track_cb = std::function<void(std::vector<rtsp_track::ptr>)>;
+    // sdp 是所有 track 的媒体描述拼在一起，track 不变时所有 DESCRIBE 共用一份
+    using track_cb = std::function<void(std::vector<rtsp_track::ptr>, std::shared_ptr<const std::string> sdp)>;
     void tracks(const track_cb& cb);
+    // 组播播放者加入 track 的组，第一个加入时打开，ret 不为 0 表示失败，回调在 sink 的线程上执行
+    using multicast_cb = std::function<void(int ret, const multicast_group& group)>;
+    void join_multicast(int media, const multicast_cb& cb);
+    // 最后一个离开时关闭组，不再发送
+    void leave_multicast(int media);
 
    private:
     std::string id_;
@@ -42,6 +49,10 @@ class rtsp_sink : public sink
     std::set<channel::ptr> chs_;
     std::shared_ptr<rtsp_encoder> video_encoder_;
     std::shared_ptr<rtsp_encoder> audio_encoder_;
+    std::vector<rtsp_track::ptr> sdp_tracks_;
+    std::shared_ptr<const std::string> sdp_;
+    rtsp_multicast::ptr video_multicast_;
+    rtsp_multicast::ptr audio_multicast_;
 };
 }    // namespace simple_rtmp
 #endif
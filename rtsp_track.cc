@@ -1,4 +1,5 @@
 #include <atomic>
+#include <chrono>
 #include <boost/beast/core/detail/base64.hpp>
 #include "rtsp_track.h"
 
@@ -27,6 +28,39 @@ std::string base64_decode(const std::string& data)
     return dest;
 }
 
+frame_buffer::ptr make_interleaved_packet(int channel, const void* packet, std::size_t bytes)
+{
+    uint8_t header[kRtspInterleavedHeaderSize] = {'$', static_cast<uint8_t>(channel), static_cast<uint8_t>((bytes >> 8) & 0xFF), static_cast<uint8_t>(bytes & 0xFF)};
+    auto frame = pooled_frame_buffer::create(kRtspInterleavedHeaderSize + bytes);
+    frame->append(header, sizeof(header));
+    frame->append(packet, bytes);
+    return frame;
+}
+
+uint64_t rtp_wall_clock()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void rtsp_track::on_packet(std::size_t payload, uint32_t timestamp, uint64_t clock)
+{
+    // 只有编码器所在的线程写
+    packets_.store(packets_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    octets_.store(octets_.load(std::memory_order_relaxed) + payload, std::memory_order_relaxed);
+    timestamp_.store(timestamp, std::memory_order_relaxed);
+    clock_.store(clock, std::memory_order_release);
+}
+
+rtp_sender_stats rtsp_track::sender_stats() const
+{
+    rtp_sender_stats stats;
+    stats.clock = clock_.load(std::memory_order_acquire);
+    stats.timestamp = timestamp_.load(std::memory_order_relaxed);
+    stats.packets = packets_.load(std::memory_order_relaxed);
+    stats.octets = octets_.load(std::memory_order_relaxed);
+    return stats;
+}
+
 uint32_t rtsp_track::audio_ssrc()
 {
     static std::atomic<uint32_t> ssrc = 0xff1;
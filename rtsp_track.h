@@ -4,6 +4,8 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <atomic>
+#include "frame_buffer.h"
 
 namespace simple_rtmp
 {
@@ -13,9 +15,26 @@ static const int kRtpAudioChannel = 2;
 static const int kRtcpAudioChannel = 3;
 const static char kRtspVideoTrackId[] = "track1";
 const static char kRtspAudioTrackId[] = "track2";
+// tcp 交织头 '$' + 通道号 + 两字节长度
+static const std::size_t kRtspInterleavedHeaderSize = 4;
+// rtp 固定头，编码器不带 csrc 和扩展头
+static const std::size_t kRtpHeaderSize = 12;
 std::string base64_decode(const std::string& data);
 std::string base64_encode(const std::uint8_t* data, std::size_t len);
 std::string base64_encode(const std::string& s);
+// 交织头和 rtp/rtcp 包放在同一个池化块里，tcp 整块发送，udp 跳过前 kRtspInterleavedHeaderSize 字节
+frame_buffer::ptr make_interleaved_packet(int channel, const void* packet, std::size_t bytes);
+// 1970 年以来的微秒数，发送报告的 ntp 时间戳由它换算
+uint64_t rtp_wall_clock();
+
+// 流的发送统计，所有播放者共用，rtcp 发送报告从这里取
+struct rtp_sender_stats
+{
+    uint32_t packets = 0;
+    uint64_t octets = 0;       // 负载字节
+    uint32_t timestamp = 0;    // 最近一个包的 rtp 时间戳
+    uint64_t clock = 0;        // 这个包打包时的 rtp_wall_clock()
+};
 
 class rtsp_track
 {
@@ -29,9 +48,21 @@ class rtsp_track
 
    public:
     virtual int32_t sample_rate() const = 0;
-    virtual std::string sdp() const = 0;
+    virtual const std::string& sdp() const = 0;
     virtual uint32_t ssrc() const = 0;
     virtual std::string id() const = 0;
+
+   public:
+    // 编码器每输出一个包调用一次，clock 每帧只取一次
+    void on_packet(std::size_t payload, uint32_t timestamp, uint64_t clock);
+    // 可以在其他线程调用
+    rtp_sender_stats sender_stats() const;
+
+   private:
+    std::atomic<uint32_t> packets_{0};
+    std::atomic<uint64_t> octets_{0};
+    std::atomic<uint32_t> timestamp_{0};
+    std::atomic<uint64_t> clock_{0};
 };
 
 }    // namespace simple_rtmp
@@ -1,37 +1,168 @@
+#include <atomic>
 #include <mutex>
-#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "sink.h"
 #include "log.h"
 
 using simple_rtmp::sink;
 
-std::map<std::string, sink::ptr> sink::sinks_;
+using sink_map = std::unordered_map<std::string, sink::ptr>;
 
-std::mutex sink::sinks_mutex_;
+// 基于纪元的回收，读者不加锁也不碰共享的引用计数
+// 读之前把当前的全局纪元写进本线程的记录，读完清零；写者换下来的旧表记下换表时的纪元，
+// 所有正在读的记录的纪元都比它大之后才释放
+namespace
+{
+struct reader_record
+{
+    std::atomic<uint64_t> epoch{0};    // 0 表示不在读
+    std::atomic<bool> used{true};
+    reader_record* next = nullptr;
+};
+
+std::atomic<reader_record*> reader_records{nullptr};
+std::atomic<uint64_t> global_epoch{1};
+
+// 每个线程一个记录，只在线程第一次查找时挂到链表上，线程退出后留给新线程复用，不释放
+struct reader_holder
+{
+    reader_record* record = nullptr;
+    reader_holder()
+    {
+        for (reader_record* r = reader_records.load(std::memory_order_acquire); r != nullptr; r = r->next)
+        {
+            bool expected = false;
+            if (r->used.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+            {
+                record = r;
+                return;
+            }
+        }
+        record = new reader_record;
+        reader_record* head = reader_records.load(std::memory_order_relaxed);
+        do
+        {
+            record->next = head;
+        } while (!reader_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    }
+    ~reader_holder()
+    {
+        record->epoch.store(0, std::memory_order_release);
+        record->used.store(false, std::memory_order_release);
+    }
+};
+
+reader_record* local_reader()
+{
+    thread_local reader_holder holder;
+    return holder.record;
+}
+
+// 正在读的记录里最小的纪元，没有读者时返回最大值
+uint64_t min_reader_epoch()
+{
+    uint64_t min = UINT64_MAX;
+    for (reader_record* r = reader_records.load(std::memory_order_acquire); r != nullptr; r = r->next)
+    {
+        uint64_t const e = r->epoch.load(std::memory_order_seq_cst);
+        if (e != 0 && e < min)
+        {
+            min = e;
+        }
+    }
+    return min;
+}
+}    // namespace
+
+struct sink::shard
+{
+    std::atomic<const sink_map*> sinks{new sink_map()};
+    // 下面的只在写者之间互斥
+    std::mutex write_mutex;
+    std::vector<std::pair<const sink_map*, uint64_t>> retired;
+
+    ~shard()
+    {
+        delete sinks.load();
+        for (auto& r : retired)
+        {
+            delete r.first;
+        }
+    }
+    // 持有 write_mutex 时调用
+    void publish(const sink_map* next)
+    {
+        const sink_map* old = sinks.exchange(next, std::memory_order_seq_cst);
+        retired.emplace_back(old, global_epoch.fetch_add(1, std::memory_order_seq_cst));
+        uint64_t const min = min_reader_epoch();
+        auto it = retired.begin();
+        while (it != retired.end())
+        {
+            // 换表之前开始读的读者纪元不会大于换表时的纪元
+            if (it->second < min)
+            {
+                delete it->first;
+                it = retired.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+};
+
+sink::shard& sink::get_shard(const std::string& id)
+{
+    static shard shards[kShardCount];
+    return shards[std::hash<std::string>{}(id) % kShardCount];
+}
 
 sink::ptr sink::get(const std::string& id)
 {
-    std::lock_guard<std::mutex> const lock(sinks_mutex_);
-    auto it = sinks_.find(id);
-    if (it == sinks_.end())
+    shard& sh = get_shard(id);
+    reader_record* reader = local_reader();
+    reader->epoch.store(global_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+    const sink_map* sinks = sh.sinks.load(std::memory_order_seq_cst);
+    sink::ptr s;
+    auto it = sinks->find(id);
+    if (it != sinks->end())
+    {
+        s = it->second;
+    }
+    reader->epoch.store(0, std::memory_order_release);
+    if (s == nullptr)
     {
         LOG_DEBUG("not found sink {}", id);
         return nullptr;
     }
     LOG_DEBUG("found sink {}", id);
-    return it->second;
+    return s;
 }
 
 void sink::add(sink::ptr& s)
 {
-    std::lock_guard<std::mutex> const lock(sinks_mutex_);
+    shard& sh = get_shard(s->id());
+    std::lock_guard<std::mutex> const lock(sh.write_mutex);
     LOG_DEBUG("add sink {}", s->id());
-    sinks_[s->id()] = s;
+    auto* sinks = new sink_map(*sh.sinks.load(std::memory_order_acquire));
+    (*sinks)[s->id()] = s;
+    sh.publish(sinks);
 }
 
 void sink::del(const std::string& id)
 {
-    std::lock_guard<std::mutex> const lock(sinks_mutex_);
+    shard& sh = get_shard(id);
+    std::lock_guard<std::mutex> const lock(sh.write_mutex);
     LOG_DEBUG("del sink {}", id);
-    sinks_.erase(id);
+    const sink_map* current = sh.sinks.load(std::memory_order_acquire);
+    if (current->find(id) == current->end())
+    {
+        return;
+    }
+    auto* sinks = new sink_map(*current);
+    sinks->erase(id);
+    sh.publish(sinks);
 }
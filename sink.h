@@ -2,7 +2,6 @@
 #define SIMPLE_RTMP_SINK_H
 
 #include <memory>
-#include <map>
 #include <mutex>
 #include <string>
 #include "frame_buffer.h"
@@ -35,8 +34,12 @@ class sink : public std::enable_shared_from_this<sink>
     virtual void add_codec(int codec, codec_option op) = 0;
 
    private:
-    static std::map<std::string, sink::ptr> sinks_;
-    static std::mutex sinks_mutex_;
+    // 按 id 哈希分片，每个分片是一份只读的表
+    // 读只做几次原子读写，不加锁也不增加表的引用计数；写在分片内复制一份修改后原子替换，
+    // 旧表等换表前开始的读者都结束后再释放(sink.cpp 里基于纪元的回收)
+    static const std::size_t kShardCount = 64;
+    struct shard;
+    static shard& get_shard(const std::string& id);
 };
 
 }    // namespace simple_rtmp
@@ -1,5 +1,7 @@
 #include "socket.h"
 #include "log.h"
+#include "error.h"
+#include <netinet/tcp.h>
 
 namespace simple_rtmp
 {
@@ -170,4 +172,95 @@ boost::asio::ip::tcp::socket change_socket_io_context(boost::asio::ip::tcp::sock
     tmp.assign(boost::asio::ip::tcp::v4(), fd);
     return tmp;
 }
+
+socket_profile socket_profile::latency()
+{
+    socket_profile profile;
+    profile.nodelay = true;
+    profile.notsent_lowat = 128 * 1024;
+    return profile;
+}
+
+socket_profile socket_profile::throughput()
+{
+    socket_profile profile;
+    profile.sndbuf = 4 * 1024 * 1024;
+    return profile;
+}
+
+socket_profile socket_profile::with_keepalive(int idle, int interval, int count) const
+{
+    socket_profile profile = *this;
+    profile.keepalive_idle = idle;
+    profile.keepalive_interval = interval;
+    profile.keepalive_count = count;
+    return profile;
+}
+
+void apply_socket_profile(boost::asio::ip::tcp::socket& socket, const socket_profile& profile)
+{
+    int const fd = socket.native_handle();
+    if (profile.nodelay)
+    {
+        int one = 1;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1)
+        {
+            LOG_WARN("{} setsockopt nodelay error {}", get_socket_remote_address(socket), errno_to_str());
+        }
+    }
+    if (profile.notsent_lowat > 0)
+    {
+        int lowat = profile.notsent_lowat;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) == -1)
+        {
+            LOG_WARN("{} setsockopt notsent lowat error {}", get_socket_remote_address(socket), errno_to_str());
+        }
+    }
+    if (profile.sndbuf > 0)
+    {
+        int sndbuf = profile.sndbuf;
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == -1)
+        {
+            LOG_WARN("{} setsockopt sndbuf error {}", get_socket_remote_address(socket), errno_to_str());
+        }
+    }
+    if (profile.keepalive_idle > 0)
+    {
+        int one = 1;
+        int idle = profile.keepalive_idle;
+        int interval = profile.keepalive_interval;
+        int count = profile.keepalive_count;
+        if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one)) == -1 || setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) == -1 ||
+            (interval > 0 && setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) == -1) ||
+            (count > 0 && setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) == -1))
+        {
+            LOG_WARN("{} setsockopt keepalive error {}", get_socket_remote_address(socket), errno_to_str());
+        }
+    }
+}
+
+bool get_socket_nodelay(boost::asio::ip::tcp::socket& socket)
+{
+    int nodelay = 0;
+    socklen_t len = sizeof(nodelay);
+    if (getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_NODELAY, &nodelay, &len) == -1)
+    {
+        return false;
+    }
+    return nodelay != 0;
+}
+
+void set_socket_cork(boost::asio::ip::tcp::socket& socket, bool cork)
+{
+    int value = cork ? 1 : 0;
+    setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+}
+
+void set_socket_user_timeout(boost::asio::ip::tcp::socket& socket, unsigned int ms)
+{
+    if (setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_USER_TIMEOUT, &ms, sizeof(ms)) == -1)
+    {
+        LOG_WARN("{} setsockopt user timeout error {}", get_socket_remote_address(socket), errno_to_str());
+    }
+}
 }    // namespace simple_rtmp
@@ -28,6 +28,32 @@ uint16_t get_socket_remote_port(boost::asio::ip::udp::socket& socket);
 
 boost::asio::ip::tcp::socket change_socket_io_context(boost::asio::ip::tcp::socket sock, boost::asio::io_context& io);
 
+// 监听端口接收的连接使用的 socket 参数
+// 关掉 nagle 的连接在发送由多段组成的一批数据时会用 TCP_CORK 包起来，只在最后一段不满时发小包
+struct socket_profile
+{
+    bool nodelay = false;
+    int notsent_lowat = 0;    // TCP_NOTSENT_LOWAT，内核里未发送的数据不超过这个值，数据留在应用的队列里可以丢帧，0 不设置
+    int sndbuf = 0;           // SO_SNDBUF，0 使用系统默认
+    // SO_KEEPALIVE，空闲多少秒开始探测，每隔多少秒探测一次，连续多少次没有回应断开，idle 为 0 不打开
+    // 只发不收的播放连接在没有数据可发时发现不了对端掉线，靠它回收
+    int keepalive_idle = 0;
+    int keepalive_interval = 0;
+    int keepalive_count = 0;
+
+    // 播放端低延迟
+    static socket_profile latency();
+    // 大发送缓冲，适合带宽大、对延迟不敏感的拉流
+    static socket_profile throughput();
+    // 在这个参数的基础上打开 keepalive
+    socket_profile with_keepalive(int idle, int interval, int count) const;
+};
+void apply_socket_profile(boost::asio::ip::tcp::socket& socket, const socket_profile& profile);
+bool get_socket_nodelay(boost::asio::ip::tcp::socket& socket);
+void set_socket_cork(boost::asio::ip::tcp::socket& socket, bool cork);
+// 已发出的数据这么久没有确认时内核断开连接
+void set_socket_user_timeout(boost::asio::ip::tcp::socket& socket, unsigned int ms);
+
 }    // namespace simple_rtmp
 
 #endif
@@ -0,0 +1,18 @@
+#include "stream_affinity.h"
+
+using simple_rtmp::stream_affinity;
+
+void stream_affinity::set_executors(executors* exs)
+{
+    exs_ = exs;
+}
+
+simple_rtmp::executors::executor* stream_affinity::get_executor(const std::string& app, const std::string& stream)
+{
+    executors* exs = exs_.load();
+    if (exs == nullptr)
+    {
+        return nullptr;
+    }
+    return &exs->get_executor(app + "_" + stream);
+}
@@ -0,0 +1,29 @@
+#ifndef SIMPLE_RTMP_STREAM_AFFINITY_H
+#define SIMPLE_RTMP_STREAM_AFFINITY_H
+
+#include <string>
+#include <atomic>
+#include "execution.h"
+#include "singleton.h"
+
+namespace simple_rtmp
+{
+// 同一路流的发布者、sink 和所有播放者都放到同一个 executor 上
+// 分发时不用跨线程 post
+class stream_affinity
+{
+   public:
+    stream_affinity() = default;
+    ~stream_affinity() = default;
+
+   public:
+    void set_executors(executors* exs);
+    // 没有设置 executors 时返回 nullptr，调用方保持在当前 executor
+    executors::executor* get_executor(const std::string& app, const std::string& stream);
+
+   private:
+    std::atomic<executors*> exs_{nullptr};
+};
+using affinity = singleton<stream_affinity>;
+}    // namespace simple_rtmp
+#endif
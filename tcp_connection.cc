@@ -1,21 +1,82 @@
+#include <array>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <sys/socket.h>
 #include "tcp_connection.h"
 #include "socket.h"
 #include "log.h"
+#include "rtmp_codec.h"
+#include "timestamp.h"
+#include "io_uring_loop.h"
+#include "timer_wheel.h"
 
 using simple_rtmp::tcp_connection;
 using namespace std::placeholders;
-tcp_connection::tcp_connection(simple_rtmp::executors::executor& ex) : ex_(ex)
+
+static std::atomic<uint64_t> dropped_frames{0};
+static std::atomic<uint64_t> dropped_bytes{0};
+static std::atomic<uint64_t> overflow_disconnects{0};
+static std::atomic<uint64_t> write_batches{0};
+static std::atomic<uint64_t> total_queue_delay_ms{0};
+static std::atomic<uint64_t> max_queue_delay_ms{0};
+static std::atomic<uint64_t> live_connections{0};
+static std::atomic<uint64_t> read_size_bytes{0};
+static std::atomic<uint64_t> read_grows{0};
+static std::atomic<uint64_t> read_shrinks{0};
+static std::atomic<uint64_t> vectored_reads{0};
+static std::atomic<uint64_t> compacted_reads{0};
+// start 之后的连接，析构时删除，api 在锁里读连接的原子成员
+static std::mutex connections_mutex;
+static std::unordered_set<const tcp_connection*> connections_set;
+static std::atomic<simple_rtmp::io_backend> backend{simple_rtmp::io_backend::asio};
+static std::atomic<std::size_t> zerocopy_threshold{0};
+static std::atomic<uint64_t> zerocopy_sends{0};
+static std::atomic<uint64_t> zerocopy_copied{0};
+static std::atomic<uint64_t> zerocopy_fallbacks{0};
+static std::atomic<uint64_t> timeout_handshake{0};
+static std::atomic<uint64_t> timeout_idle{0};
+static std::atomic<uint64_t> timeout_keepalive{0};
+static std::atomic<uint64_t> timeout_write_stall{0};
+static std::atomic<uint64_t> timeout_reaped_bytes{0};
+static const std::size_t kMaxIov = 1024;
+// asio 的 async_write 一次 writev 最多带这么多个缓冲
+static const std::size_t kAsioMaxBuffers = 64;
+
+tcp_connection::tcp_connection(simple_rtmp::executors::executor& ex) : ex_(&ex), socket_(ex)
 {
+    live_connections.fetch_add(1, std::memory_order_relaxed);
+    read_size_bytes.fetch_add(read_size_, std::memory_order_relaxed);
     LOG_DEBUG("create {}", static_cast<void*>(this));
 }
 
-tcp_connection::tcp_connection(simple_rtmp::executors::executor& ex, boost::asio::ip::tcp::socket socket) : ex_(ex), socket_(std::move(socket))
+tcp_connection::tcp_connection(simple_rtmp::executors::executor& ex, boost::asio::ip::tcp::socket socket) : ex_(&ex), socket_(std::move(socket))
 {
+    live_connections.fetch_add(1, std::memory_order_relaxed);
+    read_size_bytes.fetch_add(read_size_, std::memory_order_relaxed);
     LOG_DEBUG("create {}", static_cast<void*>(this));
 }
 
 tcp_connection::~tcp_connection()
 {
+    {
+        std::lock_guard<std::mutex> const lock(connections_mutex);
+        connections_set.erase(this);
+    }
+    live_connections.fetch_sub(1, std::memory_order_relaxed);
+    read_size_bytes.fetch_sub(read_size_, std::memory_order_relaxed);
+    inbox_node* node = inbox_.exchange(nullptr);
+    while (node != nullptr)
+    {
+        inbox_node* next = node->next;
+        node->~inbox_node();
+        frame_pool::deallocate(node);
+        node = next;
+    }
     LOG_DEBUG("destroy {}", static_cast<void*>(this));
 }
 
@@ -28,18 +89,158 @@ void tcp_connection::start()
 {
     local_addr_ = get_socket_local_address(socket_);
     remote_addr_ = get_socket_remote_address(socket_);
+    cork_ = get_socket_nodelay(socket_);
+    {
+        std::lock_guard<std::mutex> const lock(connections_mutex);
+        connections_set.insert(this);
+    }
     LOG_DEBUG("start {} <--> {}", local_addr_, remote_addr_);
+    boost::asio::post(*ex_.load(), std::bind(&tcp_connection::safe_start_timeout, shared_from_this()));
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr)
+    {
+        safe_migrate();
+        return;
+    }
+    do_read();
+}
+
+bool tcp_connection::running_in_this_thread() const
+{
+    return ex_.load(std::memory_order_acquire)->get_executor().running_in_this_thread();
+}
+
+simple_rtmp::io_backend tcp_connection::set_io_backend(io_backend b)
+{
+    if (b == io_backend::io_uring && !io_uring_loop::available())
+    {
+        LOG_WARN("io_uring not available, use asio");
+        b = io_backend::asio;
+    }
+    backend = b;
+    return b;
+}
+
+void tcp_connection::set_zerocopy_threshold(std::size_t bytes)
+{
+    zerocopy_threshold = bytes;
+}
+
+simple_rtmp::io_uring_loop* tcp_connection::uring()
+{
+    if (backend.load(std::memory_order_relaxed) != io_backend::io_uring)
+    {
+        return nullptr;
+    }
+    if (uring_ == nullptr && socket_.is_open())
+    {
+        // fd 归 asio 管，不改它的标志；io_uring 的收发不看 O_NONBLOCK，没就绪时内核自己等
+        uring_ = io_uring_loop::local(*ex_.load());
+    }
+    return uring_;
+}
+
+void tcp_connection::migrate(simple_rtmp::executors::executor& ex)
+{
+    if (&ex == ex_.load())
+    {
+        return;
+    }
+    migrate_ex_.store(&ex, std::memory_order_release);
+    if (uring_recv_ != 0)
+    {
+        // 接收结束后在 on_uring_read 里迁移
+        uring_->cancel(uring_recv_);
+    }
+}
+
+void tcp_connection::safe_migrate()
+{
+    if (!writing_queue_.empty() || uring_recv_ != 0 || !zerocopy_pending_.empty())
+    {
+        // 等写完成后在 safe_on_write 里再迁移
+        return;
+    }
+    LOG_DEBUG("{} <--> {} migrate executor", local_addr_, remote_addr_);
+    // 时间轮是每个 executor 一个，到新的 executor 上重新添加
+    stop_timeout();
+    auto* target = migrate_ex_.load(std::memory_order_acquire);
+    socket_ = simple_rtmp::change_socket_io_context(std::move(socket_), *target);
+    uring_ = nullptr;
+    auto self = shared_from_this();
+    // 先清掉 migrate_ex_ 再发布 ex_，新线程看到 ex_ 时一定也看到迁移已经结束
+    // 发布之后连接归新线程所有，这里不能再碰任何成员
+    migrate_ex_.store(nullptr, std::memory_order_relaxed);
+    ex_.store(target, std::memory_order_release);
+    boost::asio::post(*target, std::bind(&tcp_connection::safe_start_io, self));
+}
+
+void tcp_connection::safe_start_io()
+{
+    safe_start_timeout();
+    safe_do_write();
     do_read();
 }
 
 void tcp_connection::shutdown()
 {
     LOG_DEBUG("shutdown {}", static_cast<void*>(this));
-    ex_.post(std::bind(&tcp_connection::safe_shutdown, shared_from_this()));
+    boost::asio::post(*ex_.load(), std::bind(&tcp_connection::safe_shutdown, shared_from_this()));
 }
 
 void tcp_connection::safe_shutdown()
 {
+    if (!running_in_this_thread())
+    {
+        // 投递后连接迁移了，转到新的 executor 上执行
+        shutdown();
+        return;
+    }
+    if (uring_ != nullptr)
+    {
+        if (uring_recv_ != 0)
+        {
+            uring_->cancel(uring_recv_);
+        }
+        // 攒着的请求要在 fd 关闭前提交，否则 fd 可能已经被别的连接复用
+        uring_->flush();
+    }
+    stop_timeout();
+    close_socket();
+    read_cb_ = nullptr;
+    write_cb_ = nullptr;
+    drop_cb_ = nullptr;
+    drain_inbox();
+    for (const auto& frame : write_queue_)
+    {
+        queued_bytes_.fetch_sub(frame->size(), std::memory_order_relaxed);
+    }
+    write_queue_.clear();
+}
+
+void tcp_connection::close_socket()
+{
+    if (!zerocopy_pending_.empty() || zerocopy_batch_sent_)
+    {
+        if (!zerocopy_closing_)
+        {
+            LOG_DEBUG("safe shutdown {} <--> {} wait {} zerocopy batches", local_addr_, remote_addr_, zerocopy_pending_.size());
+            zerocopy_closing_ = true;
+            set_socket_user_timeout(socket_, kZeroCopyCloseTimeoutMs);
+            ::shutdown(socket_.native_handle(), SHUT_RDWR);
+        }
+        if (zerocopy_close_task_ == 0)
+        {
+            auto self = shared_from_this();
+            auto task = [self]()
+            {
+                self->zerocopy_close_task_ = 0;
+                self->read_zerocopy_notifications();
+                self->close_socket();
+            };
+            zerocopy_close_task_ = timer_wheel::local(*ex_.load())->add_task(std::chrono::milliseconds(kZeroCopyClosePollMs), task);
+        }
+        return;
+    }
     if (socket_.is_open())
     {
         LOG_DEBUG("safe shutdown {} <--> {}", local_addr_, remote_addr_);
@@ -50,8 +251,6 @@ void tcp_connection::safe_shutdown()
     {
         LOG_DEBUG("safe shutdown {}", static_cast<void*>(this));
     }
-    read_cb_ = nullptr;
-    write_cb_ = nullptr;
 }
 
 void tcp_connection::set_read_cb(const read_cb& cb)
@@ -64,19 +263,200 @@ void tcp_connection::set_write_cb(const write_cb& cb)
     write_cb_ = cb;
 }
 
+void tcp_connection::set_drop_cb(const drop_cb& cb)
+{
+    drop_cb_ = cb;
+}
+
 void tcp_connection::do_read()
 {
-    socket_.async_read_some(boost::asio::buffer(buf_, kBufSize), std::bind(&tcp_connection::on_read, shared_from_this(), _1, _2));
+    if (uring() != nullptr)
+    {
+        uring_recv_ = uring_->recv(socket_.native_handle(), std::bind(&tcp_connection::on_uring_read, shared_from_this(), _1, _2, _3));
+        return;
+    }
+    // 等到可读再申请块，空闲的连接不占读缓冲
+    socket_.async_wait(boost::asio::ip::tcp::socket::wait_read, std::bind(&tcp_connection::on_readable, shared_from_this(), _1));
 }
 
-void tcp_connection::on_read(const boost::system::error_code& ec, std::size_t bytes)
+void tcp_connection::on_readable(const boost::system::error_code& ec)
 {
-    auto frame = fixed_frame_buffer::create();
-    if (!ec)
+    if (ec)
+    {
+        on_read(pooled_frame_buffer::create(), ec);
+        return;
+    }
+    // 上一个块可能还被解析出来的切片引用着，每次读都换新块
+    pooled_frame_buffer::ptr blocks[kMaxReadBlocks];
+    boost::system::error_code read_ec;
+    std::size_t bytes = read_blocks(blocks, read_ec);
+    if (read_ec == boost::asio::error::would_block || read_ec == boost::asio::error::try_again)
     {
-        frame->append(buf_, bytes);
+        do_read();
+        return;
     }
+    LOG_TRACE("{} <--> {} read {} bytes", local_addr_, remote_addr_, bytes);
+    for (auto& block : blocks)
+    {
+        if (block == nullptr || bytes == 0)
+        {
+            break;
+        }
+        std::size_t const n = std::min(bytes, block->size());
+        bytes -= n;
+        if (n * kReadCompactRatio < block->capacity())
+        {
+            compacted_reads.fetch_add(1, std::memory_order_relaxed);
+            on_read(pooled_frame_buffer::create(block->data(), n), {});
+            continue;
+        }
+        block->resize(n);
+        on_read(block, {});
+    }
+    if (read_ec)
+    {
+        on_read(pooled_frame_buffer::create(), read_ec);
+        return;
+    }
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr)
+    {
+        safe_migrate();
+        return;
+    }
+    do_read();
+}
+
+std::size_t tcp_connection::read_blocks(pooled_frame_buffer::ptr* blocks, boost::system::error_code& ec)
+{
+    if (!socket_.non_blocking())
+    {
+        socket_.non_blocking(true, ec);
+        if (ec)
+        {
+            return 0;
+        }
+    }
+    // 内核里积压的数据超过一个块时用 readv 一次读到多个块里
+    // 查询失败时按 read_size_ 读，socket 真出错时下面的读会报告
+    boost::system::error_code available_ec;
+    std::size_t available = socket_.available(available_ec);
+    if (available_ec)
+    {
+        LOG_DEBUG("{} <--> {} query available failed {}", local_addr_, remote_addr_, available_ec.message());
+        available = 0;
+    }
+    std::size_t want = std::max(read_size_, std::min(available, kMaxReadSize * kMaxReadBlocks));
+    std::size_t capacity = 0;
+    std::array<boost::asio::mutable_buffer, kMaxReadBlocks> bufs;
+    int count = 0;
+    while (want > 0 && count < kMaxReadBlocks)
+    {
+        std::size_t const size = std::min(want, kMaxReadSize);
+        blocks[count] = pooled_frame_buffer::create(size);
+        blocks[count]->resize(size);
+        bufs[count] = boost::asio::buffer(blocks[count]->data(), size);
+        capacity += size;
+        want -= size;
+        count++;
+    }
+    if (count > 1)
+    {
+        vectored_reads.fetch_add(1, std::memory_order_relaxed);
+    }
+    // 没用到的是空缓冲，不影响 readv
+    std::size_t const bytes = socket_.read_some(bufs, ec);
+    adapt_read_size(bytes, capacity);
+    return bytes;
+}
 
+void tcp_connection::adapt_read_size(std::size_t bytes, std::size_t capacity)
+{
+    std::size_t size = read_size_;
+    if (bytes >= capacity)
+    {
+        read_shrink_ = 0;
+        size = std::min(std::max(read_size_, capacity) * 2, kMaxReadSize);
+    }
+    else if (bytes < read_size_ / 2)
+    {
+        if (++read_shrink_ >= 2)
+        {
+            read_shrink_ = 0;
+            size = std::max(read_size_ / 2, kMinReadSize);
+        }
+    }
+    else
+    {
+        read_shrink_ = 0;
+    }
+    if (size == read_size_)
+    {
+        return;
+    }
+    (size > read_size_ ? read_grows : read_shrinks).fetch_add(1, std::memory_order_relaxed);
+    read_size_bytes.fetch_add(size, std::memory_order_relaxed);
+    read_size_bytes.fetch_sub(read_size_, std::memory_order_relaxed);
+    read_size_ = size;
+}
+
+void tcp_connection::on_uring_read(const frame_buffer::ptr& frame, int res, bool more)
+{
+    if (res > 0)
+    {
+        LOG_TRACE("{} <--> {} read {} bytes", local_addr_, remote_addr_, res);
+        on_read(frame, {});
+    }
+    if (more)
+    {
+        return;
+    }
+    uring_recv_ = 0;
+    if (!socket_.is_open())
+    {
+        return;
+    }
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr)
+    {
+        safe_migrate();
+        return;
+    }
+    if (res == 0 || (res < 0 && res != -ENOBUFS && res != -ECANCELED && res != -EAGAIN))
+    {
+        auto ec = res == 0 ? boost::system::error_code(boost::asio::error::eof) : boost::system::error_code(-res, boost::system::system_category());
+        on_read(pooled_frame_buffer::create(), ec);
+        return;
+    }
+    if (res == -EAGAIN)
+    {
+        // 不应该出现，出现时等 asio 报告可读后再发起，不空转
+        socket_.async_wait(boost::asio::ip::tcp::socket::wait_read, std::bind(&tcp_connection::on_uring_readable, shared_from_this(), _1));
+        return;
+    }
+    // 缓冲环用完或者内核结束了这次多次接收，重新发起
+    do_read();
+}
+
+void tcp_connection::on_uring_readable(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        on_read(pooled_frame_buffer::create(), ec);
+        return;
+    }
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr)
+    {
+        safe_migrate();
+        return;
+    }
+    do_read();
+}
+
+void tcp_connection::on_read(const frame_buffer::ptr& frame, const boost::system::error_code& ec)
+{
+    if (!ec)
+    {
+        read_seen_ = true;
+    }
     if (read_cb_)
     {
         read_cb_(frame, ec);
@@ -85,48 +465,733 @@ void tcp_connection::on_read(const boost::system::error_code& ec, std::size_t by
     {
         LOG_DEBUG("{} <--> {} read failed {}", local_addr_, remote_addr_, ec.message());
         shutdown();
+    }
+}
+
+void tcp_connection::set_write_queue_option(const write_queue_option& op)
+{
+    write_option_ = op;
+}
+
+simple_rtmp::write_queue_stats tcp_connection::stats()
+{
+    write_queue_stats s;
+    s.dropped_frames = dropped_frames.load(std::memory_order_relaxed);
+    s.dropped_bytes = dropped_bytes.load(std::memory_order_relaxed);
+    s.disconnects = overflow_disconnects.load(std::memory_order_relaxed);
+    s.write_batches = write_batches.load(std::memory_order_relaxed);
+    s.queue_delay_ms = total_queue_delay_ms.load(std::memory_order_relaxed);
+    s.max_queue_delay_ms = max_queue_delay_ms.load(std::memory_order_relaxed);
+    s.zerocopy_sends = zerocopy_sends.load(std::memory_order_relaxed);
+    s.zerocopy_copied = zerocopy_copied.load(std::memory_order_relaxed);
+    s.zerocopy_fallbacks = zerocopy_fallbacks.load(std::memory_order_relaxed);
+    return s;
+}
+
+simple_rtmp::connection_memory_stats tcp_connection::memory_stats()
+{
+    connection_memory_stats s;
+    s.connections = live_connections.load(std::memory_order_relaxed);
+    s.object_bytes = s.connections * sizeof(tcp_connection);
+    s.read_size_bytes = read_size_bytes.load(std::memory_order_relaxed);
+    s.read_grows = read_grows.load(std::memory_order_relaxed);
+    s.read_shrinks = read_shrinks.load(std::memory_order_relaxed);
+    s.vectored_reads = vectored_reads.load(std::memory_order_relaxed);
+    s.compacted_reads = compacted_reads.load(std::memory_order_relaxed);
+    return s;
+}
+
+std::size_t tcp_connection::memory_usage() const
+{
+    // 读块只在读回调期间持有，这里不算
+    return sizeof(*this) + queue_capacity_.load(std::memory_order_relaxed) * sizeof(frame_buffer::ptr) + queued_bytes_.load(std::memory_order_relaxed);
+}
+
+void tcp_connection::update_queue_capacity()
+{
+    queue_capacity_.store(write_queue_.capacity() + writing_queue_.capacity(), std::memory_order_relaxed);
+}
+
+std::vector<simple_rtmp::connection_memory> tcp_connection::connections()
+{
+    std::vector<connection_memory> result;
+    std::lock_guard<std::mutex> const lock(connections_mutex);
+    result.reserve(connections_set.size());
+    for (const tcp_connection* conn : connections_set)
+    {
+        connection_memory m;
+        m.local = conn->local_addr_;
+        m.remote = conn->remote_addr_;
+        m.memory_bytes = conn->memory_usage();
+        m.queued_bytes = conn->queued_bytes_.load(std::memory_order_relaxed);
+        m.queue_delay_ms = conn->queue_delay_ms();
+        result.push_back(std::move(m));
+    }
+    return result;
+}
+
+uint64_t tcp_connection::queue_delay_ms() const
+{
+    int64_t const oldest = oldest_queued_ms_.load(std::memory_order_relaxed);
+    if (oldest == 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(simple_rtmp::timestamp::now().milliseconds() - oldest);
+}
+
+void tcp_connection::set_timeout_option(const connection_timeout_option& op)
+{
+    timeout_option_ = op;
+}
+
+void tcp_connection::handshake_done()
+{
+    handshake_done_ = true;
+}
+
+void tcp_connection::keepalive()
+{
+    keepalive_seen_ = true;
+}
+
+simple_rtmp::connection_timeout_stats tcp_connection::timeout_stats()
+{
+    connection_timeout_stats s;
+    s.handshake = timeout_handshake.load(std::memory_order_relaxed);
+    s.idle = timeout_idle.load(std::memory_order_relaxed);
+    s.keepalive = timeout_keepalive.load(std::memory_order_relaxed);
+    s.write_stall = timeout_write_stall.load(std::memory_order_relaxed);
+    s.reaped_bytes = timeout_reaped_bytes.load(std::memory_order_relaxed);
+    return s;
+}
+
+void tcp_connection::count_timeout(connection_timeout kind, std::size_t bytes)
+{
+    switch (kind)
+    {
+        case connection_timeout::handshake:
+            timeout_handshake.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case connection_timeout::idle:
+            timeout_idle.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case connection_timeout::keepalive:
+            timeout_keepalive.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case connection_timeout::write_stall:
+            timeout_write_stall.fetch_add(1, std::memory_order_relaxed);
+            break;
+    }
+    timeout_reaped_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void tcp_connection::safe_start_timeout()
+{
+    const auto& op = timeout_option_;
+    bool const enabled = op.handshake_ms != 0 || op.idle_ms != 0 || op.keepalive_ms != 0 || op.write_stall_ms != 0;
+    if (!enabled || timeout_task_ != 0 || migrate_ex_.load(std::memory_order_acquire) != nullptr || !running_in_this_thread() || !socket_.is_open())
+    {
         return;
     }
+    int64_t const now = simple_rtmp::timestamp::now().milliseconds();
+    if (start_ms_ == 0)
+    {
+        start_ms_ = now;
+        last_read_ms_ = now;
+        last_keepalive_ms_ = now;
+    }
+    write_progress_ms_ = now;
+    checked_completions_ = write_completions_;
+    auto task = std::bind(&tcp_connection::check_timeout, shared_from_this());
+    timeout_task_ = timer_wheel::local(*ex_.load())->add_task(std::chrono::milliseconds(kTimeoutCheckMs), task, -1);
+}
 
-    LOG_TRACE("{} <--> {} read {} bytes", local_addr_, remote_addr_, bytes);
-    do_read();
+void tcp_connection::stop_timeout()
+{
+    if (timeout_task_ == 0)
+    {
+        return;
+    }
+    timer_wheel::local(*ex_.load())->del_task(timeout_task_);
+    timeout_task_ = 0;
+}
+
+static const char* timeout_name(simple_rtmp::connection_timeout kind)
+{
+    switch (kind)
+    {
+        case simple_rtmp::connection_timeout::handshake:
+            return "handshake";
+        case simple_rtmp::connection_timeout::idle:
+            return "idle";
+        case simple_rtmp::connection_timeout::keepalive:
+            return "keepalive";
+        case simple_rtmp::connection_timeout::write_stall:
+            return "write stall";
+    }
+    return "unknown";
+}
+
+void tcp_connection::check_timeout()
+{
+    if (!socket_.is_open())
+    {
+        stop_timeout();
+        return;
+    }
+    int64_t const now = simple_rtmp::timestamp::now().milliseconds();
+    // 读写路径上只置标记，这里换成时间，精度是检查间隔
+    if (read_seen_)
+    {
+        read_seen_ = false;
+        last_read_ms_ = now;
+    }
+    if (keepalive_seen_)
+    {
+        keepalive_seen_ = false;
+        last_keepalive_ms_ = now;
+    }
+    if (writing_queue_.empty() || write_completions_ != checked_completions_)
+    {
+        checked_completions_ = write_completions_;
+        write_progress_ms_ = now;
+    }
+    auto expired = [now](int64_t since, uint64_t timeout) { return timeout != 0 && static_cast<uint64_t>(now - since) > timeout; };
+    const auto& op = timeout_option_;
+    connection_timeout kind;
+    if (!handshake_done_ && expired(start_ms_, op.handshake_ms))
+    {
+        kind = connection_timeout::handshake;
+    }
+    else if (expired(last_read_ms_, op.idle_ms))
+    {
+        kind = connection_timeout::idle;
+    }
+    else if (expired(last_keepalive_ms_, op.keepalive_ms))
+    {
+        kind = connection_timeout::keepalive;
+    }
+    else if (expired(write_progress_ms_, op.write_stall_ms))
+    {
+        kind = connection_timeout::write_stall;
+    }
+    else
+    {
+        return;
+    }
+    std::size_t const bytes = memory_usage();
+    LOG_INFO("{} <--> {} {} timeout, reap {} bytes", local_addr_, remote_addr_, timeout_name(kind), bytes);
+    count_timeout(kind, bytes);
+    stop_timeout();
+    // 和读出错一样交给会话关闭
+    on_read(pooled_frame_buffer::create(), boost::asio::error::timed_out);
+}
+
+bool tcp_connection::over_high_water(uint64_t scale) const
+{
+    if (write_option_.max_bytes != 0 && queued_bytes_.load(std::memory_order_relaxed) > write_option_.max_bytes * scale)
+    {
+        return true;
+    }
+    return write_option_.max_delay_ms != 0 && queue_delay_ms() > write_option_.max_delay_ms * scale;
+}
+
+void tcp_connection::drop_frame(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    dropped_frames.fetch_add(1, std::memory_order_relaxed);
+    dropped_bytes.fetch_add(frame->size(), std::memory_order_relaxed);
+    if (drop_cb_)
+    {
+        drop_cb_(frame);
+    }
+}
+
+bool tcp_connection::admit_frame(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    // 配置帧很小，丢了后面的帧都没法解码
+    if (frame->media() == simple_rtmp::rtmp_tag::script || simple_rtmp::rtmp_config_frame(frame))
+    {
+        return true;
+    }
+    bool const keyframe = frame->media() == simple_rtmp::rtmp_tag::video && frame->flag() == 1;
+    bool const over = over_high_water(1);
+    if (wait_keyframe_)
+    {
+        if (keyframe && !over)
+        {
+            LOG_DEBUG("{} <--> {} resume on keyframe", local_addr_, remote_addr_);
+            wait_keyframe_ = false;
+            return true;
+        }
+        drop_frame(frame);
+        return false;
+    }
+    if (!over)
+    {
+        return true;
+    }
+
+    auto policy = write_option_.policy;
+    if (policy == drop_disposable && over_high_water(2))
+    {
+        policy = skip_to_keyframe;
+    }
+    if (policy == disconnect)
+    {
+        overflow_disconnect(frame);
+        return false;
+    }
+    if (policy == skip_to_keyframe)
+    {
+        LOG_WARN("{} <--> {} write queue {} bytes over high water, skip to next keyframe", local_addr_, remote_addr_, queued_bytes_.load());
+        wait_keyframe_ = true;
+        drop_frame(frame);
+        return false;
+    }
+    if (simple_rtmp::rtmp_disposable_frame(frame))
+    {
+        drop_frame(frame);
+        return false;
+    }
+    return true;
+}
+
+bool tcp_connection::admit_rtp_packet(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    // rtcp 包没有媒体类型，很小，不丢
+    bool const video = frame->media() == simple_rtmp::rtmp_tag::video;
+    if (!video && frame->media() != simple_rtmp::rtmp_tag::audio)
+    {
+        return true;
+    }
+    // 一帧的包时间戳相同，关键帧的第一个包前面是非关键帧或者时间戳不同的包
+    bool keyframe_start = false;
+    if (video)
+    {
+        bool const keyframe = frame->flag() == 1;
+        keyframe_start = keyframe && (!last_rtp_keyframe_ || frame->pts() != last_rtp_pts_);
+        last_rtp_keyframe_ = keyframe;
+        last_rtp_pts_ = frame->pts();
+    }
+    bool const over = over_high_water(1);
+    if (wait_keyframe_)
+    {
+        if (keyframe_start && !over)
+        {
+            LOG_DEBUG("{} <--> {} resume on keyframe", local_addr_, remote_addr_);
+            wait_keyframe_ = false;
+            return true;
+        }
+        drop_frame(frame);
+        return false;
+    }
+    if (!over)
+    {
+        return true;
+    }
+    if (write_option_.policy == disconnect)
+    {
+        overflow_disconnect(frame);
+        return false;
+    }
+    LOG_WARN("{} <--> {} write queue {} bytes over high water, skip to next keyframe", local_addr_, remote_addr_, queued_bytes_.load());
+    wait_keyframe_ = true;
+    drop_frame(frame);
+    return false;
+}
+
+void tcp_connection::overflow_disconnect(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    LOG_WARN("{} <--> {} write queue {} bytes over high water, disconnect", local_addr_, remote_addr_, queued_bytes_.load());
+    overflow_disconnects.fetch_add(1, std::memory_order_relaxed);
+    drop_frame(frame);
+    shutdown();
 }
 
 void tcp_connection::write_frame(const simple_rtmp::frame_buffer::ptr& frame)
 {
-    ex_.post(std::bind(&tcp_connection::safe_write_frame, shared_from_this(), frame));
+    write_frames(boost::span<const simple_rtmp::frame_buffer::ptr>(&frame, 1));
 }
 
-void tcp_connection::safe_write_frame(const simple_rtmp::frame_buffer::ptr& frame)
+void tcp_connection::write_frames(boost::span<const simple_rtmp::frame_buffer::ptr> frames)
 {
-    write_queue_.push_back(frame);
+    if (frames.empty())
+    {
+        return;
+    }
+    uint64_t bytes = 0;
+    for (const auto& frame : frames)
+    {
+        bytes += frame->size();
+    }
+    queued_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    // 和发布者在同一个 executor 上时直接入队，收件箱里更早的数据先入队保证顺序
+    if (running_in_this_thread())
+    {
+        drain_inbox();
+        for (const auto& frame : frames)
+        {
+            enqueue_frame(frame);
+        }
+        safe_do_write();
+        return;
+    }
+
+    // 反向串起来一次压栈，取走后整体反转就是原来的顺序，同一批数据也不会被其他生产者打断
+    inbox_node* first = nullptr;
+    inbox_node* last = nullptr;
+    for (const auto& frame : frames)
+    {
+        auto* node = new (frame_pool::allocate(sizeof(inbox_node))) inbox_node{frame, first};
+        last = last == nullptr ? node : last;
+        first = node;
+    }
+    inbox_node* head = inbox_.load(std::memory_order_relaxed);
+    do
+    {
+        last->next = head;
+    } while (!inbox_.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+
+    if (!inbox_posted_.exchange(true, std::memory_order_acq_rel))
+    {
+        boost::asio::post(*ex_.load(), std::bind(&tcp_connection::safe_drain_inbox, shared_from_this()));
+    }
+}
+
+void tcp_connection::safe_drain_inbox()
+{
+    if (!running_in_this_thread())
+    {
+        // 投递后连接迁移了，转到新的 executor 上执行
+        boost::asio::post(*ex_.load(), std::bind(&tcp_connection::safe_drain_inbox, shared_from_this()));
+        return;
+    }
+    // 先清标记再取，之后压进来的数据会重新投递
+    inbox_posted_.store(false, std::memory_order_release);
+    drain_inbox();
     safe_do_write();
 }
 
+void tcp_connection::drain_inbox()
+{
+    inbox_node* node = inbox_.exchange(nullptr, std::memory_order_acquire);
+    inbox_node* reversed = nullptr;
+    while (node != nullptr)
+    {
+        inbox_node* next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+    }
+    while (reversed != nullptr)
+    {
+        inbox_node* next = reversed->next;
+        enqueue_frame(reversed->frame);
+        reversed->~inbox_node();
+        frame_pool::deallocate(reversed);
+        reversed = next;
+    }
+}
+
+void tcp_connection::enqueue_frame(const simple_rtmp::frame_buffer::ptr& frame)
+{
+    if (!socket_.is_open())
+    {
+        queued_bytes_.fetch_sub(frame->size(), std::memory_order_relaxed);
+        return;
+    }
+    if (write_queue_.empty())
+    {
+        write_queue_since_ = simple_rtmp::timestamp::now().milliseconds();
+        if (writing_queue_.empty())
+        {
+            oldest_queued_ms_.store(write_queue_since_, std::memory_order_relaxed);
+        }
+    }
+    write_queue_.push_back(frame);
+    update_queue_capacity();
+}
+
 void tcp_connection::safe_do_write()
 {
     if (!writing_queue_.empty())
     {
         return;
     }
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr)
+    {
+        return;
+    }
+    // 上一批写的过程中收件箱里积累的数据合并到这一批
+    drain_inbox();
     if (write_queue_.empty())
     {
         return;
     }
     auto self = shared_from_this();
     writing_queue_.swap(write_queue_);
+    writing_since_ = write_queue_since_;
+    oldest_queued_ms_.store(writing_since_, std::memory_order_relaxed);
+    writing_bytes_ = 0;
     std::vector<boost::asio::const_buffer> bufs;
     bufs.reserve(writing_queue_.size());
     for (const auto& frame : writing_queue_)
     {
+        writing_bytes_ += frame->size();
         bufs.emplace_back(boost::asio::buffer(frame->data(), frame->size()));
     }
+    if (uring() != nullptr)
+    {
+        // io_uring 在发完或零拷贝通知到来之前持有这批数据
+        uring_->send(socket_.native_handle(), writing_queue_, zerocopy_wanted(), std::bind(&tcp_connection::on_uring_write, self, _1));
+        return;
+    }
+    bool const zerocopy = zerocopy_batch();
+    // 一次系统调用放不下整批时才 cork，一次写完的批次 cork 没有好处，还多两次 setsockopt
+    if (cork_ && writing_queue_.size() > (zerocopy ? kMaxIov : kAsioMaxBuffers))
+    {
+        set_socket_cork(socket_, true);
+        corked_ = true;
+    }
+    if (zerocopy)
+    {
+        zerocopy_sent_ = 0;
+        safe_zerocopy_write();
+        return;
+    }
     boost::asio::async_write(socket_, bufs, std::bind(&tcp_connection::safe_on_write, self, _1, _2));
 }
 
+bool tcp_connection::zerocopy_wanted() const
+{
+    std::size_t const threshold = zerocopy_threshold.load(std::memory_order_relaxed);
+    if (threshold == 0)
+    {
+        return false;
+    }
+    return std::any_of(writing_queue_.begin(), writing_queue_.end(), [threshold](const frame_buffer::ptr& frame) { return frame->size() >= threshold; });
+}
+
+bool tcp_connection::zerocopy_batch()
+{
+    if (zerocopy_failed_ || !zerocopy_wanted())
+    {
+        return false;
+    }
+    if (!zerocopy_enabled_)
+    {
+        int one = 1;
+        if (setsockopt(socket_.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0)
+        {
+            LOG_DEBUG("{} <--> {} enable zerocopy failed {}", local_addr_, remote_addr_, strerror(errno));
+            zerocopy_failed_ = true;
+            return false;
+        }
+        zerocopy_enabled_ = true;
+    }
+    return true;
+}
+
+void tcp_connection::safe_zerocopy_write()
+{
+    auto self = shared_from_this();
+    int const fd = socket_.native_handle();
+    std::vector<struct iovec> iov;
+    while (zerocopy_sent_ < writing_bytes_)
+    {
+        // 跳过已经发出的部分
+        iov.clear();
+        std::size_t skip = zerocopy_sent_;
+        for (const auto& frame : writing_queue_)
+        {
+            if (iov.size() == kMaxIov)
+            {
+                break;
+            }
+            if (skip >= frame->size())
+            {
+                skip -= frame->size();
+                continue;
+            }
+            iov.push_back(iovec{frame->data() + skip, frame->size() - skip});
+            skip = 0;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov.data();
+        msg.msg_iovlen = iov.size();
+        bool zerocopy = true;
+        ssize_t n = ::sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == ENOBUFS)
+        {
+            // 超过 optmem 限制，这次拷贝发送
+            zerocopy = false;
+            zerocopy_fallbacks.fetch_add(1, std::memory_order_relaxed);
+            n = ::sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                socket_.async_wait(boost::asio::ip::tcp::socket::wait_write, std::bind(&tcp_connection::safe_zerocopy_resume, self, _1));
+                return;
+            }
+            boost::asio::post(*ex_.load(), std::bind(&tcp_connection::safe_on_write, self, boost::system::error_code(errno, boost::system::system_category()), zerocopy_sent_));
+            return;
+        }
+        if (zerocopy)
+        {
+            zerocopy_sends.fetch_add(1, std::memory_order_relaxed);
+            zerocopy_seq_++;
+            zerocopy_batch_sent_ = true;
+            wait_zerocopy();
+        }
+        zerocopy_sent_ += static_cast<std::size_t>(n);
+    }
+    // 和 async_write 一样在下一轮回调
+    boost::asio::post(*ex_.load(), std::bind(&tcp_connection::safe_on_write, self, boost::system::error_code(), zerocopy_sent_));
+}
+
+void tcp_connection::retain_zerocopy_batch()
+{
+    if (!zerocopy_batch_sent_)
+    {
+        return;
+    }
+    zerocopy_batch_sent_ = false;
+    // 这一批最后一次零拷贝发送已经通知过，内核不再引用
+    uint32_t const last = zerocopy_seq_ - 1;
+    if (static_cast<int32_t>(last - zerocopy_done_) <= 0)
+    {
+        return;
+    }
+    zerocopy_pending_.emplace_back(last, std::move(writing_queue_));
+}
+
+void tcp_connection::safe_zerocopy_resume(const boost::system::error_code& ec)
+{
+    if (ec)
+    {
+        safe_on_write(ec, zerocopy_sent_);
+        return;
+    }
+    safe_zerocopy_write();
+}
+
+void tcp_connection::wait_zerocopy()
+{
+    if (zerocopy_waiting_ || zerocopy_closing_)
+    {
+        return;
+    }
+    zerocopy_waiting_ = true;
+    socket_.async_wait(boost::asio::ip::tcp::socket::wait_error, std::bind(&tcp_connection::safe_on_zerocopy, shared_from_this(), _1));
+}
+
+void tcp_connection::safe_on_zerocopy(const boost::system::error_code& ec)
+{
+    zerocopy_waiting_ = false;
+    if (ec || zerocopy_closing_)
+    {
+        return;
+    }
+    read_zerocopy_notifications();
+    if (!zerocopy_pending_.empty())
+    {
+        if (socket_.is_open())
+        {
+            wait_zerocopy();
+        }
+        return;
+    }
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr && writing_queue_.empty() && uring_recv_ == 0)
+    {
+        safe_migrate();
+    }
+}
+
+void tcp_connection::read_zerocopy_notifications()
+{
+    int const fd = socket_.native_handle();
+    while (true)
+    {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            break;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            bool const recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr)
+            {
+                continue;
+            }
+            const auto* ee = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            if ((ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0)
+            {
+                zerocopy_copied.fetch_add(1, std::memory_order_relaxed);
+            }
+            // [ee_info, ee_data] 之前的发送都已经完成，tcp 按顺序确认
+            uint32_t const hi = ee->ee_data;
+            zerocopy_done_ = hi;
+            while (!zerocopy_pending_.empty() && static_cast<int32_t>(zerocopy_pending_.front().first - hi) <= 0)
+            {
+                zerocopy_pending_.pop_front();
+            }
+        }
+    }
+}
+
+void tcp_connection::on_uring_write(int res)
+{
+    if (res < 0)
+    {
+        safe_on_write(boost::system::error_code(-res, boost::system::system_category()), 0);
+        return;
+    }
+    safe_on_write({}, static_cast<std::size_t>(res));
+}
+
 void tcp_connection::safe_on_write(const boost::system::error_code& ec, std::size_t bytes)
 {
+    if (corked_)
+    {
+        corked_ = false;
+        set_socket_cork(socket_, false);
+    }
+    retain_zerocopy_batch();
     writing_queue_.clear();
+    if (zerocopy_closing_)
+    {
+        // 关闭中最后一批写完，可能刚移进待确认队列，也可能已经确认完
+        close_socket();
+    }
+    update_queue_capacity();
+    write_completions_++;
+    queued_bytes_.fetch_sub(writing_bytes_, std::memory_order_relaxed);
+    writing_bytes_ = 0;
+    auto const delay = static_cast<uint64_t>(simple_rtmp::timestamp::now().milliseconds() - writing_since_);
+    write_batches.fetch_add(1, std::memory_order_relaxed);
+    total_queue_delay_ms.fetch_add(delay, std::memory_order_relaxed);
+    uint64_t max_delay = max_queue_delay_ms.load(std::memory_order_relaxed);
+    while (delay > max_delay && !max_queue_delay_ms.compare_exchange_weak(max_delay, delay, std::memory_order_relaxed))
+    {
+    }
+    oldest_queued_ms_.store(write_queue_.empty() ? 0 : write_queue_since_, std::memory_order_relaxed);
 
     if (write_cb_)
     {
@@ -139,5 +1204,10 @@ void tcp_connection::safe_on_write(const boost::system::error_code& ec, std::siz
         return;
     }
     LOG_TRACE("{} <--> {} write {} bytes", local_addr_, remote_addr_, bytes);
+    if (migrate_ex_.load(std::memory_order_acquire) != nullptr)
+    {
+        safe_migrate();
+        return;
+    }
     safe_do_write();
 }
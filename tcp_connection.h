@@ -3,12 +3,107 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <deque>
+#include <boost/core/span.hpp>
 #include "execution.h"
 #include "channel.h"
 #include "frame_buffer.h"
 
 namespace simple_rtmp
 {
+// 写队列超过水位后的处理方式
+enum write_overflow_policy
+{
+    drop_disposable = 0,     // 丢掉不被参考的视频帧，超过两倍水位时转为 skip_to_keyframe
+    skip_to_keyframe = 1,    // 丢掉后续所有帧直到下一个关键帧
+    disconnect = 2,          // 断开连接
+};
+
+struct write_queue_option
+{
+    uint64_t max_bytes = 8 * 1024 * 1024;    // 0 不限制
+    uint64_t max_delay_ms = 5000;            // 队列里最早的数据等待的时间，0 不限制
+    write_overflow_policy policy = skip_to_keyframe;
+};
+
+// 所有连接累计
+struct write_queue_stats
+{
+    uint64_t dropped_frames = 0;
+    uint64_t dropped_bytes = 0;
+    uint64_t disconnects = 0;         // 因为超过水位被断开的连接
+    uint64_t write_batches = 0;       // 完成的批量写次数
+    uint64_t queue_delay_ms = 0;      // 每批数据在队列里等待的时间累计
+    uint64_t max_queue_delay_ms = 0;
+    uint64_t zerocopy_sends = 0;       // MSG_ZEROCOPY 的 sendmsg 次数
+    uint64_t zerocopy_copied = 0;      // 内核回退成拷贝的通知次数，回环上总是拷贝
+    uint64_t zerocopy_fallbacks = 0;   // optmem 不够改用普通发送
+
+    uint64_t avg_queue_delay_ms() const
+    {
+        return write_batches == 0 ? 0 : queue_delay_ms / write_batches;
+    }
+};
+
+// 所有连接累计的内存占用
+struct connection_memory_stats
+{
+    uint64_t connections = 0;
+    uint64_t object_bytes = 0;         // 连接对象本身
+    uint64_t read_size_bytes = 0;      // 各连接当前自适应的读块大小之和，空闲时并不占用
+    uint64_t read_grows = 0;
+    uint64_t read_shrinks = 0;
+    uint64_t vectored_reads = 0;       // 一次读满多个块
+    uint64_t compacted_reads = 0;      // 读到的远小于读块，拷到小块里的次数
+};
+
+// 一个连接当前占用的内存
+struct connection_memory
+{
+    std::string local;
+    std::string remote;
+    uint64_t memory_bytes = 0;      // memory_usage
+    uint64_t queued_bytes = 0;      // 队列里还没写出的数据
+    uint64_t queue_delay_ms = 0;    // 队列里最早的数据已经等待的时间
+};
+
+// 连接的超时，都是毫秒，0 不检查
+struct connection_timeout_option
+{
+    uint64_t handshake_ms = 0;      // start 之后多久内要调用 handshake_done
+    uint64_t idle_ms = 0;           // 多久没有收到任何数据
+    uint64_t keepalive_ms = 0;      // 多久没有调用 keepalive，比如 rtsp 的会话保活
+    uint64_t write_stall_ms = 0;    // 有数据要写但是多久没有写完一批
+};
+
+enum class connection_timeout
+{
+    handshake = 0,
+    idle = 1,
+    keepalive = 2,
+    write_stall = 3,
+};
+
+// 所有连接累计的超时回收
+struct connection_timeout_stats
+{
+    uint64_t handshake = 0;
+    uint64_t idle = 0;
+    uint64_t keepalive = 0;
+    uint64_t write_stall = 0;
+    uint64_t reaped_bytes = 0;    // 被回收的连接当时占用的内存
+};
+
+// 读写走哪种实现，io_uring 不可用时退回 asio
+enum class io_backend
+{
+    asio = 0,
+    io_uring = 1,
+};
+
+class io_uring_loop;
+
 class tcp_connection : public std::enable_shared_from_this<tcp_connection>
 {
    public:
@@ -26,29 +121,164 @@ class tcp_connection : public std::enable_shared_from_this<tcp_connection>
     using write_cb = std::function<void(boost::system::error_code, std::size_t)>;
     void set_read_cb(const read_cb& cb);
     void set_write_cb(const write_cb& cb);
+    // 写队列超过水位丢掉一帧时在调用 admit 的线程上调用，会话据此修正自己的发送统计
+    using drop_cb = std::function<void(const simple_rtmp::frame_buffer::ptr&)>;
+    void set_drop_cb(const drop_cb& cb);
+    // 任意线程都可以调用，不在连接的线程上时放进无锁收件箱，连接线程每次唤醒把收件箱里的数据合并成一次写
     void write_frame(const simple_rtmp::frame_buffer::ptr& frame);
+    // 一组数据作为整体入队，中间不会插入其他数据
+    void write_frames(boost::span<const simple_rtmp::frame_buffer::ptr> frames);
+    void set_write_queue_option(const write_queue_option& op);
+    // 播放会话在序列化一个音视频帧之前调用，返回 false 表示这一帧要丢掉
+    // 在发送数据的那个线程上调用
+    bool admit_frame(const simple_rtmp::frame_buffer::ptr& frame);
+    // rtsp 交织的 rtp 包用这个，rtp 包里没有 flv 那样的配置帧和可丢帧标记
+    // 关键帧的每个包都带关键帧标记，跳帧后从下一个关键帧的第一个包恢复，drop_disposable 按 skip_to_keyframe 处理
+    bool admit_rtp_packet(const simple_rtmp::frame_buffer::ptr& frame);
+    static write_queue_stats stats();
+    static connection_memory_stats memory_stats();
+    // 在创建连接之前设置，返回实际使用的实现
+    static io_backend set_io_backend(io_backend backend);
+    // 一批里有不小于 bytes 的帧时零拷贝发送，0 关闭
+    // asio 的实现用 MSG_ZEROCOPY，io_uring 的实现用 IORING_OP_SENDMSG_ZC，规则相同
+    static void set_zerocopy_threshold(std::size_t bytes);
+    // 这个连接当前占用的内存，包括队列里还没写出的数据，任意线程调用
+    std::size_t memory_usage() const;
+    // start 之后还没释放的每个连接的内存，给 api 查看
+    static std::vector<connection_memory> connections();
+    // 队列里最早的数据已经等待的时间
+    uint64_t queue_delay_ms() const;
+    // 在 start 之前调用，超时后读回调收到 timed_out
+    void set_timeout_option(const connection_timeout_option& op);
+    // 握手完成，之后不再检查握手超时，在读回调里调用
+    void handshake_done();
+    // 会话层的保活，在读回调里调用
+    void keepalive();
+    static connection_timeout_stats timeout_stats();
+    // 不走 tcp_connection 的会话自己检查超时，也计入统计
+    static void count_timeout(connection_timeout kind, std::size_t bytes);
+    // 只能在 start 之前或读回调里调用，等已经发出的写完成后把 socket 换到 ex 上继续读写
+    void migrate(simple_rtmp::executors::executor& ex);
 
    private:
     void do_read();
-    void on_read(const boost::system::error_code& ec, std::size_t bytes);
+    void on_readable(const boost::system::error_code& ec);
+    std::size_t read_blocks(pooled_frame_buffer::ptr* blocks, boost::system::error_code& ec);
+    void adapt_read_size(std::size_t bytes, std::size_t capacity);
+    void on_read(const frame_buffer::ptr& frame, const boost::system::error_code& ec);
     void do_write(const frame_buffer::ptr& frame);
-    void safe_write_frame(const simple_rtmp::frame_buffer::ptr& frame);
+    void safe_drain_inbox();
+    void drain_inbox();
+    void enqueue_frame(const simple_rtmp::frame_buffer::ptr& frame);
     void safe_do_write();
     void safe_on_write(const boost::system::error_code& ec, std::size_t bytes);
     void safe_shutdown();
+    void close_socket();
+    void safe_migrate();
+    void safe_start_io();
+    bool running_in_this_thread() const;
+    io_uring_loop* uring();
+    void on_uring_read(const frame_buffer::ptr& frame, int res, bool more);
+    void on_uring_readable(const boost::system::error_code& ec);
+    void on_uring_write(int res);
+    // 这一批是否满足零拷贝的条件，两种实现共用
+    bool zerocopy_wanted() const;
+    bool zerocopy_batch();
+    void safe_zerocopy_write();
+    void retain_zerocopy_batch();
+    void safe_zerocopy_resume(const boost::system::error_code& ec);
+    void wait_zerocopy();
+    void safe_on_zerocopy(const boost::system::error_code& ec);
+    void read_zerocopy_notifications();
+    void safe_start_timeout();
+    void stop_timeout();
+    void check_timeout();
+    bool over_high_water(uint64_t scale) const;
+    void drop_frame(const simple_rtmp::frame_buffer::ptr& frame);
+    void overflow_disconnect(const simple_rtmp::frame_buffer::ptr& frame);
+    void update_queue_capacity();
 
    private:
     std::string local_addr_;
     std::string remote_addr_;
 
-    const static int kBufSize = 64 * 1024;
-    uint8_t buf_[kBufSize] = {0};
+    // 可读后才按 read_size_ 申请池化的块，读回调拿到的就是这个块，不再拷贝
+    // 读满就加倍，连续两次不到一半就减半，推流端会涨到最大，播放端握手后缩到最小
+    const static std::size_t kMinReadSize = 512;
+    const static std::size_t kInitReadSize = 4 * 1024;
+    const static std::size_t kMaxReadSize = frame_pool::kMaxBlockSize;
+    // 读到的不到读块的 1/4 时拷到刚好大小的块里，解析出的切片被 gop 缓存留住时不会占住整个读块
+    const static std::size_t kReadCompactRatio = 4;
+    const static int kMaxReadBlocks = 2;
+    std::size_t read_size_ = kInitReadSize;
+    int read_shrink_ = 0;
+    // io_uring 时用多次接收，迁移或关闭前先取消
+    io_uring_loop* uring_ = nullptr;
+    uint64_t uring_recv_ = 0;
+    // 关掉 nagle 的连接一批数据要分几次 writev/sendmsg 写时先 cork，写完再放开
+    bool cork_ = false;
+    bool corked_ = false;
+    // MSG_ZEROCOPY 每次成功的 sendmsg 有一个序号，内核按序号区间通知，通知到之前持有这次发送的数据
+    // 一批写完时整批移到待确认队列，记这一批最后一次发送的序号，部分写不再各拷一份
+    bool zerocopy_enabled_ = false;
+    bool zerocopy_failed_ = false;
+    bool zerocopy_waiting_ = false;
+    bool zerocopy_batch_sent_ = false;
+    uint32_t zerocopy_seq_ = 0;
+    uint32_t zerocopy_done_ = UINT32_MAX;    // 已经通知完成的最大序号，初始为第一个序号之前
+    std::size_t zerocopy_sent_ = 0;
+    std::deque<std::pair<uint32_t, std::vector<frame_buffer::ptr>>> zerocopy_pending_;
+    // 关闭时内核还在用零拷贝的数据，先 shutdown 不关 fd，通知收齐后再关，避免数据块被池子复用后发给对端
+    // shutdown 后 epoll 一直报 HUP，改由时间轮定时收通知；对端不确认时靠 TCP_USER_TIMEOUT 让内核断开，断开后通知也会到
+    const static unsigned int kZeroCopyCloseTimeoutMs = 10 * 1000;
+    const static uint64_t kZeroCopyClosePollMs = 50;
+    bool zerocopy_closing_ = false;
+    uint64_t zerocopy_close_task_ = 0;
+    // 超时由所在 executor 的时间轮每秒检查一次，读写路径上只置标记不取时间
+    const static uint64_t kTimeoutCheckMs = 1000;
+    connection_timeout_option timeout_option_;
+    uint64_t timeout_task_ = 0;
+    bool handshake_done_ = false;
+    bool read_seen_ = false;
+    bool keepalive_seen_ = false;
+    int64_t start_ms_ = 0;
+    int64_t last_read_ms_ = 0;
+    int64_t last_keepalive_ms_ = 0;
+    int64_t write_progress_ms_ = 0;
+    uint64_t write_completions_ = 0;
+    uint64_t checked_completions_ = 0;
     read_cb read_cb_ = nullptr;
     write_cb write_cb_ = nullptr;
-    simple_rtmp::executors::executor& ex_;
-    boost::asio::ip::tcp::socket socket_{ex_};
+    drop_cb drop_cb_ = nullptr;
+    // 迁移后会变，其他线程 write_frame 时要读
+    std::atomic<simple_rtmp::executors::executor*> ex_;
+    // 迁移目标，只有当前 ex_ 的线程写；safe_migrate 先清空它再 release 发布新的 ex_，
+    // 新线程 acquire 读到 ex_ 后接手连接，不会再看到旧的迁移目标
+    std::atomic<simple_rtmp::executors::executor*> migrate_ex_{nullptr};
+    boost::asio::ip::tcp::socket socket_;
     std::vector<frame_buffer::ptr> write_queue_;
     std::vector<frame_buffer::ptr> writing_queue_;
+    write_queue_option write_option_;
+    bool wait_keyframe_ = false;
+    // admit_rtp_packet 用上一个视频包判断关键帧从哪个包开始
+    bool last_rtp_keyframe_ = false;
+    int64_t last_rtp_pts_ = 0;
+    uint64_t writing_bytes_ = 0;
+    int64_t write_queue_since_ = 0;    // write_queue_ 里第一帧入队的时间
+    int64_t writing_since_ = 0;        // 正在写的这一批最早入队的时间
+    // 包括已经投递还没入队的数据
+    std::atomic<uint64_t> queued_bytes_{0};
+    std::atomic<int64_t> oldest_queued_ms_{0};
+    // 两个队列的容量，在连接的线程上更新，别的线程读
+    std::atomic<std::size_t> queue_capacity_{0};
+    // 多生产者单消费者的收件箱，生产者压栈，连接线程整体取走后反转
+    struct inbox_node
+    {
+        frame_buffer::ptr frame;
+        inbox_node* next = nullptr;
+    };
+    std::atomic<inbox_node*> inbox_{nullptr};
+    std::atomic<bool> inbox_posted_{false};
 };
 
 }    // namespace simple_rtmp
@@ -9,6 +9,7 @@
 #include "execution.h"
 #include "error.h"
 #include "log.h"
+#include "socket.h"
 
 namespace simple_rtmp
 {
@@ -16,7 +17,10 @@ template <typename Session>
 class tcp_server : public std::enable_shared_from_this<tcp_server<Session>>
 {
    public:
-    tcp_server(uint16_t port, std::string name, executors::executor &io, executors &pool) : port_(port), name_(std::move(name)), acceptor_(io), pool_(pool)
+    // accept_local 为 true 时会话直接在 acceptor 所在的 io 上创建和运行
+    // profile 设置到每个接收的连接上
+    tcp_server(uint16_t port, std::string name, executors::executor &io, executors &pool, bool accept_local = false, socket_profile profile = {})
+        : port_(port), accept_local_(accept_local), name_(std::move(name)), io_(io), acceptor_(io), pool_(pool), profile_(profile)
     {
         LOG_INFO("{} server :{} create", name_, port_);
     }
@@ -63,17 +67,18 @@ class tcp_server : public std::enable_shared_from_this<tcp_server<Session>>
             return;
         }
         int one = 1;
-        int flag = SO_REUSEADDR;
-
-#ifdef __linux__
-        flag |= SO_REUSEPORT;
-#endif
-
-        int ret = setsockopt(acceptor.native_handle(), SOL_SOCKET, flag, &one, sizeof(one));
+        int ret = setsockopt(acceptor.native_handle(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (ret == -1)
+        {
+            LOG_WARN("{} server :{} setsockopt reuse addr error {}", name_, port_, errno_to_str());
+        }
+#ifdef SO_REUSEPORT
+        ret = setsockopt(acceptor.native_handle(), SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
         if (ret == -1)
         {
-            LOG_WARN("{} server :{} setsockopt error {}", name_, port_, errno_to_str());
+            LOG_WARN("{} server :{} setsockopt reuse port error {}", name_, port_, errno_to_str());
         }
+#endif
         acceptor.bind(boost::asio::ip::tcp::endpoint(addr, port_), ec);
         if (ec)
         {
@@ -97,7 +102,7 @@ class tcp_server : public std::enable_shared_from_this<tcp_server<Session>>
             return;
         }
         LOG_INFO("{} server :{} accept count {}", name_, port_, count_++);
-        session_ = std::make_shared<Session>(pool_.get_executor());
+        session_ = std::make_shared<Session>(accept_local_ ? io_ : pool_.get_executor());
         auto self = tcp_server<Session>::shared_from_this();
         acceptor_.async_accept(session_->socket(), [this, self](boost::system::error_code ec) { on_accept(ec); });
     }
@@ -113,6 +118,7 @@ class tcp_server : public std::enable_shared_from_this<tcp_server<Session>>
             LOG_ERROR("{} server :{} accept error {}", name_, port_, ec.message());
             return;
         }
+        apply_socket_profile(session_->socket(), profile_);
         session_->start();
         do_accept();
     }
@@ -120,10 +126,24 @@ class tcp_server : public std::enable_shared_from_this<tcp_server<Session>>
    private:
     uint16_t port_ = 0;
     uint32_t count_ = 0;
+    bool accept_local_ = false;
     std::string name_;
+    executors::executor &io_;
     boost::asio::ip::tcp::acceptor acceptor_;
     std::shared_ptr<Session> session_ = nullptr;
     simple_rtmp::executors &pool_;
+    socket_profile profile_;
 };
+
+// 每个 io_context 一个 acceptor 监听同一个端口(SO_REUSEPORT)，由内核分配连接
+// 会话在接收连接的线程上创建和运行，不再经过单个 acceptor 转发
+template <typename Session>
+void run_reuse_port_servers(uint16_t port, const std::string &name, executors &pool, const socket_profile &profile = {})
+{
+    for (std::size_t i = 0; i < pool.size(); i++)
+    {
+        std::make_shared<tcp_server<Session>>(port, name, pool.at(i), pool, true, profile)->run();
+    }
+}
 }    // namespace simple_rtmp
 #endif    // SIMPLE_RTMP_TCP_SERVER_H
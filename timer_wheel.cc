@@ -0,0 +1,286 @@
+#include "timer_wheel.h"
+#include "log.h"
+
+namespace simple_rtmp
+{
+struct timer_wheel::task_node : task_link
+{
+    timer_task task;           // 回调函数
+    uint64_t id = 0;           //
+    uint64_t expire = 0;       // 到期的刻度
+    uint64_t interval = 0;     // 间隔多少个刻度
+    int repeat = 1;            // 重复次数，-1 一直重复
+    bool running = false;      // 回调执行中
+    bool cancelled = false;    // 执行中被删除，回调返回后释放
+};
+
+void timer_wheel::task_link::unlink()
+{
+    prev->next = next;
+    next->prev = prev;
+    prev = this;
+    next = this;
+}
+
+bool timer_wheel::task_list::empty() const
+{
+    return head_.next == &head_;
+}
+
+void timer_wheel::task_list::push_back(task_link* node)
+{
+    node->prev = head_.prev;
+    node->next = &head_;
+    head_.prev->next = node;
+    head_.prev = node;
+}
+
+void timer_wheel::task_list::splice(task_list& other)
+{
+    if (other.empty())
+    {
+        return;
+    }
+    task_link* first = other.head_.next;
+    task_link* last = other.head_.prev;
+    first->prev = head_.prev;
+    last->next = &head_;
+    head_.prev->next = first;
+    head_.prev = last;
+    other.head_.prev = &other.head_;
+    other.head_.next = &other.head_;
+}
+
+timer_wheel::task_node* timer_wheel::task_list::pop_front()
+{
+    if (empty())
+    {
+        return nullptr;
+    }
+    task_link* node = head_.next;
+    node->unlink();
+    return static_cast<task_node*>(node);
+}
+
+timer_wheel::timer_wheel(boost::asio::io_context& io) : start_(std::chrono::steady_clock::now()), timer_(io)
+{
+}
+
+timer_wheel::~timer_wheel()
+{
+    boost::system::error_code ec;
+    timer_.cancel(ec);
+    for (auto&& pair : tasks_)
+    {
+        delete pair.second;
+    }
+}
+
+timer_wheel* timer_wheel::local(boost::asio::io_context& io)
+{
+    thread_local std::unique_ptr<timer_wheel> wheel;
+    if (wheel == nullptr)
+    {
+        wheel.reset(new timer_wheel(io));
+    }
+    return wheel.get();
+}
+
+uint64_t timer_wheel::now_tick() const
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_);
+    return static_cast<uint64_t>(elapsed.count() / kTickMicroseconds);
+}
+
+uint64_t timer_wheel::add_task(std::chrono::microseconds delay, timer_task&& task, int repeat)
+{
+    if (repeat == 0 || !task)
+    {
+        return 0;
+    }
+    const uint64_t now = now_tick();
+    if (tasks_.empty())
+    {
+        // 没有任务时轮子是空的，直接跳到当前刻度，不用一格一格追
+        current_tick_ = now;
+    }
+    // 向上取整，至少一个刻度
+    int64_t const ticks = (delay.count() + kTickMicroseconds - 1) / kTickMicroseconds;
+    auto* node = new task_node;
+    node->task = std::move(task);
+    node->id = next_id_++;
+    node->interval = ticks > 0 ? static_cast<uint64_t>(ticks) : 1;
+    node->expire = now + node->interval;
+    node->repeat = repeat;
+    tasks_.emplace(node->id, node);
+    insert(node);
+    schedule();
+    return node->id;
+}
+
+void timer_wheel::del_task(uint64_t id)
+{
+    auto it = tasks_.find(id);
+    if (it == tasks_.end())
+    {
+        return;
+    }
+    task_node* node = it->second;
+    if (node->running)
+    {
+        node->cancelled = true;
+        return;
+    }
+    node->unlink();
+    tasks_.erase(it);
+    delete node;
+}
+
+std::size_t timer_wheel::size() const
+{
+    return tasks_.size();
+}
+
+void timer_wheel::insert(task_node* node)
+{
+    uint64_t expire = node->expire;
+    if (expire < current_tick_)
+    {
+        expire = current_tick_;
+    }
+    uint64_t const delta = expire - current_tick_;
+    if (delta < kLevel0Slots)
+    {
+        level0_[expire & (kLevel0Slots - 1)].push_back(node);
+        return;
+    }
+    for (int level = 0; level < kLevels - 1; level++)
+    {
+        int const shift = kLevel0Bits + level * kLevelBits;
+        uint64_t const range = 1ULL << (shift + kLevelBits);
+        if (delta < range || level == kLevels - 2)
+        {
+            // 超出最后一层的先放到最远的槽，降层时按真实的到期时间重新放
+            if (delta >= range)
+            {
+                expire = current_tick_ + range - 1;
+            }
+            levels_[level][(expire >> shift) & (kLevelSlots - 1)].push_back(node);
+            return;
+        }
+    }
+}
+
+void timer_wheel::cascade(int level, std::size_t index)
+{
+    task_list tmp;
+    tmp.splice(levels_[level][index]);
+    while (task_node* node = tmp.pop_front())
+    {
+        insert(node);
+    }
+}
+
+void timer_wheel::run_slot(task_list& slot)
+{
+    while (task_node* node = slot.pop_front())
+    {
+        node->running = true;
+        node->task();
+        node->running = false;
+        if (node->repeat > 0)
+        {
+            node->repeat--;
+        }
+        if (node->cancelled || node->repeat == 0)
+        {
+            tasks_.erase(node->id);
+            delete node;
+            continue;
+        }
+        node->expire += node->interval;
+        // 回调或者线程卡住错过了若干个周期，从当前刻度重新算，不连续补发
+        uint64_t const now = now_tick();
+        if (node->expire <= now)
+        {
+            node->expire = now + node->interval;
+        }
+        insert(node);
+    }
+}
+
+void timer_wheel::advance(uint64_t target)
+{
+    while (current_tick_ <= target && !tasks_.empty())
+    {
+        std::size_t const index = current_tick_ & (kLevel0Slots - 1);
+        if (index == 0)
+        {
+            // 第 0 层转完一圈，从上一层取下一段时间的任务放下来
+            for (int level = 0; level < kLevels - 1; level++)
+            {
+                int const shift = kLevel0Bits + level * kLevelBits;
+                std::size_t const slot = (current_tick_ >> shift) & (kLevelSlots - 1);
+                cascade(level, slot);
+                if (slot != 0)
+                {
+                    break;
+                }
+            }
+        }
+        // 先摘下来再执行，回调里添加的任务不会在这一轮执行
+        task_list expired;
+        expired.splice(level0_[index]);
+        current_tick_++;
+        run_slot(expired);
+    }
+    if (tasks_.empty())
+    {
+        current_tick_ = target + 1;
+    }
+}
+
+void timer_wheel::schedule()
+{
+    if (tasks_.empty())
+    {
+        return;
+    }
+    // 第 0 层这一圈里最近的非空槽，没有时在转完一圈降层的时候醒来
+    uint64_t const round_end = (current_tick_ | (kLevel0Slots - 1)) + 1;
+    uint64_t wake = round_end;
+    for (uint64_t tick = current_tick_; tick < round_end; tick++)
+    {
+        if (!level0_[tick & (kLevel0Slots - 1)].empty())
+        {
+            wake = tick;
+            break;
+        }
+    }
+    if (timer_armed_ && timer_tick_ <= wake)
+    {
+        return;
+    }
+    timer_armed_ = true;
+    timer_tick_ = wake;
+    timer_.expires_at(start_ + std::chrono::microseconds(static_cast<int64_t>(wake) * kTickMicroseconds));
+    timer_.async_wait([this](const boost::system::error_code& ec) { on_timer(ec); });
+}
+
+void timer_wheel::on_timer(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted)
+    {
+        // 被更早的到期时间替换
+        return;
+    }
+    if (ec)
+    {
+        LOG_ERROR("timer wheel wait error {}", ec.message());
+    }
+    timer_armed_ = false;
+    advance(now_tick());
+    schedule();
+}
+
+}    // namespace simple_rtmp
@@ -0,0 +1,92 @@
+#ifndef SIMPLE_RTMP_TIMER_WHEEL_H
+#define SIMPLE_RTMP_TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <boost/asio.hpp>
+
+namespace simple_rtmp
+{
+// 分层时间轮，每个 executor 线程一个，任务在所属的 executor 上执行
+// 第 0 层 256 个槽，其余三层各 64 个槽，一个刻度 250 微秒，最长约 4.6 小时，更长的先放到最后一层
+// 添加和删除都是 O(1)，只在有任务时按最近的槽启动 steady_timer，空闲时不唤醒
+// add_task/del_task 只能在所属的 io 线程上调用，其它线程需要先 post 过去
+class timer_wheel
+{
+   public:
+    using timer_task = std::function<void(void)>;
+    const static int64_t kTickMicroseconds = 250;
+
+   public:
+    ~timer_wheel();
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+   public:
+    // 当前线程的时间轮，第一次调用时创建，只能在 io 线程上调用
+    static timer_wheel* local(boost::asio::io_context& io);
+
+   public:
+    // delay 之后执行，之后每隔 delay 执行一次
+    // repeat 重复次数，-1 一直重复
+    // return id，0 为无效 id
+    uint64_t add_task(std::chrono::microseconds delay, timer_task&& task, int repeat = 1);
+    // 任务执行中删除自己也可以
+    void del_task(uint64_t id);
+    std::size_t size() const;
+
+   private:
+    struct task_link
+    {
+        task_link* prev = this;
+        task_link* next = this;
+        void unlink();
+    };
+    struct task_node;
+    // 侵入式双向链表，任务在哪个链表里都可以直接摘下来
+    struct task_list
+    {
+        task_list() = default;
+        task_list(const task_list&) = delete;
+        task_list& operator=(const task_list&) = delete;
+        bool empty() const;
+        void push_back(task_link* node);
+        // 把 other 的任务全部移过来，other 置空
+        void splice(task_list& other);
+        task_node* pop_front();
+        task_link head_;
+    };
+
+    const static int kLevel0Bits = 8;
+    const static int kLevelBits = 6;
+    const static int kLevels = 4;
+    const static std::size_t kLevel0Slots = 1U << kLevel0Bits;
+    const static std::size_t kLevelSlots = 1U << kLevelBits;
+
+   private:
+    explicit timer_wheel(boost::asio::io_context& io);
+    uint64_t now_tick() const;
+    void insert(task_node* node);
+    void cascade(int level, std::size_t index);
+    void run_slot(task_list& slot);
+    void advance(uint64_t target);
+    void schedule();
+    void on_timer(const boost::system::error_code& ec);
+
+   private:
+    std::chrono::steady_clock::time_point start_;
+    boost::asio::steady_timer timer_;
+    bool timer_armed_ = false;
+    uint64_t timer_tick_ = 0;
+    uint64_t current_tick_ = 0;
+    uint64_t next_id_ = 1;
+    task_list level0_[kLevel0Slots];
+    task_list levels_[kLevels - 1][kLevelSlots];
+    std::unordered_map<uint64_t, task_node*> tasks_;
+};
+
+}    // namespace simple_rtmp
+
+#endif
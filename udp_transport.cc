@@ -0,0 +1,329 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include "udp_transport.h"
+#include "log.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+using simple_rtmp::udp_transport;
+using namespace std::placeholders;
+
+static std::atomic<uint16_t> port_base{30000};
+static std::atomic<uint16_t> port_count{1000};
+static std::atomic<uint32_t> next_pair{0};
+static std::atomic<uint64_t> udp_transports{0};
+static std::atomic<uint64_t> udp_packets{0};
+static std::atomic<uint64_t> udp_bytes{0};
+static std::atomic<uint64_t> udp_syscalls{0};
+static std::atomic<uint64_t> udp_gso_messages{0};
+static std::atomic<uint64_t> udp_dropped{0};
+static std::atomic<uint64_t> udp_rtcp_received{0};
+
+static const uint32_t kMaxBindAttempts = 64;
+// UIO_MAXIOV
+static const std::size_t kMaxMessages = 1024;
+static const std::size_t kMaxGsoSegments = 64;
+static const std::size_t kMaxGsoBytes = 65000;
+static const int kSendBufferSize = 4 * 1024 * 1024;
+static const std::size_t kRecvBufferSize = 2048;
+
+udp_transport::udp_transport(boost::asio::io_context& io) : io_(io), rtp_(io), rtcp_(io)
+{
+}
+
+udp_transport::~udp_transport()
+{
+    boost::system::error_code ec;
+    rtp_.close(ec);
+    rtcp_.close(ec);
+}
+
+void udp_transport::set_port_range(uint16_t base, uint16_t count)
+{
+    port_base = base;
+    port_count = count;
+}
+
+udp_transport* udp_transport::local(boost::asio::io_context& io)
+{
+    thread_local std::unique_ptr<udp_transport> transport;
+    thread_local bool failed = false;
+    if (transport != nullptr || failed)
+    {
+        return transport.get();
+    }
+    transport.reset(new udp_transport(io));
+    if (!transport->open())
+    {
+        LOG_ERROR("udp transport no free port in {}-{}", port_base.load(), port_base.load() + port_count.load());
+        failed = true;
+        transport.reset();
+    }
+    return transport.get();
+}
+
+simple_rtmp::udp_transport_stats udp_transport::stats()
+{
+    udp_transport_stats s;
+    s.transports = udp_transports.load(std::memory_order_relaxed);
+    s.packets = udp_packets.load(std::memory_order_relaxed);
+    s.bytes = udp_bytes.load(std::memory_order_relaxed);
+    s.syscalls = udp_syscalls.load(std::memory_order_relaxed);
+    s.gso_messages = udp_gso_messages.load(std::memory_order_relaxed);
+    s.dropped = udp_dropped.load(std::memory_order_relaxed);
+    s.rtcp_received = udp_rtcp_received.load(std::memory_order_relaxed);
+    return s;
+}
+
+bool udp_transport::open()
+{
+    uint32_t const pairs = port_count.load() / 2;
+    uint32_t const attempts = pairs < kMaxBindAttempts ? pairs : kMaxBindAttempts;
+    for (uint32_t i = 0; i < attempts; i++)
+    {
+        auto port = static_cast<uint16_t>(port_base.load() + 2 * (next_pair.fetch_add(1) % pairs));
+        boost::system::error_code ec;
+        rtp_.open(boost::asio::ip::udp::v4(), ec);
+        if (!ec)
+        {
+            rtp_.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), port), ec);
+        }
+        if (!ec)
+        {
+            rtcp_.open(boost::asio::ip::udp::v4(), ec);
+        }
+        if (!ec)
+        {
+            rtcp_.bind(boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::any(), port + 1), ec);
+        }
+        if (ec)
+        {
+            LOG_DEBUG("udp transport bind {}-{} failed {}", port, port + 1, ec.message());
+            boost::system::error_code ignore;
+            rtp_.close(ignore);
+            rtcp_.close(ignore);
+            continue;
+        }
+        rtp_.non_blocking(true, ec);
+        rtcp_.non_blocking(true, ec);
+        rtp_.set_option(boost::asio::socket_base::send_buffer_size(kSendBufferSize), ec);
+        if (ec)
+        {
+            LOG_WARN("udp transport set send buffer failed {}", ec.message());
+        }
+        port_ = port;
+        udp_transports.fetch_add(1, std::memory_order_relaxed);
+        LOG_INFO("udp transport bind {}-{}", port_, port_ + 1);
+        do_receive();
+        return true;
+    }
+    return false;
+}
+
+uint16_t udp_transport::rtp_port() const
+{
+    return port_;
+}
+
+uint16_t udp_transport::rtcp_port() const
+{
+    return port_ + 1;
+}
+
+void udp_transport::send_rtp(const boost::asio::ip::udp::endpoint& to, const frame_buffer::ptr& frame, std::size_t offset)
+{
+    rtp_pending_.push_back(packet{to, frame, offset});
+    schedule_flush(rtp_pending_);
+}
+
+void udp_transport::send_rtcp(const boost::asio::ip::udp::endpoint& to, const frame_buffer::ptr& frame, std::size_t offset)
+{
+    rtcp_pending_.push_back(packet{to, frame, offset});
+    schedule_flush(rtcp_pending_);
+}
+
+void udp_transport::schedule_flush(std::vector<packet>& pending)
+{
+    if (pending.size() >= kMaxMessages)
+    {
+        flush();
+        return;
+    }
+    // 这一轮事件处理完后统一发送，编码器同步输出一帧的所有包，所有播放者的这一帧合在一起
+    if (flush_posted_)
+    {
+        return;
+    }
+    flush_posted_ = true;
+    boost::asio::post(io_, std::bind(&udp_transport::flush, this));
+}
+
+void udp_transport::flush()
+{
+    flush_posted_ = false;
+    flush_socket(rtp_, rtp_pending_);
+    flush_socket(rtcp_, rtcp_pending_);
+}
+
+std::size_t udp_transport::build_messages(std::vector<packet>& pending, std::size_t begin)
+{
+    // 先分好每条消息包含哪些包，iovs_ 填完再取指针，避免扩容后指针失效
+    msg_packets_.clear();
+    std::size_t end = begin;
+    while (end < pending.size() && msg_packets_.size() < kMaxMessages)
+    {
+        std::size_t next = end + 1;
+        std::size_t const segment = pending[end].size();
+        std::size_t bytes = segment;
+        // 同一个地址、除最后一个外大小相同的连续包，内核按 segment 切开
+        while (gso_ && next < pending.size() && next - end < kMaxGsoSegments && pending[next].to == pending[end].to && pending[next - 1].size() == segment &&
+               pending[next].size() <= segment && bytes + pending[next].size() <= kMaxGsoBytes)
+        {
+            bytes += pending[next].size();
+            next++;
+        }
+        msg_packets_.push_back(next - end);
+        end = next;
+    }
+
+    std::size_t const control_size = CMSG_SPACE(sizeof(uint16_t));
+    iovs_.resize(end - begin);
+    msgs_.resize(msg_packets_.size());
+    controls_.assign(msg_packets_.size() * control_size, 0);
+    std::size_t index = begin;
+    for (std::size_t m = 0; m < msg_packets_.size(); m++)
+    {
+        struct msghdr& hdr = msgs_[m].msg_hdr;
+        memset(&msgs_[m], 0, sizeof(msgs_[m]));
+        const auto& to = pending[index].to;
+        hdr.msg_name = const_cast<struct sockaddr*>(to.data());
+        hdr.msg_namelen = static_cast<socklen_t>(to.size());
+        hdr.msg_iov = &iovs_[index - begin];
+        hdr.msg_iovlen = msg_packets_[m];
+        for (std::size_t p = 0; p < msg_packets_[m]; p++)
+        {
+            const auto& pkt = pending[index + p];
+            iovs_[index - begin + p] = iovec{pkt.frame->data() + pkt.offset, pkt.size()};
+        }
+        if (msg_packets_[m] > 1)
+        {
+            hdr.msg_control = &controls_[m * control_size];
+            hdr.msg_controllen = control_size;
+            struct cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            auto segment = static_cast<uint16_t>(pending[index].size());
+            memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+        }
+        index += msg_packets_[m];
+    }
+    return end;
+}
+
+void udp_transport::flush_socket(boost::asio::ip::udp::socket& socket, std::vector<packet>& pending)
+{
+    if (pending.empty())
+    {
+        return;
+    }
+    int const fd = socket.native_handle();
+    std::size_t begin = 0;
+    while (begin < pending.size())
+    {
+        build_messages(pending, begin);
+        int const n = ::sendmmsg(fd, msgs_.data(), static_cast<unsigned int>(msgs_.size()), MSG_DONTWAIT | MSG_NOSIGNAL);
+        udp_syscalls.fetch_add(1, std::memory_order_relaxed);
+        if (n > 0)
+        {
+            // 只发出了一部分时从没发出的那条重新组织，下一次调用会返回出错原因
+            std::size_t packets = 0;
+            uint64_t bytes = 0;
+            for (int i = 0; i < n; i++)
+            {
+                packets += msg_packets_[i];
+                bytes += msgs_[i].msg_len;
+                if (msg_packets_[i] > 1)
+                {
+                    udp_gso_messages.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            udp_packets.fetch_add(packets, std::memory_order_relaxed);
+            udp_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            begin += packets;
+            continue;
+        }
+        int const err = errno;
+        if (err == EINTR)
+        {
+            continue;
+        }
+        if (gso_ && msg_packets_[0] > 1 && (err == EIO || err == EINVAL || err == ENOPROTOOPT || err == EOPNOTSUPP))
+        {
+            // 内核或网卡不支持 UDP_SEGMENT，之后一个包一条消息
+            LOG_WARN("udp transport {} disable gso {}", port_, strerror(err));
+            gso_ = false;
+            continue;
+        }
+        if (err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS)
+        {
+            // 发送缓冲满，udp 不重传，剩下的都丢掉
+            udp_dropped.fetch_add(pending.size() - begin, std::memory_order_relaxed);
+            break;
+        }
+        // 单个目的地址的错误(比如收到 icmp 不可达)，丢掉这条消息继续发后面的
+        LOG_DEBUG("udp transport {} send failed {}", port_, strerror(err));
+        udp_dropped.fetch_add(msg_packets_[0], std::memory_order_relaxed);
+        begin += msg_packets_[0];
+    }
+    pending.clear();
+}
+
+void udp_transport::add_peer(const boost::asio::ip::udp::endpoint& from, rtcp_cb cb)
+{
+    peers_[from] = std::move(cb);
+}
+
+void udp_transport::del_peer(const boost::asio::ip::udp::endpoint& from)
+{
+    peers_.erase(from);
+}
+
+void udp_transport::do_receive()
+{
+    // 回调可能还持有上一个块，每次换新块
+    recv_buffer_ = pooled_frame_buffer::create(kRecvBufferSize);
+    recv_buffer_->resize(kRecvBufferSize);
+    rtcp_.async_receive_from(boost::asio::buffer(recv_buffer_->data(), kRecvBufferSize), recv_from_, std::bind(&udp_transport::on_receive, this, _1, _2));
+}
+
+void udp_transport::on_receive(const boost::system::error_code& ec, std::size_t bytes)
+{
+    if (ec == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+    if (ec)
+    {
+        // 之前发往某个地址的包收到了 icmp 不可达，继续收
+        LOG_DEBUG("udp transport {} receive failed {}", port_ + 1, ec.message());
+        do_receive();
+        return;
+    }
+    udp_rtcp_received.fetch_add(1, std::memory_order_relaxed);
+    auto it = peers_.find(recv_from_);
+    if (it != peers_.end())
+    {
+        recv_buffer_->resize(bytes);
+        it->second(recv_buffer_);
+    }
+    do_receive();
+}
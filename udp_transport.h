@@ -0,0 +1,97 @@
+#ifndef SIMPLE_RTMP_UDP_TRANSPORT_H
+#define SIMPLE_RTMP_UDP_TRANSPORT_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <boost/asio.hpp>
+#include "frame_buffer.h"
+
+namespace simple_rtmp
+{
+struct udp_transport_stats
+{
+    uint64_t transports = 0;       // 已经绑定端口的 executor 数
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t syscalls = 0;         // sendmmsg 调用次数
+    uint64_t gso_messages = 0;     // 带 UDP_SEGMENT 的消息，一条消息里有多个包
+    uint64_t dropped = 0;          // 发送缓冲满或者出错丢掉的包
+    uint64_t rtcp_received = 0;
+};
+
+// rtp over udp 的发送端，每个 executor 一对 udp socket(rtp 偶数端口，rtcp 奇数端口)，这个 executor 上所有 udp 播放者共用
+// 同一轮事件里所有会话要发的包攒起来，结束时一次 sendmmsg 发出，发往同一个地址的连续等长包用 UDP_SEGMENT 合成一条消息
+// rtcp 端口收到的包按源地址分给会话
+// 除了 set_port_range 和 stats 都只能在所属的 io 线程上调用
+class udp_transport
+{
+   public:
+    using rtcp_cb = std::function<void(const frame_buffer::ptr& frame)>;
+
+   public:
+    ~udp_transport();
+    udp_transport(const udp_transport&) = delete;
+    udp_transport& operator=(const udp_transport&) = delete;
+
+   public:
+    // 在创建 executor 之前设置，从 base 开始两两一对分给各个 executor
+    static void set_port_range(uint16_t base, uint16_t count);
+    // 当前线程的 transport，第一次调用时分配端口，端口都被占用时返回 nullptr
+    static udp_transport* local(boost::asio::io_context& io);
+    static udp_transport_stats stats();
+
+   public:
+    uint16_t rtp_port() const;
+    uint16_t rtcp_port() const;
+    // 这一轮事件结束时发出，之前一直持有 frame，offset 之前的字节(交织头)不发送
+    void send_rtp(const boost::asio::ip::udp::endpoint& to, const frame_buffer::ptr& frame, std::size_t offset = 0);
+    void send_rtcp(const boost::asio::ip::udp::endpoint& to, const frame_buffer::ptr& frame, std::size_t offset = 0);
+    void add_peer(const boost::asio::ip::udp::endpoint& from, rtcp_cb cb);
+    void del_peer(const boost::asio::ip::udp::endpoint& from);
+
+   private:
+    struct packet
+    {
+        boost::asio::ip::udp::endpoint to;
+        frame_buffer::ptr frame;
+        std::size_t offset;
+        std::size_t size() const
+        {
+            return frame->size() - offset;
+        }
+    };
+    explicit udp_transport(boost::asio::io_context& io);
+    bool open();
+    void schedule_flush(std::vector<packet>& pending);
+    void flush();
+    void flush_socket(boost::asio::ip::udp::socket& socket, std::vector<packet>& pending);
+    std::size_t build_messages(std::vector<packet>& pending, std::size_t begin);
+    void do_receive();
+    void on_receive(const boost::system::error_code& ec, std::size_t bytes);
+
+   private:
+    boost::asio::io_context& io_;
+    boost::asio::ip::udp::socket rtp_;
+    boost::asio::ip::udp::socket rtcp_;
+    uint16_t port_ = 0;
+    bool gso_ = true;
+    bool flush_posted_ = false;
+    std::vector<packet> rtp_pending_;
+    std::vector<packet> rtcp_pending_;
+    // 复用，flush 时按消息填
+    std::vector<struct iovec> iovs_;
+    std::vector<struct mmsghdr> msgs_;
+    std::vector<std::size_t> msg_packets_;    // 每条消息包含的包数
+    std::vector<uint8_t> controls_;
+    pooled_frame_buffer::ptr recv_buffer_;
+    boost::asio::ip::udp::endpoint recv_from_;
+    std::map<boost::asio::ip::udp::endpoint, rtcp_cb> peers_;
+};
+
+}    // namespace simple_rtmp
+
+#endif